@@ -0,0 +1,379 @@
+#include "Platform/LocateFont.hxx"
+#include "Render/RenderContext.hxx"
+#include "SDL.h"
+#include "SDL_error.h"
+#include "SDL_hints.h"
+#include "SDL_video.h"
+#include "Syntax/Highlighter.hxx"
+#include "TextBuffer/TextBuffer.hxx"
+#include "UI/FrameScheduler.hxx"
+#include "UI/Input.hxx"
+#include "UI/View.hxx"
+#include "UI/ViewEditor.hxx"
+#include "Util/Assert.hxx"
+#include "Util/Profile.hxx"
+#include "src/Render/RenderFont.hxx"
+#include "src/Render/ShapeCache.hxx"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#define GL_GLEXT_PROTOTYPES
+#include "SDL_opengl.h"
+
+/* Drives the editor through scripted scenarios without a visible window, and
+ * prints the frame times of every scenario as one JSON object per line, so
+ * that they can be compared across commits.
+ *
+ * Unless SDL_VIDEODRIVER says otherwise, SDL's offscreen driver is used, which
+ * renders into an EGL pbuffer and works with Mesa's llvmpipe on machines
+ * without a GPU or display. The pbuffer has no buffer age, so every frame is
+ * repainted in full.
+ *
+ * usage: editor_bench [--replay trace] [font family] [file]
+ * without a file, a generated C++ file of kGeneratedLines lines is used.
+ * With --replay, an input trace recorded by the editor is replayed instead of
+ * the scenarios, which should be done with the file it was recorded with.
+ * Fails if scrolling over text which was drawn before allocates, see
+ * RunScenarios */
+
+static constexpr size_t kGeneratedLines = 200'000;
+static constexpr int kWindowW = 1920;
+static constexpr int kWindowH = 1080;
+
+static void ReadFile(TextBuffer &tb, const char *filename) {
+  std::ifstream file(filename, std::ios::binary);
+  assume(file.good(), "could not open the file to benchmark with");
+  std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  tb.InsertAt(tb.AtByteOffset(0), data.begin(), data.end());
+}
+
+/* a mix of short and long lines, comments and strings, so that lexing,
+ * shaping and wrapping all have work to do */
+static void GenerateFile(TextBuffer &tb, size_t lines) {
+  std::string text;
+  for (size_t i = 0; i < lines; i++) {
+    switch (i % 8) {
+    case 0:
+      text += "/* block " + std::to_string(i) + " of the generated file */\n";
+      break;
+    case 1:
+      text += "static int function_" + std::to_string(i) + "(int a, int b) {\n";
+      break;
+    case 2:
+      text += "  const char *s = \"a string literal with some words\";\n";
+      break;
+    case 3:
+      text += "  for (int i = 0; i < a; i++) { b += i * 3 + (b >> 2); }\n";
+      break;
+    case 4:
+      text += "  // " + std::string(40 + i % 200, 'x') + "\n";
+      break;
+    case 5:
+      text += "  return a + b;\n";
+      break;
+    case 6:
+      text += "}\n";
+      break;
+    case 7:
+      text += "\n";
+      break;
+    }
+  }
+  tb.InsertAt(tb.AtByteOffset(0), text.begin(), text.end());
+}
+
+struct Samples {
+  std::vector<double> cpu_ms;
+  std::vector<double> gpu_ms;
+  std::vector<double> quads;
+  /* heap allocations of the main thread and the render thread, only counted
+   * with EDITOR_COUNT_ALLOCATIONS */
+  std::vector<double> allocations;
+};
+
+static void PrintPercentiles(const char *name, std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  auto at = [&](double p) {
+    if (values.empty())
+      return 0.0;
+    return values[std::min<size_t>(values.size() * p, values.size() - 1)];
+  };
+  printf("\"%s\":{\"samples\":%zu,\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,"
+         "\"p999\":%.4f,\"max\":%.4f}",
+         name, values.size(), at(0.5), at(0.9), at(0.99), at(0.999),
+         values.empty() ? 0.0 : values.back());
+}
+
+struct Bench {
+  SDL_Window *window;
+  RenderContext &rctx;
+  View &root;
+  /* frame of the GPU stats which were last sampled */
+  uint64_t gpu_frame;
+
+  /* draws and commits a single frame, as the main loop of the editor does */
+  void Frame(Samples *samples) {
+    /* the render thread reports its allocations once it submitted the frame,
+     * so they are counted for a later frame */
+    const uint64_t allocations =
+        ProfileAllocations() + rctx.last_render_allocations;
+    const uint64_t begin = ProfileNow();
+    root.draw(rctx);
+    const double quads = rctx.quads_pushed;
+    rctx.Commit();
+    const uint64_t end = ProfileNow();
+    const double allocated =
+        ProfileAllocations() + rctx.last_render_allocations - allocations;
+
+    if (samples == nullptr)
+      return;
+    samples->cpu_ms.push_back((end - begin) / 1e6);
+    samples->quads.push_back(quads);
+    samples->allocations.push_back(allocated);
+    /* only the most recent frame whose timer queries are available is kept,
+     * so some frames have no GPU sample */
+    const RenderContext::GPUFrameStats &gpu = rctx.last_gpu_stats;
+    if (gpu.frame != UINT64_MAX && gpu.frame != gpu_frame) {
+      samples->gpu_ms.push_back(gpu.total_ns / 1e6);
+      gpu_frame = gpu.frame;
+    }
+  }
+
+  /* draws until glyphs are rasterized and highlighting caught up, so that
+   * scenarios do not measure the work left over from the previous one */
+  void Settle(void) {
+    for (int i = 0; i < 10'000 && root.is_animating; i++) {
+      Frame(nullptr);
+      SDL_Delay(1);
+    }
+    rctx.Finish();
+    Frame(nullptr);
+    gpu_frame = rctx.last_gpu_stats.frame;
+  }
+
+  Samples Run(const char *name, int frames, std::function<void(int)> step) {
+    Settle();
+    Samples samples;
+    for (int i = 0; i < frames; i++) {
+      step(i);
+      Frame(&samples);
+    }
+
+    printf("{\"scenario\":\"%s\",\"frames\":%d,", name, frames);
+    PrintPercentiles("cpu_ms", samples.cpu_ms);
+    printf(",");
+    PrintPercentiles("gpu_ms", samples.gpu_ms);
+    printf(",");
+    PrintPercentiles("quads", samples.quads);
+    printf(",");
+    PrintPercentiles("allocations", samples.allocations);
+    printf("}\n");
+    fflush(stdout);
+    return samples;
+  }
+
+  /* handles the events at the times they were recorded, and draws frames
+   * like the main loop of the editor does, at the default refresh rate. The
+   * latency of an event is the time from when it was due until the first
+   * frame drawn after it was swapped */
+  void Replay(const std::vector<InputEvent> &events, InputHandler &input) {
+    Settle();
+    Samples samples;
+    std::vector<double> latency_ms;
+    /* due times of the events which were handled but not drawn yet */
+    std::vector<uint64_t> undrawn;
+    std::vector<InputEvent> arrived;
+    FrameScheduler scheduler(FrameScheduler::FrameNsForRefreshRate(0));
+    const uint64_t start = ProfileNow();
+
+    size_t next = 0;
+    while ((next < events.size() || !undrawn.empty()) && !input.quit) {
+      const uint64_t now = ProfileNow();
+      const uint64_t since_start = now - start;
+
+      /* every event which is due arrived before the next frame */
+      arrived.clear();
+      for (; next < events.size() && events[next].time_ns <= since_start;
+           next++) {
+        arrived.push_back(events[next]);
+        undrawn.push_back(events[next].time_ns);
+      }
+      if (!arrived.empty()) {
+        CoalesceInputEvents(arrived);
+        for (const InputEvent &event : arrived) {
+          if (event.type == InputEvent::kResize) {
+            SDL_SetWindowSize(window, event.w, event.h);
+          }
+          input.Handle(event);
+        }
+        scheduler.InputArrived();
+      }
+
+      if (!scheduler.FrameDue(now, root.is_animating)) {
+        uint64_t wait = scheduler.WaitNs(now, root.is_animating);
+        if (next < events.size()) {
+          wait = std::min(wait, events[next].time_ns - since_start);
+        }
+        std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+        continue;
+      }
+
+      input.ApplyScroll();
+      Frame(&samples);
+      scheduler.FrameDrawn(now);
+      const uint64_t drawn = ProfileNow() - start;
+      for (uint64_t due : undrawn) {
+        latency_ms.push_back((drawn - due) / 1e6);
+      }
+      undrawn.clear();
+    }
+
+    printf("{\"scenario\":\"replay\",\"events\":%zu,\"frames\":%zu,",
+           events.size(), samples.cpu_ms.size());
+    PrintPercentiles("latency_ms", latency_ms);
+    printf(",");
+    PrintPercentiles("cpu_ms", samples.cpu_ms);
+    printf(",");
+    PrintPercentiles("gpu_ms", samples.gpu_ms);
+    printf(",");
+    PrintPercentiles("quads", samples.quads);
+    printf(",");
+    PrintPercentiles("allocations", samples.allocations);
+    printf("}\n");
+    fflush(stdout);
+  }
+
+  void Resize(int w, int h) {
+    SDL_SetWindowSize(window, w, h);
+    rctx.win_w = w;
+    rctx.win_h = h;
+    rctx.UpdateProjection();
+  }
+};
+
+/* returns false if a frame scrolling over text which was drawn before
+ * allocated from the heap, which is only counted with
+ * EDITOR_COUNT_ALLOCATIONS */
+static bool RunScenarios(Bench &bench, ViewEditor &editor, TextBuffer &tb,
+                         int line_height) {
+  /* three lines per frame, like a fast mouse wheel */
+  bench.Run("scroll", 3000, [&](int) { editor.ScrollPx(3 * line_height); });
+
+  /* the lines are shaped and their glyphs are in the atlas, so these frames
+   * only reuse memory of earlier frames */
+  const Samples scroll_back = bench.Run(
+      "scroll back", 1000, [&](int) { editor.ScrollPx(-3 * line_height); });
+  const size_t allocating = std::count_if(
+      scroll_back.allocations.begin(), scroll_back.allocations.end(),
+      [](double allocations) { return allocations > 0; });
+  if (allocating > 0) {
+    fprintf(stderr, "%zu frames allocated while scrolling back\n", allocating);
+  }
+
+  bench.Run("page down", 500, [&](int) {
+    editor.ScrollPx(kWindowH / line_height * line_height);
+  });
+
+  /* a character per frame, in the middle of the file */
+  editor.first_line = tb.num_lines / 2;
+  editor.offset_px = 0;
+  editor.cursor = tb.PersistIterator(tb.AtByteOffset(tb.num_bytes / 2));
+  bench.Run("type", 10'000, [&](int i) {
+    const std::string_view text = i % 80 == 79 ? "\n" : "a";
+    tb.InsertAt(*editor.cursor, text.begin(), text.end());
+  });
+
+  bench.Run("resize", 500, [&](int i) {
+    const int step = i % 100 < 50 ? i % 50 : 50 - i % 50;
+    bench.Resize(kWindowW - step * 16, kWindowH - step * 8);
+  });
+
+  return allocating == 0;
+}
+
+int main(int argc, char **argv) {
+  std::optional<std::vector<InputEvent>> replay;
+  int arg = 1;
+  if (argc > 2 && std::string_view(argv[1]) == "--replay") {
+    replay = ReadInputTrace(argv[2]);
+    assume(replay.has_value(), "could not read the input trace");
+    arg = 3;
+  }
+  assume(argc - arg <= 2, "expects an optional font family and filename");
+  const char *font_family = argc > arg ? argv[arg] : "monospace";
+  const char *filename = argc > arg + 1 ? argv[arg + 1] : nullptr;
+
+  assume(LocateFontInit(), "failed to init font locator");
+  std::optional<std::string> font_path = LocateFontFile(
+      {font_family, 24.0, FontFaceProperties::WEIGHT_REGULAR,
+       FontFaceProperties::STRETCH_MEDIUM, FontFaceProperties::SLANT_NORMAL});
+  assume(font_path.has_value(), "couldn't locate font");
+
+  /* the environment variable takes precedence over a default priority hint */
+  SDL_SetHintWithPriority(SDL_HINT_VIDEODRIVER, "offscreen", SDL_HINT_DEFAULT);
+  int err = SDL_Init(SDL_INIT_VIDEO);
+  assume(err == 0, SDL_GetError);
+
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+  SDL_Window *window =
+      SDL_CreateWindow("bench", SDL_WINDOWPOS_UNDEFINED,
+                       SDL_WINDOWPOS_UNDEFINED, kWindowW, kWindowH,
+                       SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL);
+  assume(window != nullptr, SDL_GetError);
+  SDL_GLContext context = SDL_GL_CreateContext(window);
+  assume(context != nullptr, SDL_GetError);
+  SDL_GL_SetSwapInterval(0);
+
+  RenderContext rctx(window);
+  rctx.Init();
+#ifndef __APPLE__
+  /* frames are submitted the way the editor submits them */
+  rctx.Start();
+#endif /* __APPLE__ */
+  auto font = LoadFont(&rctx, font_path.value(), 12.0);
+  assume(font, "could not render font");
+
+  TextBuffer tb;
+  if (filename != nullptr) {
+    ReadFile(tb, filename);
+  } else {
+    GenerateFile(tb, kGeneratedLines);
+  }
+
+  ShapeCache shapes(8 << 20);
+  Highlighter highlighter;
+  highlighter.Start();
+  auto editor = ViewEditor(*font, shapes, highlighter, tb);
+  editor.cursor = tb.PersistIterator(tb.AtByteOffset(0));
+  auto root = ViewRoot(editor);
+
+  Bench bench = {window, rctx, root, UINT64_MAX};
+  const int line_height = font->line_height;
+
+  bool passed = true;
+  if (replay) {
+    InputHandler input(editor, rctx);
+    bench.Replay(*replay, input);
+  } else {
+    passed = RunScenarios(bench, editor, tb, line_height);
+  }
+
+  rctx.Stop();
+  SDL_GL_DeleteContext(context);
+  SDL_DestroyWindow(window);
+  LocateFontDeinit();
+  SDL_Quit();
+  return passed ? 0 : 1;
+}
@@ -1,4 +1,5 @@
-#include "Platform/LocateFont.hxx"
+#include "Platform/CacheDirectory.hxx"
+#include "Platform/FontLocator.hxx"
 #include "Render/RenderContext.hxx"
 #include "SDL.h"
 #include "SDL_error.h"
@@ -6,17 +7,26 @@
 #include "SDL_keycode.h"
 #include "SDL_timer.h"
 #include "SDL_video.h"
+#include "Syntax/Highlighter.hxx"
 #include "TextBuffer/TextBuffer.hxx"
+#include "UI/FrameScheduler.hxx"
+#include "UI/Input.hxx"
 #include "UI/View.hxx"
 #include "UI/ViewEditor.hxx"
+#include "UI/ViewMinimap.hxx"
+#include "UI/ViewProfile.hxx"
 #include "Util/Assert.hxx"
+#include "Util/Profile.hxx"
 #include "src/Render/RenderFont.hxx"
+#include "src/Render/ShapeCache.hxx"
+#include <algorithm>
 #include <chrono>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
 
 #define GL_GLEXT_PROTOTYPES
 #include "SDL_opengl.h"
@@ -44,16 +54,29 @@ void readFile(TextBuffer &tb, const char *filename) {
   tb.InsertAt(tb.AtByteOffset(0), data.begin(), data.end());
 }
 
+static double MillisecondsBetween(std::chrono::steady_clock::time_point t0,
+                                  std::chrono::steady_clock::time_point t1) {
+  return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
 int main(int argc, char **argv) {
-  assume(argc == 3,
-         "expects exactly one font argument and one filename argument");
-
-  // LocateFont init
-  assume(LocateFontInit(), "failed to init font locator");
-  std::optional<std::string> font_path = LocateFontFile(
-      {argv[1], 24.0, FontFaceProperties::WEIGHT_REGULAR,
-       FontFaceProperties::STRETCH_MEDIUM, FontFaceProperties::SLANT_NORMAL});
-  assume(font_path.has_value(), "couldn't locate font");
+  assume(argc == 3 || argc == 4,
+         "expects a font argument, a filename argument, and optionally a file "
+         "to record input into");
+  /* replayed by editor_bench --replay */
+  const char *record_path = argc == 4 ? argv[3] : nullptr;
+
+  const auto start_time = std::chrono::steady_clock::now();
+  PROFILE_THREAD_NAME("main");
+
+  /* the font is located on a worker thread while the window is created,
+   * unless the path is cached from a previous run */
+  std::optional<std::string> cache_dir = CacheDirectory();
+  auto locator = std::make_unique<FontLocator>(
+      FontFaceProperties{argv[1], 24.0, FontFaceProperties::WEIGHT_REGULAR,
+                         FontFaceProperties::STRETCH_MEDIUM,
+                         FontFaceProperties::SLANT_NORMAL},
+      cache_dir ? std::optional(*cache_dir + "/fonts.bin") : std::nullopt);
 
   // SDL2 init
   int err = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
@@ -84,131 +107,185 @@ int main(int argc, char **argv) {
   int w, h;
   SDL_GetWindowSize(window, &w, &h);
   rctx.Init();
+#ifndef __APPLE__
+  /* Cocoa expects windows to be swapped on the main thread */
+  rctx.Start();
+#endif /* __APPLE__ */
+  const auto window_created_time = std::chrono::steady_clock::now();
+
+  std::optional<std::string> font_path = locator->Get();
+  assume(font_path.has_value(), "couldn't locate font");
+  const FontLocator::Stats locate = locator->stats;
+  /* the font location service is not needed anymore */
+  locator.reset();
+  const auto font_located_time = std::chrono::steady_clock::now();
+
   auto font = LoadFont(&rctx, font_path.value(), 12.0);
   assume(font, "could not render font");
+  const auto font_loaded_time = std::chrono::steady_clock::now();
 
   TextBuffer tb;
   readFile(tb, argv[2]);
 
-  auto editor = ViewEditor(*font, tb);
+  /* shaped runs are small, this is enough for tens of thousands of lines */
+  ShapeCache shapes(8 << 20);
+  Highlighter highlighter;
+  highlighter.Start();
+  auto editor = ViewEditor(*font, shapes, highlighter, tb);
   editor.first_line = 0;
   editor.cursor = tb.PersistIterator(tb.AtByteOffset(0));
-  auto root = ViewRoot(editor);
+  Minimap minimap(highlighter);
+  minimap.Start();
+  auto overview = ViewMinimap(minimap, editor);
+  auto split = ViewSplit(editor, overview, ViewMinimap::kWidth);
+  auto overlay = ViewProfile(split, *font, shapes);
+  auto root = ViewRoot(overlay);
 
   SDL_Event event;
   bool running = true;
-  const uint64_t frame_ms = 1000 / 120;
-  uint64_t last_render_time = 0;
-  int frame_num = 0;
+  /* the window is created on the display dm was queried from, swapping does
+   * not wait for vsync, so frames are paced by the scheduler */
+  FrameScheduler scheduler(
+      FrameScheduler::FrameNsForRefreshRate(dm.refresh_rate));
+  std::vector<InputEvent> input_events;
 
-  float scroll_accum = 0;
+  InputHandler input(editor, rctx);
+  std::vector<InputEvent> recorded;
+  const uint64_t record_start_ms = SDL_GetTicks64();
+  if (record_path != nullptr) {
+    /* replays start from the same window size */
+    recorded.push_back({InputEvent::kResize, 0, w, h, 0, 0, 0, {}});
+  }
+  /* startup is over once the first frame is drawn without placeholders */
+  bool startup_reported = false;
 
   while (running) {
-    auto t0 = std::chrono::high_resolution_clock::now();
+    /* waits for input, or until the next frame is due, rounding up so that
+     * the loop does not spin for the last fraction of a millisecond. A due
+     * frame waits for the render thread to take the previous ones, while
+     * input keeps being handled */
+    uint64_t wait_ns = scheduler.WaitNs(ProfileNow(), root.is_animating);
+    if (wait_ns == 0 && !rctx.FrameReady()) {
+      wait_ns = 1'000'000;
+    }
     /* TODO: error handling */
     int event_present = 0;
-    if (root.is_animating) {
-      int64_t remaining_time = frame_ms - (SDL_GetTicks64() - last_render_time);
-      if (remaining_time > 2) {
-        event_present = SDL_WaitEventTimeout(&event, remaining_time);
-      }
-    } else {
+    if (wait_ns == UINT64_MAX) {
       event_present = SDL_WaitEvent(&event);
+    } else if (wait_ns > 0) {
+      event_present =
+          SDL_WaitEventTimeout(&event, (wait_ns + 999'999) / 1'000'000);
     }
 
-    if (event_present) {
-      switch (event.type) {
-      case SDL_WINDOWEVENT:
-        if (event.window.event == SDL_WINDOWEVENT_RESIZED ||
-            event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-          rctx.win_w = event.window.data1;
-          rctx.win_h = event.window.data2;
-          rctx.UpdateProjection();
-          /* TODO: better way to force rerender */
-          // last_render_time = 0;
-        }
-        break;
-      case SDL_MOUSEWHEEL:
-        scroll_accum += event.wheel.preciseY;
-        break;
-
-      case SDL_TEXTINPUT: {
-        std::string_view text(event.text.text);
-        tb.InsertAt(*editor.cursor, text.begin(), text.end());
-        break;
+    /* takes every pending event, so that a burst is handled in one frame */
+    input_events.clear();
+    auto take = [&](const SDL_Event &sdl_event) {
+      /* SDL timestamps are in milliseconds since SDL_Init */
+      const uint64_t since_start_ms = std::max<int64_t>(
+          (int64_t)sdl_event.common.timestamp - (int64_t)record_start_ms, 0);
+      std::optional<InputEvent> input_event =
+          InputEventFromSDL(sdl_event, since_start_ms * 1'000'000);
+      if (!input_event)
+        return;
+      if (record_path != nullptr) {
+        recorded.push_back(*input_event);
       }
+      input_events.push_back(std::move(*input_event));
+    };
+    if (event_present) {
+      take(event);
+    }
+    SDL_PumpEvents();
+    while (SDL_PeepEvents(&event, 1, SDL_GETEVENT, SDL_FIRSTEVENT,
+                          SDL_LASTEVENT) > 0) {
+      take(event);
+    }
 
-      case SDL_KEYDOWN:
-        switch (event.key.keysym.sym) {
-        case SDLK_UP:
-          if (event.key.keysym.mod & KMOD_SHIFT) {
-            editor.PageUp();
-          } else {
-            editor.ScrollLines(-1);
-          }
-          break;
-        case SDLK_DOWN:
-          if (event.key.keysym.mod & KMOD_SHIFT) {
-            editor.PageDown();
+    if (!input_events.empty()) {
+      PROFILE_ZONE("HandleEvents");
+      CoalesceInputEvents(input_events);
+      for (const InputEvent &input_event : input_events) {
+        input.Handle(input_event);
+
+        if (input_event.type == InputEvent::kKeyDown &&
+            input_event.key == SDLK_F11) {
+          const std::string trace_path = "editor-trace.json";
+          if (ProfileWriteTrace(trace_path)) {
+            std::cerr << "wrote trace to " << trace_path << "\n";
           } else {
-            editor.ScrollLines(1);
+            std::cerr << "could not write trace to " << trace_path << "\n";
           }
-          break;
-        case SDLK_RIGHT:
-          if (*editor.cursor < editor.buffer.end())
-            (*editor.cursor)++;
-          break;
-        case SDLK_LEFT:
-          if (editor.buffer.begin() < *editor.cursor)
-            (*editor.cursor)--;
-          break;
-        case SDLK_RETURN:
-          std::string_view newline = "\n";
-          tb.InsertAt(*editor.cursor, newline.begin(), newline.end());
-          break;
         }
-        break;
-      case SDL_MOUSEBUTTONDOWN:
-      case SDL_QUIT:
-        running = false;
-        break;
+        if (input_event.type == InputEvent::kKeyDown &&
+            input_event.key == SDLK_F12) {
+          overlay.Toggle();
+        }
       }
+      running = !input.quit;
+      scheduler.InputArrived();
     }
 
-    /* TODO: fix */
-    // if (SDL_GetTicks64() - last_render_time > frame_ms) {
-    editor.target_px += -scroll_accum * 3 * (int)font->line_height;
-    scroll_accum = 0;
-    auto t1 = std::chrono::high_resolution_clock::now();
-    root.draw(rctx);
-    auto t2 = std::chrono::high_resolution_clock::now();
+    const uint64_t frame_start = ProfileNow();
+    if (!running || !scheduler.FrameDue(frame_start, root.is_animating) ||
+        !rctx.FrameReady())
+      continue;
+
+    input.ApplyScroll();
+    const uint64_t allocations =
+        ProfileAllocations() + rctx.last_render_allocations;
+    {
+      PROFILE_ZONE("draw");
+      root.draw(rctx);
+    }
     rctx.Commit();
-    auto t3 = std::chrono::high_resolution_clock::now();
-
-    if (frame_num % 60 == 0) {
-      std::chrono::duration<double, std::nano> total_time =
-          std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t0);
-      std::chrono::duration<double, std::nano> layout_time =
-          std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1);
-      std::chrono::duration<double, std::nano> commit_time =
-          std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2);
-      std::cerr << "\nnew frame:\n";
-      std::cerr << "layout: " << layout_time.count() << "ns\n";
-      std::cerr << "commit: " << commit_time.count() << "ns\n";
-      std::cerr << "total draw:  " << layout_time.count() + commit_time.count()
-                << "ns\n";
-      std::cerr << "total draw + events:  " << total_time.count() << "ns\n";
-      std::cerr << "fps: "
-                << 1000000000 / (layout_time.count() + commit_time.count())
-                << " fps\n";
+    /* of this thread and the render thread, whose allocations are reported
+     * a frame or two late. Expected to stay at 0 while scrolling over text
+     * which was drawn before */
+    PROFILE_COUNTER("heap allocations", ProfileAllocations() +
+                                            rctx.last_render_allocations -
+                                            allocations);
+    PROFILE_FRAME();
+
+    if (!startup_reported && !font->GlyphsPending()) {
+      startup_reported = true;
+      const auto now = std::chrono::steady_clock::now();
+      const RenderFont::LoadStats &load = font->load_stats;
+      std::cerr << "startup: " << MillisecondsBetween(start_time, now)
+                << "ms\n";
+      std::cerr << "  create window: "
+                << MillisecondsBetween(start_time, window_created_time)
+                << "ms\n";
+      std::cerr << "  locate font: "
+                << MillisecondsBetween(window_created_time, font_located_time)
+                << "ms after the window (path cache "
+                << (locate.cache_hit ? "hit" : "miss") << ", lookup "
+                << locate.lookup / 1e6 << "ms, init " << locate.init / 1e6
+                << "ms, match " << locate.match / 1e6 << "ms, waited "
+                << locate.wait / 1e6 << "ms)\n";
+      std::cerr << "  load font: "
+                << MillisecondsBetween(font_located_time, font_loaded_time)
+                << "ms (atlas cache " << (load.cache_hit ? "hit" : "miss")
+                << ", read cache " << load.read_cache / 1e6
+                << "ms, prepare atlas " << load.prepare_atlas / 1e6
+                << "ms, upload " << load.upload / 1e6 << "ms)\n";
+      if (load.cache_hit) {
+        std::cerr << "  open font face for shaping: " << load.open_face / 1e6
+                  << "ms on a thread, the first draw waited "
+                  << load.wait_face / 1e6 << "ms\n";
+      }
+      std::cerr << "  until glyphs are rasterized and drawn: "
+                << MillisecondsBetween(font_loaded_time, now) << "ms\n";
     }
-    last_render_time = SDL_GetTicks64();
-    frame_num++;
-    frame_num %= 60;
-    //}
+
+    scheduler.FrameDrawn(frame_start);
+  }
+
+  if (record_path != nullptr) {
+    assume(WriteInputTrace(record_path, recorded),
+           "could not write the input trace");
   }
 
-  LocateFontDeinit();
+  rctx.Stop();
   SDL_GL_DeleteContext(context);
   SDL_DestroyWindow(window);
   SDL_Quit();
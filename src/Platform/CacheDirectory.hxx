@@ -0,0 +1,9 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+/* Returns the directory for cache files of the editor, creating it if it does
+ * not exist yet. Returns nullopt if there is no usable cache directory.
+ * The contents of the directory may be deleted at any time */
+std::optional<std::string> CacheDirectory(void);
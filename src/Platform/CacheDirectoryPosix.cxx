@@ -0,0 +1,34 @@
+#include "CacheDirectory.hxx"
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
+
+static bool CreateDirectory(const std::string &path) {
+  return mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+std::optional<std::string> CacheDirectory(void) {
+  const char *home = getenv("HOME");
+
+#ifdef __APPLE__
+  if (home == nullptr || *home == '\0')
+    return std::nullopt;
+  std::string base = std::string(home) + "/Library/Caches";
+#else
+  /* https://specifications.freedesktop.org/basedir-spec/latest/ */
+  std::string base;
+  const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+  if (xdg_cache_home != nullptr && *xdg_cache_home == '/') {
+    base = xdg_cache_home;
+  } else if (home != nullptr && *home != '\0') {
+    base = std::string(home) + "/.cache";
+  } else {
+    return std::nullopt;
+  }
+#endif
+
+  std::string dir = base + "/editor";
+  if (!CreateDirectory(base) || !CreateDirectory(dir))
+    return std::nullopt;
+  return dir;
+}
@@ -0,0 +1,190 @@
+#include "FontLocator.hxx"
+#include "../Util/CacheFile.hxx"
+#include "../Util/Profile.hxx"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+/* the layout of the file is
+ * - magic and version
+ * - the number of entries
+ * - every entry, see PutEntry
+ * Changing the layout requires incrementing the version */
+static constexpr char kMagic[8] = {'E', 'D', 'F', 'O', 'N', 'T', 'S', '\0'};
+static constexpr uint32_t kVersion = 1;
+/* most recently stored last, the oldest are dropped past this */
+static constexpr size_t kMaxEntries = 16;
+
+struct FontPathEntry {
+  FontFaceProperties face;
+  std::string path;
+  /* of the font file when it was located, in nanoseconds */
+  int64_t mtime;
+  uint64_t size;
+};
+
+static bool SameFace(const FontFaceProperties &a, const FontFaceProperties &b) {
+  return a.family_name == b.family_name && a.pt_size == b.pt_size &&
+         a.weight == b.weight && a.stretch == b.stretch && a.slant == b.slant;
+}
+
+/* returns false if the file does not exist */
+static bool FileVersion(const std::string &path, int64_t *mtime,
+                        uint64_t *size) {
+  std::error_code err;
+  const auto time = std::filesystem::last_write_time(path, err);
+  if (err)
+    return false;
+  *size = std::filesystem::file_size(path, err);
+  if (err)
+    return false;
+  *mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+               time.time_since_epoch())
+               .count();
+  return true;
+}
+
+static std::vector<FontPathEntry> ReadEntries(const std::string &cache_path) {
+  std::vector<FontPathEntry> entries;
+  const std::optional<std::vector<uint8_t>> data = ReadCacheFile(cache_path);
+  if (!data)
+    return entries;
+
+  CacheReader r = {data->data(), data->data() + data->size()};
+  const uint8_t *magic = r.GetBytes(sizeof(kMagic));
+  uint32_t version;
+  uint32_t num_entries;
+  if (magic == nullptr || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      !r.Get(&version) || version != kVersion || !r.Get(&num_entries))
+    return entries;
+
+  for (uint32_t i = 0; i < num_entries; i++) {
+    FontPathEntry entry;
+    uint32_t weight, stretch, slant;
+    if (!r.GetString(&entry.face.family_name) || !r.Get(&entry.face.pt_size) ||
+        !r.Get(&weight) || !r.Get(&stretch) || !r.Get(&slant) ||
+        !r.GetString(&entry.path) || !r.Get(&entry.mtime) ||
+        !r.Get(&entry.size)) {
+      /* a corrupt file is replaced on the next store */
+      entries.clear();
+      return entries;
+    }
+    entry.face.weight = (FontFaceProperties::Weight)weight;
+    entry.face.stretch = (FontFaceProperties::Stretch)stretch;
+    entry.face.slant = (FontFaceProperties::Slant)slant;
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+static void PutEntry(CacheWriter &w, const FontPathEntry &entry) {
+  w.PutString(entry.face.family_name);
+  w.Put(entry.face.pt_size);
+  w.Put((uint32_t)entry.face.weight);
+  w.Put((uint32_t)entry.face.stretch);
+  w.Put((uint32_t)entry.face.slant);
+  w.PutString(entry.path);
+  w.Put(entry.mtime);
+  w.Put(entry.size);
+}
+
+std::optional<std::string> LookupFontPath(const std::string &cache_path,
+                                          const FontFaceProperties &face) {
+  for (const FontPathEntry &entry : ReadEntries(cache_path)) {
+    if (!SameFace(entry.face, face))
+      continue;
+
+    int64_t mtime;
+    uint64_t size;
+    if (!FileVersion(entry.path, &mtime, &size) || mtime != entry.mtime ||
+        size != entry.size)
+      return std::nullopt;
+    return entry.path;
+  }
+  return std::nullopt;
+}
+
+bool StoreFontPath(const std::string &cache_path,
+                   const FontFaceProperties &face,
+                   const std::string &font_path) {
+  FontPathEntry stored = {face, font_path, 0, 0};
+  if (!FileVersion(font_path, &stored.mtime, &stored.size))
+    return false;
+
+  std::vector<FontPathEntry> entries = ReadEntries(cache_path);
+  std::erase_if(entries, [&](const FontPathEntry &entry) {
+    return SameFace(entry.face, face);
+  });
+  if (entries.size() >= kMaxEntries) {
+    entries.erase(entries.begin(),
+                  entries.begin() + (entries.size() - kMaxEntries + 1));
+  }
+  entries.push_back(std::move(stored));
+
+  CacheWriter w;
+  w.PutBytes(kMagic, sizeof(kMagic));
+  w.Put(kVersion);
+  w.Put((uint32_t)entries.size());
+  for (const FontPathEntry &entry : entries) {
+    PutEntry(w, entry);
+  }
+  return WriteCacheFile(cache_path, w.data);
+}
+
+static double NanosecondsSince(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - t0)
+      .count();
+}
+
+FontLocator::FontLocator(const FontFaceProperties &face,
+                         std::optional<std::string> cache_path)
+    : stats(), face(face), cache_path(std::move(cache_path)),
+      initialized(false) {
+  if (this->cache_path) {
+    const auto t0 = std::chrono::steady_clock::now();
+    font_path = LookupFontPath(*this->cache_path, face);
+    stats.lookup = NanosecondsSince(t0);
+  }
+  stats.cache_hit = font_path.has_value();
+  if (!stats.cache_hit) {
+    worker = std::thread(&FontLocator::Work, this);
+  }
+}
+
+FontLocator::~FontLocator() {
+  if (worker.joinable()) {
+    worker.join();
+  }
+  if (initialized) {
+    LocateFontDeinit();
+  }
+}
+
+void FontLocator::Work(void) {
+  PROFILE_THREAD_NAME("font locator");
+  auto t0 = std::chrono::steady_clock::now();
+  initialized = LocateFontInit();
+  stats.init = NanosecondsSince(t0);
+  if (!initialized)
+    return;
+
+  t0 = std::chrono::steady_clock::now();
+  font_path = LocateFontFile(face);
+  stats.match = NanosecondsSince(t0);
+
+  /* off the startup path, so a failure to store only costs the next start */
+  if (font_path && cache_path) {
+    StoreFontPath(*cache_path, face, *font_path);
+  }
+}
+
+std::optional<std::string> FontLocator::Get(void) {
+  if (worker.joinable()) {
+    const auto t0 = std::chrono::steady_clock::now();
+    worker.join();
+    stats.wait = NanosecondsSince(t0);
+  }
+  return font_path;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "LocateFont.hxx"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+
+/* Paths found by LocateFontFile, persisted between runs in a cache file.
+ *
+ * An entry is only used while the font file has the same modification time
+ * and size as when it was located. Fonts which are installed later and would
+ * match better are not noticed until the located file changes or the cache is
+ * deleted */
+std::optional<std::string> LookupFontPath(const std::string &cache_path,
+                                          const FontFaceProperties &);
+/* adds or replaces the entry of the face, returns false on failure */
+bool StoreFontPath(const std::string &cache_path, const FontFaceProperties &,
+                   const std::string &font_path);
+
+/* Locates a font without blocking startup on the font location service.
+ *
+ * On a cache hit the service is not initialized at all. Otherwise it is
+ * initialized and queried on a worker thread, while the caller goes on e.g.
+ * creating the window, and the result is stored in the cache */
+struct FontLocator {
+  /* durations in nanoseconds */
+  struct Stats {
+    bool cache_hit;
+    double lookup;
+    /* LocateFontInit and LocateFontFile, on the worker thread */
+    double init;
+    double match;
+    /* time Get waited for the worker thread */
+    double wait;
+  };
+
+  /* cache_path may be nullopt if there is no cache directory */
+  FontLocator(const FontFaceProperties &,
+              std::optional<std::string> cache_path);
+  FontLocator(FontLocator const &) = delete;
+  FontLocator &operator=(FontLocator const &) = delete;
+  /* deinitializes the font location service if it was initialized, which can
+   * not be initialized again afterwards */
+  ~FontLocator();
+
+  /* waits for the worker thread, returns nullopt if no font was found */
+  std::optional<std::string> Get(void);
+
+  Stats stats;
+
+private:
+  void Work(void);
+
+  FontFaceProperties face;
+  std::optional<std::string> cache_path;
+  std::thread worker;
+  bool initialized;
+  std::optional<std::string> font_path;
+};
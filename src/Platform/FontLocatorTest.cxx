@@ -0,0 +1,62 @@
+#include "FontLocator.hxx"
+#include "catch2/catch.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+TEST_CASE("font path cache", "[FontLocator]") {
+  const std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "editor_font_locator_test";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  const std::string cache_path = (dir / "fonts.bin").string();
+  const std::string font_path = (dir / "font.ttf").string();
+  std::ofstream(font_path) << "not really a font";
+
+  const FontFaceProperties face = {"Mono", 24.0,
+                                   FontFaceProperties::WEIGHT_REGULAR,
+                                   FontFaceProperties::STRETCH_MEDIUM,
+                                   FontFaceProperties::SLANT_NORMAL};
+  FontFaceProperties bold = face;
+  bold.weight = FontFaceProperties::WEIGHT_BOLD;
+
+  REQUIRE(!LookupFontPath(cache_path, face));
+  REQUIRE(StoreFontPath(cache_path, face, font_path));
+  REQUIRE(LookupFontPath(cache_path, face) == font_path);
+  REQUIRE(!LookupFontPath(cache_path, bold));
+  /* fonts which do not exist are not stored */
+  REQUIRE(!StoreFontPath(cache_path, bold, (dir / "missing.ttf").string()));
+
+  SECTION("hits skip the font location service") {
+    FontLocator locator(face, cache_path);
+    REQUIRE(locator.Get() == font_path);
+    REQUIRE(locator.stats.cache_hit);
+  }
+
+  SECTION("entries of changed fonts are not used") {
+    std::ofstream(font_path, std::ios::app) << ", and longer";
+    REQUIRE(!LookupFontPath(cache_path, face));
+
+    /* until the font is located again */
+    REQUIRE(StoreFontPath(cache_path, face, font_path));
+    REQUIRE(LookupFontPath(cache_path, face) == font_path);
+  }
+
+  SECTION("old entries are dropped") {
+    for (int i = 0; i < 100; i++) {
+      FontFaceProperties sized = face;
+      sized.pt_size = 100 + i;
+      REQUIRE(StoreFontPath(cache_path, sized, font_path));
+    }
+    REQUIRE(!LookupFontPath(cache_path, face));
+    REQUIRE(std::filesystem::file_size(cache_path) < 4096);
+  }
+
+  SECTION("corrupt files are ignored") {
+    std::filesystem::resize_file(cache_path,
+                                 std::filesystem::file_size(cache_path) - 1);
+    REQUIRE(!LookupFontPath(cache_path, face));
+    REQUIRE(StoreFontPath(cache_path, face, font_path));
+    REQUIRE(LookupFontPath(cache_path, face) == font_path);
+  }
+}
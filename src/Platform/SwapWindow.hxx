@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../Render/Types.hxx"
+#include "SDL.h"
+#include <vector>
+
+/* Looks up the extensions for presenting partial updates on the current GL
+ * context of the window.
+ * Requires the GL context to be created and current
+ * THREAD-UNSAFE */
+void SwapWindowInit(SDL_Window *);
+
+/* Returns the number of frames since the contents of the back buffer were
+ * presented, or 0 if the contents are undefined and the whole window has to be
+ * redrawn.
+ * Must be called before drawing into the back buffer
+ * THREAD-UNSAFE */
+uint SwapWindowBufferAge(SDL_Window *);
+
+/* Presents the back buffer, telling the compositor that only the damaged
+ * rectangles changed since the previous frame. Rectangles use window
+ * coordinates with the origin at the top left.
+ * An empty damage list damages the whole window
+ * THREAD-UNSAFE */
+void SwapWindowWithDamage(SDL_Window *, const std::vector<Rect> &damage);
@@ -0,0 +1,78 @@
+#include "SwapWindow.hxx"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+
+/* SDL only creates an EGL context on some backends (Wayland, KMSDRM, X11 if
+ * forced), otherwise there is no current EGL display and the window is simply
+ * swapped with full damage */
+static EGLDisplay display = EGL_NO_DISPLAY;
+static bool has_buffer_age = false;
+/* both the KHR and EXT variants of swap with damage have the same signature */
+static PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC SwapBuffersWithDamage = nullptr;
+/* reused by every swap, so that swapping does not allocate once it grew */
+static std::vector<EGLint> rects;
+
+static bool HasExtension(const char *extensions, const char *name) {
+  const size_t len = strlen(name);
+  for (const char *s = extensions; (s = strstr(s, name)) != nullptr; s += len) {
+    /* make sure the match is not a prefix of a longer name */
+    if ((s == extensions || s[-1] == ' ') && (s[len] == ' ' || s[len] == '\0'))
+      return true;
+  }
+  return false;
+}
+
+void SwapWindowInit(SDL_Window *window) {
+  (void)window;
+  display = eglGetCurrentDisplay();
+  if (display == EGL_NO_DISPLAY)
+    return;
+
+  const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+  if (extensions == nullptr)
+    return;
+
+  has_buffer_age = HasExtension(extensions, "EGL_EXT_buffer_age");
+  if (HasExtension(extensions, "EGL_KHR_swap_buffers_with_damage")) {
+    SwapBuffersWithDamage =
+        (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress(
+            "eglSwapBuffersWithDamageKHR");
+  } else if (HasExtension(extensions, "EGL_EXT_swap_buffers_with_damage")) {
+    SwapBuffersWithDamage =
+        (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress(
+            "eglSwapBuffersWithDamageEXT");
+  }
+}
+
+uint SwapWindowBufferAge(SDL_Window *window) {
+  (void)window;
+  if (!has_buffer_age)
+    return 0;
+
+  EGLint age = 0;
+  if (!eglQuerySurface(display, eglGetCurrentSurface(EGL_DRAW),
+                       EGL_BUFFER_AGE_EXT, &age))
+    return 0;
+  return age;
+}
+
+void SwapWindowWithDamage(SDL_Window *window, const std::vector<Rect> &damage) {
+  if (SwapBuffersWithDamage == nullptr || damage.empty()) {
+    SDL_GL_SwapWindow(window);
+    return;
+  }
+
+  /* EGL rectangles are x, y, w, h with the origin at the bottom left */
+  int win_h;
+  SDL_GL_GetDrawableSize(window, nullptr, &win_h);
+  rects.clear();
+  for (const Rect &r : damage) {
+    rects.insert(rects.end(), {r.x, win_h - r.y - r.h, r.w, r.h});
+  }
+
+  if (!SwapBuffersWithDamage(display, eglGetCurrentSurface(EGL_DRAW),
+                             rects.data(), damage.size())) {
+    SDL_GL_SwapWindow(window);
+  }
+}
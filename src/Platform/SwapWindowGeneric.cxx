@@ -0,0 +1,16 @@
+#include "SwapWindow.hxx"
+
+/* there is no way to query the back buffer contents or pass damage to the
+ * compositor, so every frame is a full redraw */
+
+void SwapWindowInit(SDL_Window *window) { (void)window; }
+
+uint SwapWindowBufferAge(SDL_Window *window) {
+  (void)window;
+  return 0;
+}
+
+void SwapWindowWithDamage(SDL_Window *window, const std::vector<Rect> &damage) {
+  (void)damage;
+  SDL_GL_SwapWindow(window);
+}
@@ -2,6 +2,7 @@
 
 #include <cstddef>
 #include <optional>
+#include <string>
 #include <string_view>
 
 namespace VirtualMemory {
@@ -29,6 +30,12 @@ bool RemoveSharedMemory(Handle);
 /* TODO: immediately close once mapped? */
 Handle OpenSharedMemory(std::string_view id);
 
+/* open an existing file to map it's contents, returns nullopt if the file can
+ * not be opened or is empty */
+std::optional<Handle> OpenFile(const std::string &path);
+/* closes the file or shared memory of a handle, mappings stay valid */
+void Close(Handle &);
+
 /* map the memory handle into the current processes address space, and return
  * the pointer */
 void *Map(Handle &, bool writable);
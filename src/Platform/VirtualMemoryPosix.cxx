@@ -2,8 +2,10 @@
 #include "VirtualMemory.hxx"
 #include <cerrno>
 #include <cstring>
+#include <fcntl.h>
 #include <optional>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace VirtualMemory {
@@ -12,6 +14,27 @@ Handle NewPrivateMemory(size_t size) {
   return {size, std::nullopt, nullptr, -1};
 }
 
+std::optional<Handle> OpenFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return std::nullopt;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return std::nullopt;
+  }
+
+  return Handle{(size_t)st.st_size, std::nullopt, nullptr, fd};
+}
+
+void Close(Handle &handle) {
+  if (handle.file_descriptor != -1) {
+    close(handle.file_descriptor);
+    handle.file_descriptor = -1;
+  }
+}
+
 /* shmem is roughly
  * handle.id = generate_uuid() // argv[0]-pid-uuid
  * handle.file_descriptor = shmem_open(handle.id.c_str(), O_RDWR | O_EXCL, )
@@ -29,11 +52,16 @@ void *Map(Handle &handle, bool writable) {
     flags |= PROT_WRITE;
   }
 
+  /* handles without a file descriptor are backed by anonymous memory */
+  int map_flags = MAP_PRIVATE;
+  if (handle.file_descriptor == -1) {
+    map_flags |= MAP_ANONYMOUS;
+  }
+
   handle.mapped_address =
-      mmap(nullptr, handle.size, flags, MAP_PRIVATE | MAP_ANONYMOUS,
-           handle.file_descriptor, 0);
+      mmap(nullptr, handle.size, flags, map_flags, handle.file_descriptor, 0);
 
-  assume(handle.mapped_address != NULL, strerror(errno));
+  assume(handle.mapped_address != MAP_FAILED, strerror(errno));
 
   return handle.mapped_address;
 }
@@ -0,0 +1,192 @@
+#include "AtlasCache.hxx"
+#include "../Util/CacheFile.hxx"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#include "xxhash.h"
+
+/* the layout of the file is
+ * - the key, see WriteKey
+ * - font metrics, and the size and occupancy of the atlas pages
+ * - the atlas entries, with the metrics of their glyphs
+ * - the pixels of every page
+ * using native byte order, as the cache is never shared between machines.
+ * Changing the layout requires incrementing the version */
+static constexpr char kMagic[8] = {'E', 'D', 'A', 'T', 'L', 'A', 'S', '\0'};
+/* 2: atlas keys are glyph indices instead of characters
+ * 3: control characters have the advance of '?' */
+static constexpr uint32_t kVersion = 3;
+
+static void WriteKey(CacheWriter &w, const AtlasCacheKey &key) {
+  w.PutBytes(kMagic, sizeof(kMagic));
+  w.Put(kVersion);
+  w.PutString(key.font_path);
+  w.Put(key.font_mtime);
+  w.Put(key.font_size);
+  w.Put(key.pt_size);
+  w.Put((uint32_t)key.dpi);
+  w.Put((uint8_t)key.subpixel);
+}
+
+std::optional<AtlasCacheKey> AtlasCacheKeyForFont(const std::string &path,
+                                                  double pt_size, uint dpi,
+                                                  bool subpixel) {
+  std::error_code err;
+  const auto mtime = std::filesystem::last_write_time(path, err);
+  if (err)
+    return std::nullopt;
+  const uintmax_t size = std::filesystem::file_size(path, err);
+  if (err)
+    return std::nullopt;
+
+  return AtlasCacheKey{
+      path,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          mtime.time_since_epoch())
+          .count(),
+      size,
+      pt_size,
+      dpi,
+      subpixel};
+}
+
+std::string AtlasCacheFileName(const AtlasCacheKey &key) {
+  /* the modification time and size are left out, so that a cache which is out
+   * of date is replaced, instead of left behind */
+  CacheWriter w;
+  w.PutBytes(key.font_path.data(), key.font_path.size());
+  w.Put(key.pt_size);
+  w.Put((uint32_t)key.dpi);
+  w.Put((uint8_t)key.subpixel);
+
+  char name[32];
+  snprintf(name, sizeof(name), "atlas-%016llx.bin",
+           (unsigned long long)XXH64(w.data.data(), w.data.size(), 0));
+  return name;
+}
+
+AtlasCache::~AtlasCache() { VirtualMemory::Unmap(mapping); }
+
+std::unique_ptr<AtlasCache> ReadAtlasCache(const std::string &path,
+                                           const AtlasCacheKey &key) {
+  std::optional<VirtualMemory::Handle> file = VirtualMemory::OpenFile(path);
+  if (!file)
+    return nullptr;
+
+  auto cache = std::make_unique<AtlasCache>();
+  cache->mapping = *file;
+  const uint8_t *data =
+      (const uint8_t *)VirtualMemory::Map(cache->mapping, false);
+  VirtualMemory::Close(cache->mapping);
+  CacheReader r = {data, data + cache->mapping.size};
+
+  CacheWriter expected_key;
+  WriteKey(expected_key, key);
+  const uint8_t *file_key = r.GetBytes(expected_key.data.size());
+  if (file_key == nullptr || memcmp(file_key, expected_key.data.data(),
+                                    expected_key.data.size()) != 0)
+    return nullptr;
+
+  vec2<uint> tile_dimensions;
+  uint64_t page_rows;
+  uint32_t max_pages;
+  uint32_t num_pages;
+  uint32_t bytes_per_pixel;
+  if (!r.Get(&cache->line_height) || !r.Get(&cache->ascii_advances) ||
+      !r.Get(&tile_dimensions) || !r.Get(&page_rows) || !r.Get(&max_pages) ||
+      !r.Get(&num_pages) || !r.Get(&bytes_per_pixel))
+    return nullptr;
+
+  if (tile_dimensions.x == 0 || tile_dimensions.y == 0 || page_rows == 0 ||
+      page_rows > (1 << 16) || num_pages == 0 || num_pages > max_pages ||
+      (bytes_per_pixel != 1 && bytes_per_pixel != 3))
+    return nullptr;
+  cache->bytes_per_pixel = bytes_per_pixel;
+
+  GlyphAtlas &atlas = cache->atlas;
+  atlas.Init(tile_dimensions, page_rows, max_pages);
+  atlas.pages.resize(num_pages);
+  for (GlyphAtlas::Matrix &page : atlas.pages) {
+    page.Resize(page_rows);
+    const size_t rows_len = page_rows * sizeof(page.rows[0]);
+    const uint8_t *rows = r.GetBytes(rows_len);
+    const uint8_t *free_runs = r.GetBytes(page_rows);
+    if (rows == nullptr || free_runs == nullptr)
+      return nullptr;
+    memcpy(page.rows.data(), rows, rows_len);
+    memcpy(page.free_runs.data(), free_runs, page_rows);
+  }
+
+  const vec2<uint> page_size = atlas.PageSize();
+  uint32_t num_glyphs;
+  if (!r.Get(&num_glyphs))
+    return nullptr;
+  cache->glyphs.resize(num_glyphs);
+  for (AtlasCacheGlyph &glyph : cache->glyphs) {
+    uint8_t permanent;
+    if (!r.Get(&glyph.key) || !r.Get(&glyph.slot) || !r.Get(&permanent) ||
+        !r.Get(&glyph.bitmap_size) || !r.Get(&glyph.offset))
+      return nullptr;
+    glyph.permanent = permanent != 0;
+
+    const Rect region = glyph.slot.region;
+    if (glyph.slot.page >= num_pages || region.x < 0 || region.y < 0 ||
+        region.w < 0 || region.h < 0 ||
+        (uint)(region.x + region.w) > page_size.x ||
+        (uint)(region.y + region.h) > page_size.y)
+      return nullptr;
+    atlas.entries[glyph.key] = {glyph.slot, 0, glyph.permanent};
+  }
+
+  const size_t pixels_len =
+      (size_t)num_pages * page_size.x * page_size.y * bytes_per_pixel;
+  cache->pixels = r.GetBytes(pixels_len);
+  if (cache->pixels == nullptr || r.cur != r.end)
+    return nullptr;
+
+  return cache;
+}
+
+bool WriteAtlasCache(const std::string &path, const AtlasCacheKey &key,
+                     float line_height, const float ascii_advances[128],
+                     const GlyphAtlas &atlas,
+                     const std::vector<AtlasCacheGlyph> &glyphs,
+                     const std::vector<std::vector<uint8_t>> &pages,
+                     size_t bytes_per_pixel) {
+  const vec2<uint> page_size = atlas.PageSize();
+  const size_t page_len = (size_t)page_size.x * page_size.y * bytes_per_pixel;
+  if (pages.size() != atlas.pages.size())
+    return false;
+
+  CacheWriter w;
+  WriteKey(w, key);
+  w.Put(line_height);
+  w.PutBytes(ascii_advances, sizeof(float) * 128);
+  w.Put(atlas.tile_dimensions);
+  w.Put((uint64_t)atlas.page_rows);
+  w.Put((uint32_t)atlas.max_pages);
+  w.Put((uint32_t)atlas.pages.size());
+  w.Put((uint32_t)bytes_per_pixel);
+  for (const GlyphAtlas::Matrix &page : atlas.pages) {
+    w.PutBytes(page.rows.data(), page.rows.size() * sizeof(page.rows[0]));
+    w.PutBytes(page.free_runs.data(), page.free_runs.size());
+  }
+
+  w.Put((uint32_t)glyphs.size());
+  for (const AtlasCacheGlyph &glyph : glyphs) {
+    w.Put(glyph.key);
+    w.Put(glyph.slot);
+    w.Put((uint8_t)glyph.permanent);
+    w.Put(glyph.bitmap_size);
+    w.Put(glyph.offset);
+  }
+
+  for (const std::vector<uint8_t> &page : pages) {
+    if (page.size() != page_len)
+      return false;
+    w.PutBytes(page.data(), page.size());
+  }
+
+  return WriteCacheFile(path, w.data);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../Platform/VirtualMemory.hxx"
+#include "GlyphAtlas.hxx"
+#include "Types.hxx"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/* Everything that changes the rasterized glyphs of a font. A cache file is
+ * only used if all of it matches */
+struct AtlasCacheKey {
+  std::string font_path;
+  /* modification time of the font file, in nanoseconds */
+  int64_t font_mtime;
+  uint64_t font_size;
+  double pt_size;
+  uint dpi;
+  bool subpixel;
+};
+
+/* metrics of an atlas entry */
+struct AtlasCacheGlyph {
+  GlyphAtlas::Key key;
+  GlyphAtlas::Slot slot;
+  bool permanent;
+  vec2<uint> bitmap_size;
+  vec2<int> offset;
+};
+
+/* Contents of a cache file, read by mapping the file into memory.
+ *
+ * The pixels of the pages point into the mapping, so that they can be uploaded
+ * without copying. They are only valid as long as the AtlasCache lives */
+struct AtlasCache {
+  float line_height;
+  float ascii_advances[128];
+  /* the entries of the atlas are restored from the glyphs, and are all marked
+   * as last used in frame 0 */
+  GlyphAtlas atlas;
+  std::vector<AtlasCacheGlyph> glyphs;
+  size_t bytes_per_pixel;
+  /* every page of the atlas, one after the other */
+  const uint8_t *pixels;
+
+  AtlasCache() : mapping({0, std::nullopt, nullptr, -1}){};
+  AtlasCache(AtlasCache const &) = delete;
+  AtlasCache &operator=(AtlasCache const &) = delete;
+  ~AtlasCache();
+
+  VirtualMemory::Handle mapping;
+};
+
+/* returns nullopt if the font file does not exist */
+std::optional<AtlasCacheKey> AtlasCacheKeyForFont(const std::string &path,
+                                                  double pt_size, uint dpi,
+                                                  bool subpixel);
+/* file name of the cache for key, different fonts and sizes map to different
+ * names */
+std::string AtlasCacheFileName(const AtlasCacheKey &);
+
+/* returns nullptr if the file does not exist, was written for a different key
+ * or is corrupt */
+std::unique_ptr<AtlasCache> ReadAtlasCache(const std::string &path,
+                                           const AtlasCacheKey &);
+/* replaces the file at path atomically, so that concurrently starting editors
+ * never read a partially written cache. Returns false on failure */
+bool WriteAtlasCache(const std::string &path, const AtlasCacheKey &,
+                     float line_height, const float ascii_advances[128],
+                     const GlyphAtlas &,
+                     const std::vector<AtlasCacheGlyph> &glyphs,
+                     const std::vector<std::vector<uint8_t>> &pages,
+                     size_t bytes_per_pixel);
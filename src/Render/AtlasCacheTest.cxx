@@ -0,0 +1,116 @@
+#include "AtlasCache.hxx"
+#include "catch2/catch.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+TEST_CASE("atlas cache", "[AtlasCache]") {
+  const std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "editor_atlas_cache_test";
+  std::filesystem::create_directories(dir);
+  const std::string font_path = (dir / "font.ttf").string();
+  std::ofstream(font_path) << "not really a font";
+
+  std::optional<AtlasCacheKey> key =
+      AtlasCacheKeyForFont(font_path, 12.0, 96, true);
+  REQUIRE(key);
+  REQUIRE(key->font_size == 17);
+  REQUIRE(!AtlasCacheKeyForFont((dir / "missing.ttf").string(), 12.0, 96,
+                                true));
+  const std::string cache_path = (dir / AtlasCacheFileName(*key)).string();
+
+  /* two pages, with a glyph filling most of each and an empty glyph */
+  GlyphAtlas atlas;
+  atlas.Init({2, 4}, 16, 4);
+  std::vector<AtlasCacheGlyph> glyphs;
+  for (GlyphAtlas::Key glyph_key : {'a', ' ', 'b'}) {
+    const vec2<uint> size =
+        glyph_key == ' ' ? vec2<uint>{0, 0} : vec2<uint>{30, 100};
+    const GlyphAtlas::Entry *entry =
+        atlas.Insert(glyph_key, size.x, size.y, glyph_key == 'a', 7);
+    REQUIRE(entry != nullptr);
+    glyphs.push_back({glyph_key, entry->slot, entry->permanent, size,
+                      {(int)glyph_key, -2}});
+  }
+  REQUIRE(atlas.pages.size() == 2);
+
+  const vec2<uint> page_size = atlas.PageSize();
+  std::vector<std::vector<uint8_t>> pages;
+  for (uint8_t fill : {0x11, 0x22}) {
+    pages.emplace_back(page_size.x * page_size.y * 3, fill);
+  }
+  float advances[128];
+  for (int i = 0; i < 128; i++) {
+    advances[i] = i * 0.5f;
+  }
+
+  REQUIRE(WriteAtlasCache(cache_path, *key, 17.5f, advances, atlas, glyphs,
+                          pages, 3));
+
+  SECTION("round trip") {
+    std::unique_ptr<AtlasCache> cache = ReadAtlasCache(cache_path, *key);
+    REQUIRE(cache);
+    REQUIRE(cache->line_height == 17.5f);
+    REQUIRE(cache->ascii_advances[127] == 63.5f);
+    REQUIRE(cache->bytes_per_pixel == 3);
+    REQUIRE(cache->atlas.tile_dimensions.x == 2);
+    REQUIRE(cache->atlas.tile_dimensions.y == 4);
+    REQUIRE(cache->atlas.max_pages == 4);
+    REQUIRE(cache->atlas.pages.size() == 2);
+    REQUIRE(cache->atlas.entries.size() == 3);
+
+    for (size_t i = 0; i < atlas.pages.size(); i++) {
+      REQUIRE(cache->atlas.pages[i].rows == atlas.pages[i].rows);
+      REQUIRE(cache->atlas.pages[i].free_runs == atlas.pages[i].free_runs);
+    }
+
+    REQUIRE(cache->glyphs.size() == glyphs.size());
+    for (size_t i = 0; i < glyphs.size(); i++) {
+      const AtlasCacheGlyph &glyph = cache->glyphs[i];
+      REQUIRE(glyph.key == glyphs[i].key);
+      REQUIRE(glyph.slot.page == glyphs[i].slot.page);
+      REQUIRE(glyph.slot.region.x == glyphs[i].slot.region.x);
+      REQUIRE(glyph.slot.region.y == glyphs[i].slot.region.y);
+      REQUIRE(glyph.slot.region.w == glyphs[i].slot.region.w);
+      REQUIRE(glyph.slot.region.h == glyphs[i].slot.region.h);
+      REQUIRE(glyph.permanent == glyphs[i].permanent);
+      REQUIRE(glyph.offset.x == glyphs[i].offset.x);
+      REQUIRE(cache->atlas.entries.at(glyph.key).last_used_frame == 0);
+    }
+
+    const size_t page_len = pages[0].size();
+    REQUIRE(cache->pixels[0] == 0x11);
+    REQUIRE(cache->pixels[page_len - 1] == 0x11);
+    REQUIRE(cache->pixels[page_len] == 0x22);
+    REQUIRE(cache->pixels[2 * page_len - 1] == 0x22);
+
+    /* the restored atlas knows the cached pages are full */
+    const GlyphAtlas::Entry *entry =
+        cache->atlas.Insert('c', 30, 100, false, 1);
+    REQUIRE(entry != nullptr);
+    REQUIRE(entry->slot.page == 2);
+  }
+
+  SECTION("mismatched keys are rejected") {
+    AtlasCacheKey other = *key;
+    other.pt_size = 14.0;
+    REQUIRE(!ReadAtlasCache(cache_path, other));
+    other = *key;
+    other.subpixel = false;
+    REQUIRE(!ReadAtlasCache(cache_path, other));
+    other = *key;
+    other.font_mtime++;
+    REQUIRE(!ReadAtlasCache(cache_path, other));
+    REQUIRE(ReadAtlasCache(cache_path, *key));
+  }
+
+  SECTION("truncated files are rejected") {
+    std::filesystem::resize_file(cache_path,
+                                 std::filesystem::file_size(cache_path) - 1);
+    REQUIRE(!ReadAtlasCache(cache_path, *key));
+    std::filesystem::resize_file(cache_path, 0);
+    REQUIRE(!ReadAtlasCache(cache_path, *key));
+  }
+
+  std::filesystem::remove_all(dir);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Types.hxx"
+#include <bit>
 #include <cstdint>
 #include <optional>
 #include <vector>
@@ -10,14 +11,22 @@
 /* axis size BitMatrixFixedDimension */
 enum class BitMatrix2DFixedAxis { kWidth, kHeight };
 
+/* Rows are stored as words, with the first element of a row in the most
+ * significant bit.
+ *
+ * The length of the longest run of unset bits is kept for every row, so that
+ * FindUnsetRect can skip rows which can not fit the rect without looking at
+ * their bits. The remaining rows are searched a whole word at a time. */
 template <BitMatrix2DFixedAxis order, typename FixedAxis> struct BitMatrix2D {
   constexpr static uint8_t major_len = std::numeric_limits<FixedAxis>::digits;
   constexpr static BitMatrix2DFixedAxis axis = order;
   using size_type = size_t;
 
   std::vector<FixedAxis> rows;
+  /* longest run of unset bits in each row */
+  std::vector<uint8_t> free_runs;
 
-  size_type width() {
+  size_type width() const {
     if constexpr (order == BitMatrix2DFixedAxis::kWidth) {
       return major_len;
     } else {
@@ -25,7 +34,7 @@ template <BitMatrix2DFixedAxis order, typename FixedAxis> struct BitMatrix2D {
     }
   }
 
-  size_type height() {
+  size_type height() const {
     if constexpr (order == BitMatrix2DFixedAxis::kHeight) {
       return major_len;
     } else {
@@ -34,21 +43,19 @@ template <BitMatrix2DFixedAxis order, typename FixedAxis> struct BitMatrix2D {
   }
 
   void Fill(bool value) {
-    const FixedAxis v = value && ~(FixedAxis)0;
+    const FixedAxis v = value ? ~(FixedAxis)0 : 0;
     for (FixedAxis &x : rows) {
       x = v;
     }
+    for (uint8_t &run : free_runs) {
+      run = value ? 0 : major_len;
+    }
   }
 
   void Resize(size_t new_size) {
-    size_t original_size = rows.size();
-    rows.resize(new_size);
-
-    if (original_size > new_size) {
-      for (size_t i = original_size; i < new_size; i++) {
-        rows[i] = 0;
-      }
-    }
+    /* new rows are unset */
+    rows.resize(new_size, 0);
+    free_runs.resize(new_size, major_len);
   }
 
   void SetRect(Rect r) {
@@ -57,15 +64,30 @@ template <BitMatrix2DFixedAxis order, typename FixedAxis> struct BitMatrix2D {
       std::swap(r.w, r.h);
     }
 
-    FixedAxis mask =
-        ((FixedAxis)(~(FixedAxis)0) << (major_len - (uint)r.w)) >> (uint)r.x;
+    const FixedAxis mask = RowMask(r.x, r.w);
     for (size_type y = (uint)r.y; y < (uint)r.y + (uint)r.h; y++) {
       rows[y] |= mask;
+      free_runs[y] = LongestUnsetRun(rows[y]);
+    }
+  };
+
+  void ClearRect(Rect r) {
+    if constexpr (order == BitMatrix2DFixedAxis::kHeight) {
+      std::swap(r.x, r.y);
+      std::swap(r.w, r.h);
+    }
+
+    const FixedAxis mask = RowMask(r.x, r.w);
+    for (size_type y = (uint)r.y; y < (uint)r.y + (uint)r.h; y++) {
+      rows[y] &= ~mask;
+      free_runs[y] = LongestUnsetRun(rows[y]);
     }
   };
 
+  /* returns the top left of the first w * h rect of unset bits, searching
+   * row by row */
   std::optional<vec2<size_type>> FindUnsetRect(size_type w, size_type h) {
-    uint_fast8_t min_bit_width;
+    size_type min_bit_width;
     size_type min_run_len;
 
     if constexpr (order == BitMatrix2DFixedAxis::kWidth) {
@@ -76,39 +98,67 @@ template <BitMatrix2DFixedAxis order, typename FixedAxis> struct BitMatrix2D {
       min_bit_width = h;
     }
 
-    FixedAxis *row = rows.data();
-    const FixedAxis *end = row + rows.size();
+    if (min_bit_width == 0 || min_bit_width > major_len || min_run_len == 0)
+      return std::nullopt;
 
-    uint32_t minor_idx = 0;
-    size_type run_len = 0;
-    constexpr static uint32_t q = major_len - 1;
-    while (row < end && run_len <= min_run_len) {
-      uint32_t bits_unset =
-          __builtin_clz((*row << minor_idx) | (FixedAxis)1 << minor_idx);
-      uint32_t bits_set = __builtin_clz(~(*row << minor_idx));
+    size_type start = 0;
+    while (start + min_run_len <= rows.size()) {
+      /* bits where a run of min_bit_width unset bits starts in every row of
+       * the window */
+      FixedAxis candidates = ~(FixedAxis)0;
+      size_type i = start;
+      for (; i < start + min_run_len; i++) {
+        if (free_runs[i] < min_bit_width)
+          break;
+        candidates &= UnsetRunStarts(rows[i], min_bit_width);
+        if (candidates == 0)
+          break;
+      }
 
-      bool is_match = bits_unset >= min_bit_width;
+      if (i == start + min_run_len) {
+        const size_type minor_idx = std::countl_zero(candidates);
+        if constexpr (order == BitMatrix2DFixedAxis::kWidth) {
+          return std::optional<vec2<size_type>>({minor_idx, start});
+        } else {
+          return std::optional<vec2<size_type>>({start, minor_idx});
+        }
+      }
 
-      minor_idx += !is_match * (bits_unset + bits_set);
+      /* no window containing a row without a long enough run can match */
+      start = free_runs[i] < min_bit_width ? i + 1 : start + 1;
+    }
 
-      row += (minor_idx >= q);
-      row -= !is_match * run_len;
-      row += is_match;
+    return std::nullopt;
+  }
 
-      run_len = is_match * (run_len + 1);
-      minor_idx *= (q > minor_idx);
-    }
+private:
+  /* len bits starting at offset, counted from the most significant bit */
+  static FixedAxis RowMask(uint offset, uint len) {
+    if (len == 0)
+      return 0;
+    return (FixedAxis)(~(FixedAxis)0 << (major_len - len)) >> offset;
+  }
 
-    /* TODO: will exit early, fix */
-    if (row == end) {
-      return std::nullopt;
+  /* sets the bits where a run of at least len unset bits starts, by and-ing
+   * the unset bits with themselves shifted by doubling distances */
+  static FixedAxis UnsetRunStarts(FixedAxis row, uint len) {
+    FixedAxis starts = ~row;
+    uint covered = 1;
+    while (covered < len && starts != 0) {
+      const uint shift = std::min(covered, len - covered);
+      starts &= starts << shift;
+      covered += shift;
     }
+    return starts;
+  }
 
-    size_type i = (row - rows.data()) - run_len;
-    if constexpr (order == BitMatrix2DFixedAxis::kWidth) {
-      return std::optional<vec2<size_type>>({minor_idx, i});
-    } else {
-      return std::optional<vec2<size_type>>({i, minor_idx});
+  static uint8_t LongestUnsetRun(FixedAxis row) {
+    FixedAxis unset = ~row;
+    uint8_t len = 0;
+    while (unset != 0) {
+      unset &= unset << 1;
+      len++;
     }
+    return len;
   }
 };
@@ -0,0 +1,142 @@
+#include "BitMatrix2D.hxx"
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <random>
+
+using Matrix = BitMatrix2D<BitMatrix2DFixedAxis::kHeight, uint32_t>;
+
+static bool IsSet(Matrix &m, size_t x, size_t y) {
+  return m.rows[x] >> (Matrix::major_len - 1 - y) & 1;
+}
+
+/* first unset rect in the same order as FindUnsetRect, checking every bit */
+static std::optional<vec2<size_t>> FindUnsetRectSlow(Matrix &m, size_t w,
+                                                     size_t h) {
+  for (size_t x = 0; x + w <= m.width(); x++) {
+    for (size_t y = 0; y + h <= m.height(); y++) {
+      bool unset = true;
+      for (size_t i = x; i < x + w && unset; i++) {
+        for (size_t j = y; j < y + h && unset; j++) {
+          unset = !IsSet(m, i, j);
+        }
+      }
+      if (unset)
+        return vec2<size_t>{x, y};
+    }
+  }
+  return std::nullopt;
+}
+
+TEST_CASE("find unset rects", "[BitMatrix2D]") {
+  Matrix m;
+  m.Resize(64);
+
+  SECTION("fills the whole matrix") {
+    auto pos = m.FindUnsetRect(64, 32);
+    REQUIRE(pos);
+    REQUIRE(pos->x == 0);
+    REQUIRE(pos->y == 0);
+    m.SetRect({0, 0, 64, 32});
+    REQUIRE(!m.FindUnsetRect(1, 1));
+
+    m.ClearRect({63, 31, 1, 1});
+    pos = m.FindUnsetRect(1, 1);
+    REQUIRE(pos);
+    REQUIRE(pos->x == 63);
+    REQUIRE(pos->y == 31);
+  }
+
+  SECTION("matches an exhaustive search") {
+    std::mt19937 rng(1234);
+    std::vector<Rect> set;
+    for (int i = 0; i < 2000; i++) {
+      const size_t w = rng() % 6 + 1;
+      const size_t h = rng() % 10 + 1;
+
+      auto pos = m.FindUnsetRect(w, h);
+      auto expected = FindUnsetRectSlow(m, w, h);
+      REQUIRE(pos.has_value() == expected.has_value());
+      if (pos) {
+        REQUIRE(pos->x == expected->x);
+        REQUIRE(pos->y == expected->y);
+        set.push_back({(int)pos->x, (int)pos->y, (int)w, (int)h});
+        m.SetRect(set.back());
+      }
+
+      /* free a random rect every few inserts, or when full */
+      if (!set.empty() && (!pos || rng() % 3 == 0)) {
+        std::swap(set[rng() % set.size()], set.back());
+        m.ClearRect(set.back());
+        set.pop_back();
+      }
+    }
+  }
+}
+
+TEST_CASE("atlas packing performance", "[BitMatrix2D]") {
+  constexpr size_t num_ops = 100 * 1000;
+
+  /* glyph sizes in tiles, like RenderFont uses: an M is 6 * 3 tiles */
+  std::mt19937 rng(42);
+  std::vector<vec2<size_t>> sizes(num_ops);
+  for (auto &size : sizes) {
+    size = {rng() % 7 + 1, rng() % 4 + 1};
+  }
+
+  /* inserts glyphs until the matrix is full, then frees random glyphs to make
+   * space, like LRU eviction does. Returns the number of allocations */
+  auto run = [&](Matrix &m, double *density) {
+    std::vector<Rect> set;
+    size_t allocations = 0;
+    size_t used_bits = 0;
+    double density_sum = 0;
+    size_t density_samples = 0;
+    for (size_t i = 0; i < num_ops; i++) {
+      const auto [w, h] = sizes[i];
+      auto pos = m.FindUnsetRect(w, h);
+      while (!pos && !set.empty()) {
+        /* sample the density whenever the matrix is full */
+        density_sum += (double)used_bits / (m.width() * m.height());
+        density_samples++;
+
+        std::swap(set[rng() % set.size()], set.back());
+        m.ClearRect(set.back());
+        used_bits -= set.back().w * set.back().h;
+        set.pop_back();
+        pos = m.FindUnsetRect(w, h);
+      }
+      set.push_back({(int)pos->x, (int)pos->y, (int)w, (int)h});
+      m.SetRect(set.back());
+      used_bits += w * h;
+      allocations++;
+    }
+    if (density != nullptr) {
+      *density = density_sum / std::max(density_samples, (size_t)1);
+    }
+    return allocations;
+  };
+
+  double density;
+  {
+    Matrix m;
+    m.Resize(576);
+    const auto t0 = std::chrono::steady_clock::now();
+    const size_t allocations = run(m, &density);
+    const auto t1 = std::chrono::steady_clock::now();
+    const double ns =
+        std::chrono::duration<double, std::nano>(t1 - t0).count() /
+        allocations;
+    WARN("time per allocation: " << ns << "ns, packing density when full: "
+                                 << density * 100 << "%");
+  }
+  REQUIRE(density > 0.5);
+
+  BENCHMARK_ADVANCED("insert and free " + std::to_string(num_ops) +
+                     " glyphs")(Catch::Benchmark::Chronometer meter) {
+    Matrix m;
+    m.Resize(576);
+    meter.measure([&] { return run(m, nullptr); });
+  };
+}
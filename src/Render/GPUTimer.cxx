@@ -0,0 +1,84 @@
+#include "GPUTimer.hxx"
+#include "../Util/Assert.hxx"
+
+#define GL_GLEXT_PROTOTYPES
+#include "SDL_opengl.h"
+#include "SDL_opengl_glext.h"
+
+void GPUTimer::Init(void) { enabled = true; }
+
+void GPUTimer::Query(Slot &slot, size_t i) {
+  if (i == slot.queries.size()) {
+    GLuint query;
+    glGenQueries(1, &query);
+    slot.queries.push_back(query);
+  }
+  glQueryCounter(slot.queries[i], GL_TIMESTAMP);
+}
+
+bool GPUTimer::BeginFrame(uint64_t frame) {
+  recording = nullptr;
+  Slot &slot = slots[next];
+  if (!enabled || slot.pending)
+    return false;
+
+  slot.spans.clear();
+  slot.frame = frame;
+  Query(slot, 0);
+  recording = &slot;
+  return true;
+}
+
+void GPUTimer::Mark(uint32_t tag, uint32_t count) {
+  if (recording == nullptr)
+    return;
+  recording->spans.push_back({tag, count, 0});
+  Query(*recording, recording->spans.size());
+}
+
+void GPUTimer::EndFrame(void) {
+  if (recording == nullptr)
+    return;
+  recording->pending = true;
+  recording = nullptr;
+  next = (next + 1) % kFramesInFlight;
+}
+
+bool GPUTimer::Available(const Slot &slot) {
+  /* the queries of a frame are not guaranteed to become available in order */
+  for (size_t i = 0; i <= slot.spans.size(); i++) {
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return false;
+  }
+  return true;
+}
+
+bool GPUTimer::Poll(uint64_t &frame, std::vector<Span> &spans) {
+  assume(recording == nullptr, "polled while recording a frame");
+  bool found = false;
+  /* oldest first, starting with the slot the next frame is recorded into */
+  for (uint n = 0; n < kFramesInFlight; n++) {
+    Slot &slot = slots[(next + n) % kFramesInFlight];
+    if (!slot.pending || !Available(slot))
+      continue;
+
+    GLuint64 previous;
+    glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &previous);
+    for (size_t i = 0; i < slot.spans.size(); i++) {
+      GLuint64 timestamp;
+      glGetQueryObjectui64v(slot.queries[i + 1], GL_QUERY_RESULT, &timestamp);
+      slot.spans[i].ns = timestamp - previous;
+      previous = timestamp;
+    }
+    slot.pending = false;
+
+    if (!found || slot.frame > frame) {
+      frame = slot.frame;
+      spans = slot.spans;
+      found = true;
+    }
+  }
+  return found;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "SDL.h"
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+#define GL_GLEXT_PROTOTYPES
+#include "SDL_opengl.h"
+
+/* Measures how long the GPU spends on parts of a frame without stalling the
+ * pipeline.
+ *
+ * A GL_TIMESTAMP query is issued at the start of a frame and after every part
+ * of it, so a frame with n parts uses n + 1 queries and no nesting is needed,
+ * unlike with GL_TIME_ELAPSED. The queries of a frame are only read back once
+ * all of them are available, which is usually a few frames later. Frames are
+ * recorded into kFramesInFlight slots used as a ring, and a frame is not timed
+ * if its slot is still waiting for the GPU */
+struct GPUTimer {
+  static constexpr uint kFramesInFlight = 4;
+
+  /* GPU time between a mark and the previous one */
+  struct Span {
+    /* set by the caller to tell the parts apart */
+    uint32_t tag;
+    uint32_t count;
+    uint64_t ns;
+  };
+
+  struct Slot {
+    /* grows to the largest number of marks in a frame */
+    std::vector<GLuint> queries;
+    /* one per mark, ns is filled in when read back */
+    std::vector<Span> spans;
+    uint64_t frame;
+    /* queries were issued and not read back yet */
+    bool pending;
+  };
+
+  bool enabled;
+  Slot slots[kFramesInFlight];
+  /* slot of the next frame */
+  uint next;
+  /* slot of the frame being recorded, or null if it is not timed */
+  Slot *recording;
+
+  GPUTimer() : enabled(false), slots(), next(0), recording(nullptr){};
+  GPUTimer(GPUTimer const &) = delete;
+  GPUTimer &operator=(GPUTimer const &) = delete;
+
+  /* timer queries are core since GL 3.3 */
+  void Init(void);
+
+  /* starts recording frame at the current position in the command stream,
+   * returns false if the frame is not timed */
+  bool BeginFrame(uint64_t frame);
+  /* ends the span since the previous mark or BeginFrame */
+  void Mark(uint32_t tag, uint32_t count);
+  void EndFrame(void);
+
+  /* reads back the frames whose queries are available, without waiting.
+   * Returns false if none was, otherwise frame and spans are those of the
+   * most recent one */
+  bool Poll(uint64_t &frame, std::vector<Span> &spans);
+
+private:
+  void Query(Slot &, size_t i);
+  bool Available(const Slot &);
+};
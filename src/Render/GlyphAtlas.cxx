@@ -0,0 +1,124 @@
+#include "GlyphAtlas.hxx"
+#include <algorithm>
+#include <cassert>
+
+void GlyphAtlas::Init(vec2<uint> tiles, size_t rows, uint max) {
+  tile_dimensions = tiles;
+  page_rows = rows;
+  max_pages = max;
+
+  pages.clear();
+  entries.clear();
+  pages.emplace_back();
+  pages.back().Resize(page_rows);
+}
+
+vec2<uint> GlyphAtlas::PageSize(void) const {
+  return {(uint)pages.front().width() * tile_dimensions.x,
+          (uint)pages.front().height() * tile_dimensions.y};
+}
+
+const GlyphAtlas::Entry *GlyphAtlas::Find(Key key, uint64_t frame) {
+  auto entry = entries.find(key);
+  if (entry == entries.end()) {
+    stats.misses++;
+    return nullptr;
+  }
+
+  stats.hits++;
+  entry->second.last_used_frame = frame;
+  return &entry->second;
+}
+
+void GlyphAtlas::Touch(Key key, uint64_t frame) {
+  auto entry = entries.find(key);
+  if (entry != entries.end()) {
+    entry->second.last_used_frame = frame;
+  }
+}
+
+std::optional<GlyphAtlas::Slot> GlyphAtlas::Allocate(uint page,
+                                                     vec2<uint> tiles) {
+  auto pos = pages[page].FindUnsetRect(tiles.x, tiles.y);
+  if (!pos)
+    return std::nullopt;
+
+  pages[page].SetRect({(int)pos->x, (int)pos->y, (int)tiles.x, (int)tiles.y});
+  return Slot{page,
+              {(int)pos->x * (int)tile_dimensions.x,
+               (int)pos->y * (int)tile_dimensions.y, 0, 0}};
+}
+
+void GlyphAtlas::Free(const Slot &slot) {
+  if (slot.region.empty())
+    return;
+
+  pages[slot.page].ClearRect(
+      {slot.region.x / (int)tile_dimensions.x,
+       slot.region.y / (int)tile_dimensions.y,
+       (int)DivideRoundUp((uint)slot.region.w, tile_dimensions.x),
+       (int)DivideRoundUp((uint)slot.region.h, tile_dimensions.y)});
+}
+
+const GlyphAtlas::Entry *GlyphAtlas::Insert(Key key, uint w, uint h,
+                                            bool permanent, uint64_t frame) {
+  assert(entries.find(key) == entries.end());
+
+  /* empty bitmaps, e.g. for spaces, don't need any space */
+  if (w == 0 || h == 0) {
+    return &(entries[key] = {{0, {0, 0, 0, 0}}, frame, permanent});
+  }
+
+  const vec2<uint> tiles = {DivideRoundUp(w, tile_dimensions.x),
+                            DivideRoundUp(h, tile_dimensions.y)};
+  if (tiles.x > pages.front().width() || tiles.y > pages.front().height()) {
+    stats.failed_inserts++;
+    return nullptr;
+  }
+
+  std::optional<Slot> slot;
+  for (uint page = 0; page < pages.size() && !slot; page++) {
+    slot = Allocate(page, tiles);
+  }
+
+  if (!slot && pages.size() < max_pages) {
+    pages.emplace_back();
+    pages.back().Resize(page_rows);
+    slot = Allocate(pages.size() - 1, tiles);
+  }
+
+  if (!slot) {
+    /* evict the least recently used entries, until enough space is freed on
+     * one of their pages. Entries of the previous frame are kept too, as
+     * glyphs arriving from the rasterizer are inserted before the views of
+     * the frame touch the glyphs they draw */
+    std::vector<std::pair<uint64_t, Key>> candidates;
+    for (auto &[candidate, entry] : entries) {
+      if (!entry.permanent && entry.last_used_frame + 1 < frame &&
+          !entry.slot.region.empty()) {
+        candidates.push_back({entry.last_used_frame, candidate});
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (auto &[last_used_frame, candidate] : candidates) {
+      const Slot freed = entries.at(candidate).slot;
+      Free(freed);
+      entries.erase(candidate);
+      stats.evictions++;
+
+      slot = Allocate(freed.page, tiles);
+      if (slot)
+        break;
+    }
+  }
+
+  if (!slot) {
+    stats.failed_inserts++;
+    return nullptr;
+  }
+
+  slot->region.w = w;
+  slot->region.h = h;
+  return &(entries[key] = {*slot, frame, permanent});
+}
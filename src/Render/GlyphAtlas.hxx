@@ -0,0 +1,78 @@
+#pragma once
+
+#include "BitMatrix2D.hxx"
+#include "Types.hxx"
+#include <cstdint>
+#include <optional>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+/* Allocates space for glyph bitmaps in the pages of an atlas texture.
+ *
+ * Space is allocated in tiles. When no page has room for a new entry, a new
+ * page is added, up to max_pages. After that the least recently used entries
+ * are evicted until the new entry fits. Permanent entries, and entries used in
+ * the current or the previous frame, are never evicted.
+ *
+ * Only keeps track of where entries are, the owner is responsible for
+ * uploading the bitmaps, and growing the texture when pages are added. */
+struct GlyphAtlas {
+  using Key = uint32_t;
+  using Matrix = BitMatrix2D<BitMatrix2DFixedAxis::kHeight, uint32_t>;
+
+  struct Slot {
+    uint page;
+    /* in pixels */
+    Rect region;
+  };
+
+  struct Entry {
+    Slot slot;
+    uint64_t last_used_frame;
+    bool permanent;
+  };
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    /* inserts which failed because the atlas was full */
+    uint64_t failed_inserts;
+  };
+
+  vec2<uint> tile_dimensions;
+  /* number of tiles along the variable axis of every page */
+  size_t page_rows;
+  uint max_pages;
+
+  std::vector<Matrix> pages;
+  std::unordered_map<Key, Entry> entries;
+  Stats stats;
+
+  GlyphAtlas() : tile_dimensions({0, 0}), page_rows(0), max_pages(0), stats(){};
+
+  void Init(vec2<uint> tile_dimensions, size_t page_rows, uint max_pages);
+
+  /* in pixels */
+  vec2<uint> PageSize(void) const;
+  /* changes whenever entries are evicted or could not be inserted, so that
+   * content drawn using the atlas can be invalidated */
+  uint64_t Epoch(void) const { return stats.evictions + stats.failed_inserts; }
+
+  /* returns the entry of key and marks it as used in frame, or nullptr if key
+   * is not in the atlas */
+  const Entry *Find(Key, uint64_t frame);
+  /* marks key as used in frame if it is in the atlas, without counting it as
+   * a hit or miss */
+  void Touch(Key, uint64_t frame);
+  /* allocates space for a w * h pixel bitmap under key, which must not be in
+   * the atlas, and marks it as used in frame.
+   * Returns nullptr if the bitmap is larger than a page, or if every page is
+   * full of entries which can not be evicted */
+  const Entry *Insert(Key, uint w, uint h, bool permanent, uint64_t frame);
+
+private:
+  std::optional<Slot> Allocate(uint page, vec2<uint> tiles);
+  void Free(const Slot &);
+};
@@ -0,0 +1,103 @@
+#include "GlyphAtlas.hxx"
+#include "catch2/catch.hpp"
+
+/* fills the atlas with glyphs of the same size, each used in it's own frame,
+ * returns the number of glyphs inserted */
+static uint32_t Fill(GlyphAtlas &atlas, uint w, uint h, bool permanent,
+                     uint64_t *frame) {
+  uint32_t n = 0;
+  while (atlas.Insert(n, w, h, permanent, *frame) != nullptr &&
+         atlas.stats.evictions == 0) {
+    n++;
+    (*frame)++;
+  }
+  return n;
+}
+
+TEST_CASE("glyph atlas", "[GlyphAtlas]") {
+  GlyphAtlas atlas;
+  atlas.Init({2, 4}, 16, 2);
+  const vec2<uint> page_size = atlas.PageSize();
+  REQUIRE(page_size.x == 16 * 2);
+  REQUIRE(page_size.y == 32 * 4);
+
+  SECTION("hits and misses") {
+    REQUIRE(atlas.Find(1, 0) == nullptr);
+    const GlyphAtlas::Entry *entry = atlas.Insert(1, 5, 7, false, 0);
+    REQUIRE(entry != nullptr);
+    REQUIRE(entry->slot.region.w == 5);
+    REQUIRE(entry->slot.region.h == 7);
+    REQUIRE(atlas.Find(1, 1) == entry);
+    REQUIRE(entry->last_used_frame == 1);
+    REQUIRE(atlas.stats.hits == 1);
+    REQUIRE(atlas.stats.misses == 1);
+  }
+
+  SECTION("empty glyphs take no space") {
+    const GlyphAtlas::Entry *entry = atlas.Insert(' ', 0, 0, false, 0);
+    REQUIRE(entry != nullptr);
+    REQUIRE(entry->slot.region.empty());
+  }
+
+  SECTION("glyphs larger than a page are rejected") {
+    REQUIRE(atlas.Insert(1, page_size.x + 1, 1, false, 0) == nullptr);
+    REQUIRE(atlas.stats.failed_inserts == 1);
+  }
+
+  SECTION("grows into new pages, then evicts the least recently used") {
+    uint64_t frame = 0;
+    const uint32_t n = Fill(atlas, 8, 16, false, &frame);
+    REQUIRE(atlas.pages.size() == 2);
+    REQUIRE(atlas.stats.evictions == 1);
+    /* the oldest glyph was evicted to make space */
+    REQUIRE(atlas.entries.count(0) == 0);
+    REQUIRE(atlas.entries.count(n) == 1);
+
+    /* glyphs used recently are kept */
+    atlas.Touch(1, frame);
+    frame++;
+    REQUIRE(atlas.Insert(n + 1, 8, 16, false, frame) != nullptr);
+    REQUIRE(atlas.entries.count(1) == 1);
+    REQUIRE(atlas.entries.count(2) == 0);
+  }
+
+  SECTION("glyphs used in the current frame are pinned") {
+    uint32_t n = 0;
+    while (atlas.Insert(n, 8, 16, false, 0) != nullptr) {
+      n++;
+    }
+    REQUIRE(n > 0);
+    REQUIRE(atlas.stats.evictions == 0);
+    REQUIRE(atlas.stats.failed_inserts == 1);
+    REQUIRE(atlas.entries.size() == n);
+    const uint64_t epoch = atlas.Epoch();
+
+    /* once they were not used for a whole frame, the glyphs can be evicted */
+    REQUIRE(atlas.Insert(n, 8, 16, false, 2) != nullptr);
+    REQUIRE(atlas.stats.evictions > 0);
+    REQUIRE(atlas.Epoch() != epoch);
+  }
+
+  SECTION("glyphs used in the previous frame are pinned") {
+    /* the glyphs drawn in frame N are touched after the glyphs which arrived
+     * during it are inserted, at the start of frame N + 1 */
+    uint32_t n = 0;
+    while (atlas.Insert(n, 8, 16, false, 5) != nullptr) {
+      n++;
+    }
+    REQUIRE(atlas.Insert(n, 8, 16, false, 6) == nullptr);
+    REQUIRE(atlas.stats.evictions == 0);
+    REQUIRE(atlas.entries.size() == n);
+    for (uint32_t key = 0; key < n; key++) {
+      REQUIRE(atlas.Find(key, 6) != nullptr);
+    }
+  }
+
+  SECTION("permanent glyphs are never evicted") {
+    uint64_t frame = 0;
+    const uint32_t n = Fill(atlas, 8, 16, true, &frame);
+    REQUIRE(atlas.stats.evictions == 0);
+    REQUIRE(atlas.entries.size() == n);
+    REQUIRE(atlas.Insert(n + 1, 8, 16, false, frame + 1) == nullptr);
+  }
+}
@@ -0,0 +1,144 @@
+#include "GlyphRasterizer.hxx"
+#include "../Util/Profile.hxx"
+#include <cstring>
+
+#include "freetype/ftimage.h"
+
+bool OpenFontFace(FT_Library library, const std::string &path, double pt_size,
+                  FT_Face *face) {
+  FT_Error err = FT_New_Face(library, path.c_str(), 0, face);
+  if (err != FT_Err_Ok)
+    return false;
+
+  err = FT_Set_Char_Size(*face,
+                         /* default char width */
+                         0,
+                         /* char_height in 1/64th of points */
+                         (uint32_t)(pt_size * 64),
+                         kFontDPI, kFontDPI);
+  return err == FT_Err_Ok;
+}
+
+std::optional<GlyphBitmap> RasterizeGlyph(FT_Face face, uint32_t glyph_id,
+                                          bool subpixel) {
+  int32_t flags = FT_LOAD_RENDER;
+  if (subpixel) {
+    flags |= FT_LOAD_TARGET_LCD;
+  } else {
+    /* TODO: investigate whether or not this actually disables subpixel
+     * rendering entirely */
+    flags |= FT_LOAD_TARGET_NORMAL;
+  }
+
+  FT_Error err = FT_Load_Glyph(face, glyph_id, flags);
+  if (err != FT_Err_Ok)
+    return std::nullopt;
+
+  const FT_Bitmap &bitmap = face->glyph->bitmap;
+  const size_t bytes_per_pixel = subpixel ? 3 : 1;
+
+  GlyphBitmap glyph;
+  glyph.glyph_id = glyph_id;
+  glyph.permanent = false;
+  /* TODO: should we round up? */
+  glyph.size = {subpixel ? bitmap.width / 3u : bitmap.width, bitmap.rows};
+  glyph.offset = {face->glyph->bitmap_left, face->glyph->bitmap_top};
+
+  /* the pitch of freetype's bitmap does not correspond with the width, and can
+   * also be negative, which opengl has difficulty with */
+  const size_t row_len = glyph.size.x * bytes_per_pixel;
+  glyph.pixels.resize(row_len * glyph.size.y);
+  const uint8_t *src = bitmap.buffer;
+  for (size_t i = 0; i < glyph.size.y; i++) {
+    memcpy(&glyph.pixels[i * row_len], src, row_len);
+    src += bitmap.pitch;
+  }
+
+  return glyph;
+}
+
+bool GlyphRasterizer::Start(const std::string &path, double pt_size,
+                            bool subpixel, uint num_threads) {
+  for (uint i = 0; i < num_threads; i++) {
+    /* faces are opened here, so that failures are reported to the caller */
+    FT_Library library;
+    FT_Face face;
+    if (FT_Init_FreeType(&library) != FT_Err_Ok)
+      return false;
+    if (!OpenFontFace(library, path, pt_size, &face)) {
+      FT_Done_FreeType(library);
+      return false;
+    }
+
+    workers.emplace_back(&GlyphRasterizer::Work, this, library, face,
+                         subpixel);
+  }
+  return true;
+}
+
+GlyphRasterizer::~GlyphRasterizer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  requests_available.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void GlyphRasterizer::Push(Request request) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    requests.push_back(request);
+    in_flight++;
+  }
+  requests_available.notify_one();
+}
+
+void GlyphRasterizer::TakeFinished(std::vector<GlyphBitmap> &out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  in_flight -= finished.size();
+  for (GlyphBitmap &glyph : finished) {
+    out.push_back(std::move(glyph));
+  }
+  finished.clear();
+}
+
+bool GlyphRasterizer::Busy(void) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return in_flight > 0;
+}
+
+void GlyphRasterizer::Work(FT_Library library, FT_Face face, bool subpixel) {
+  PROFILE_THREAD_NAME("glyph rasterizer");
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    requests_available.wait(lock,
+                            [&] { return stopping || !requests.empty(); });
+    if (stopping)
+      break;
+
+    const Request request = requests.front();
+    requests.pop_front();
+
+    lock.unlock();
+    std::optional<GlyphBitmap> glyph;
+    {
+      PROFILE_ZONE("RasterizeGlyph");
+      glyph = RasterizeGlyph(face, request.glyph_id, subpixel);
+    }
+    /* glyphs which can not be rasterized are drawn as empty glyphs, so that
+     * they are not requested again */
+    if (!glyph) {
+      glyph = GlyphBitmap{request.glyph_id, false, {0, 0}, {0, 0}, {}};
+    }
+    glyph->permanent = request.permanent;
+    lock.lock();
+
+    finished.push_back(std::move(*glyph));
+  }
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+}
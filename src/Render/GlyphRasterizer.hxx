@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Types.hxx"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+/* a rasterized glyph, with rows packed without padding */
+struct GlyphBitmap {
+  uint32_t glyph_id;
+  bool permanent;
+  vec2<uint> size;
+  /* offset of the top left of the bitmap from the pen position */
+  vec2<int> offset;
+  std::vector<uint8_t> pixels;
+};
+
+/* TODO: look up dpi in registry */
+constexpr uint kFontDPI = 96;
+
+/* opens the font at path at the size used for rendering, returns false on
+ * failure */
+bool OpenFontFace(FT_Library, const std::string &path, double pt_size,
+                  FT_Face *);
+/* rasterizes the glyph with the given index in the face, using 3 bytes per
+ * pixel if subpixel is true, otherwise 1 byte per pixel
+ * THREAD-UNSAFE for the same face */
+std::optional<GlyphBitmap> RasterizeGlyph(FT_Face, uint32_t glyph_id,
+                                          bool subpixel);
+
+/* Rasterizes glyphs on a pool of worker threads.
+ *
+ * FreeType faces can not be used by multiple threads at once, so every worker
+ * opens it's own library and face. Requests are handled in the order they were
+ * pushed, and finished glyphs are collected with TakeFinished. */
+struct GlyphRasterizer {
+  struct Request {
+    uint32_t glyph_id;
+    bool permanent;
+  };
+
+  GlyphRasterizer() : stopping(false), in_flight(0){};
+  GlyphRasterizer(GlyphRasterizer const &) = delete;
+  GlyphRasterizer &operator=(GlyphRasterizer const &) = delete;
+  ~GlyphRasterizer();
+
+  /* returns false if the font could not be opened */
+  bool Start(const std::string &path, double pt_size, bool subpixel,
+             uint num_threads);
+
+  void Push(Request);
+  /* moves the glyphs finished so far into out */
+  void TakeFinished(std::vector<GlyphBitmap> &out);
+  /* true if any pushed request has not been taken yet */
+  bool Busy(void);
+
+private:
+  void Work(FT_Library, FT_Face, bool subpixel);
+
+  std::mutex mutex;
+  std::condition_variable requests_available;
+  std::deque<Request> requests;
+  std::vector<GlyphBitmap> finished;
+  bool stopping;
+  /* requests which were pushed, but not taken yet */
+  size_t in_flight;
+
+  std::vector<std::thread> workers;
+};
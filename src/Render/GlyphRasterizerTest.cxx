@@ -0,0 +1,74 @@
+#include "GlyphRasterizer.hxx"
+#include "../Platform/LocateFont.hxx"
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <unordered_map>
+
+static std::optional<std::string> LocateTestFont(void) {
+  static bool initialized = LocateFontInit();
+  if (!initialized)
+    return std::nullopt;
+  return LocateFontFile(
+      {"monospace", 12.0, FontFaceProperties::WEIGHT_REGULAR,
+       FontFaceProperties::STRETCH_MEDIUM, FontFaceProperties::SLANT_NORMAL});
+}
+
+TEST_CASE("rasterize glyphs on worker threads", "[GlyphRasterizer]") {
+  std::optional<std::string> path = LocateTestFont();
+  if (!path) {
+    WARN("skipping, could not locate a font");
+    return;
+  }
+
+  FT_Library library;
+  FT_Face face;
+  REQUIRE(FT_Init_FreeType(&library) == FT_Err_Ok);
+  REQUIRE(OpenFontFace(library, *path, 12.0, &face));
+
+  GlyphRasterizer rasterizer;
+  REQUIRE(rasterizer.Start(*path, 12.0, true, 4));
+
+  /* glyphs are requested by their index in the font */
+  auto index = [&](char c) { return FT_Get_Char_Index(face, c); };
+  for (char c = ' '; c < 127; c++) {
+    rasterizer.Push({index(c), c == 'M'});
+  }
+  REQUIRE(rasterizer.Busy());
+
+  std::vector<GlyphBitmap> finished;
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (rasterizer.Busy() && std::chrono::steady_clock::now() < deadline) {
+    rasterizer.TakeFinished(finished);
+  }
+  REQUIRE(!rasterizer.Busy());
+  REQUIRE(finished.size() == 127 - ' ');
+
+  std::unordered_map<uint32_t, GlyphBitmap *> by_id;
+  for (GlyphBitmap &glyph : finished) {
+    by_id[glyph.glyph_id] = &glyph;
+  }
+  REQUIRE(by_id.size() == finished.size());
+
+  /* spaces have no bitmap */
+  REQUIRE(by_id.at(index(' '))->pixels.empty());
+  REQUIRE(by_id.at(index('M'))->permanent);
+  REQUIRE(!by_id.at(index('a'))->permanent);
+
+  /* the workers rasterize exactly like the calling thread */
+  for (char c : {'M', 'g', '@'}) {
+    std::optional<GlyphBitmap> expected =
+        RasterizeGlyph(face, index(c), true);
+    REQUIRE(expected);
+    const GlyphBitmap &glyph = *by_id.at(index(c));
+    REQUIRE(glyph.size.x == expected->size.x);
+    REQUIRE(glyph.size.y == expected->size.y);
+    REQUIRE(glyph.offset.x == expected->offset.x);
+    REQUIRE(glyph.offset.y == expected->offset.y);
+    REQUIRE(glyph.pixels == expected->pixels);
+  }
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+}
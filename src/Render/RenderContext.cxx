@@ -1,9 +1,14 @@
 #include "RenderContext.hxx"
+#include "../Platform/SwapWindow.hxx"
 #include "Shader.hxx"
 #include "src/Render/Types.hxx"
 #include "src/Util/Assert.hxx"
+#include "src/Util/Profile.hxx"
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cstdint>
+#include <cstring>
 
 #define GL_GLEXT_PROTOTYPES
 #include "SDL_opengl.h"
@@ -25,20 +30,50 @@ void RenderContext::Init(void) {
   /*glDebugMessageCallback(MessageCallback, 0);*/
 #endif /* __APPLE__ */
 
-  programs = LoadShaders();
+  programs = LoadShaders(instanced);
+  SwapWindowInit(window);
+  if (gpu_timing) {
+    gpu_timer.Init();
+  }
 
-  /* initialize VAO and VBO */
+  /* initialize VAO and streaming buffer, a segment fits the maximum number of
+   * quads in a single draw call */
   glGenVertexArrays(1, &vao);
-  glGenBuffers(1, &vbo);
   glBindVertexArray(vao);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-  BindVBOAttribs();
+  const bool buffer_storage =
+      SDL_GL_ExtensionSupported("GL_ARB_buffer_storage");
+  if (instanced) {
+    vertex_stream.Init(GL_ARRAY_BUFFER, kMaxQuadsPerDraw * sizeof(Instance),
+                       buffer_storage);
+    glGenBuffers(1, &retained_buffer);
+  } else {
+    vertex_stream.Init(GL_ARRAY_BUFFER, kMaxQuadsPerDraw * 4 * sizeof(Vertex),
+                       buffer_storage);
+
+    std::vector<VertexIndex> indices;
+    indices.reserve(kMaxQuadsPerDraw * 6);
+    for (uint32_t quad = 0; quad < kMaxQuadsPerDraw; quad++) {
+      VertexIndex i = quad * 4;
+      /* clang-format off */
+      indices.insert(indices.end(), {
+        i, (VertexIndex)(i+1), (VertexIndex)(i+2), /* top right triangle */
+        i, (VertexIndex)(i+2), (VertexIndex)(i+3), /* bottom left triangle */
+      });
+      /* clang-format on */
+    }
+
+    /* the element buffer binding is part of the VAO state */
+    glGenBuffers(1, &quad_index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(VertexIndex),
+                 indices.data(), GL_STATIC_DRAW);
+  }
 
   /* default screen color is red */
   glClearColor(0.0, 0.0, 0.0, 1.0);
 
-  /* set up orthographic projection*/
+  /* set up orthographic projection, the viewport is set by Submit */
   SDL_GetWindowSize(window, (int *)&win_w, (int *)&win_h);
   UpdateProjection();
 
@@ -51,17 +86,114 @@ void RenderContext::Init(void) {
 
   static uint8_t backing_texture[4] = {0xff, 0xff, 0xff, 0xff};
   rect_batch = NewBatch(
-      CreateTexture(GPUTexture::Format::kGrayscale, 1, 1, backing_texture),
+      CreateTexture(GPUTexture::Format::kGrayscale, 1, 1, 1, backing_texture),
       false);
 }
 
-RenderContext::Batch *RenderContext::NewBatch(GPUTexture t, bool subpixel) {
+RenderContext::~RenderContext() { Stop(); }
+
+void RenderContext::Start(void) {
+  gl_context = SDL_GL_GetCurrentContext();
+  /* a context can only be current on one thread at a time */
+  SDL_GL_MakeCurrent(window, nullptr);
+  render_thread = std::thread(&RenderContext::RenderThread, this);
+}
+
+void RenderContext::Stop(void) {
+  if (!render_thread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(packets_mutex);
+    stopping = true;
+  }
+  packets_changed.notify_all();
+  render_thread.join();
+  stopping = false;
+  SDL_GL_MakeCurrent(window, gl_context);
+}
+
+void RenderContext::RenderThread(void) {
+  PROFILE_THREAD_NAME("render");
+  SDL_GL_MakeCurrent(window, gl_context);
+
+  std::unique_lock<std::mutex> lock(packets_mutex);
+  for (;;) {
+    packets_changed.wait(lock, [&] {
+      return packets_executed < packets_submitted || finish_requested ||
+             stopping;
+    });
+
+    /* every committed packet is submitted before stopping */
+    if (packets_executed < packets_submitted) {
+      const FramePacket &next = packets[packets_executed % kFramePackets];
+      lock.unlock();
+      Submit(next);
+      lock.lock();
+      /* without a render thread, Submit runs on the thread drawing the
+       * views, which counts its allocations itself */
+      shared_render_allocations = ProfileAllocations();
+      packets_executed++;
+      packets_changed.notify_all();
+    } else if (finish_requested) {
+      glFinish();
+      finish_requested = false;
+      packets_changed.notify_all();
+    } else {
+      break;
+    }
+  }
+  lock.unlock();
+
+  SDL_GL_MakeCurrent(window, nullptr);
+}
+
+bool RenderContext::FrameReady(void) {
+  if (packet != nullptr)
+    return true;
+  std::lock_guard<std::mutex> lock(packets_mutex);
+  return packets_submitted - packets_executed < kFramePackets;
+}
+
+void RenderContext::Finish(void) {
+  if (!render_thread.joinable()) {
+    glFinish();
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(packets_mutex);
+  finish_requested = true;
+  packets_changed.notify_all();
+  packets_changed.wait(lock, [&] { return !finish_requested; });
+}
+
+void RenderContext::FramePacket::Clear(void) {
+  texture_ops.clear();
+  pixels.clear();
+  quads_used = 0;
+  retained_upload.clear();
+  commands.clear();
+  damage.clear();
+}
+
+void RenderContext::AcquirePacket(void) {
+  PROFILE_ZONE("AcquirePacket");
+  std::unique_lock<std::mutex> lock(packets_mutex);
+  /* the oldest packet is free once the render thread submitted it */
+  packets_changed.wait(lock, [&] {
+    return packets_submitted - packets_executed < kFramePackets;
+  });
+  packet = &packets[packets_submitted % kFramePackets];
+  packet->Clear();
+}
+
+RenderContext::BatchID RenderContext::NewBatch(GPUTexture t, bool subpixel) {
   batches.emplace_back(Batch(t, subpixel));
-  return &batches.back();
+  return batches.size() - 1;
 }
 
 void RenderContext::UpdateProjection() {
-  glViewport(0, 0, win_w, win_h);
+  DamageAll();
 
   /* depth range */
   float r = max_z;
@@ -89,85 +221,218 @@ static GLenum TextureFormatToOpenGLEnum(GPUTexture::Format format) {
   unreachable("unknown enum value");
 }
 
+static size_t BytesPerPixel(GPUTexture::Format format) {
+  switch (format) {
+  case GPUTexture::Format::kGrayscale:
+    return 1;
+  case GPUTexture::Format::kRGB:
+    return 3;
+  case GPUTexture::Format::kRGBA:
+    return 4;
+  }
+  unreachable("unknown enum value");
+}
+
 GPUTexture RenderContext::CreateTexture(GPUTexture::Format format, uint w,
-                                        uint h, uint8_t *data) {
+                                        uint h, uint pages,
+                                        const uint8_t *data) {
   GPUTexture texture;
+  texture.id = ++textures_created;
   texture.size = {w, h};
+  texture.pages = pages;
   texture.format = {format};
+  QueueTextureOp(FramePacket::TextureOp::Kind::kCreate, texture, 0,
+                 {0, 0, (int)w, (int)h}, data,
+                 (size_t)w * h * pages * BytesPerPixel(format));
+  return texture;
+}
+
+void RenderContext::ReallocTexture(GPUTexture &texture, uint w, uint h,
+                                   uint pages, const uint8_t *data) {
+  texture.size = {w, h};
+  texture.pages = pages;
+  QueueTextureOp(FramePacket::TextureOp::Kind::kRealloc, texture, 0,
+                 {0, 0, (int)w, (int)h}, data,
+                 (size_t)w * h * pages * BytesPerPixel(texture.format));
+}
 
-  glGenTextures(1, &texture.id);
-  glBindTexture(GL_TEXTURE_2D, texture.id);
+void RenderContext::CopyIntoTexture(const GPUTexture &texture, uint page,
+                                    Rect dst, const uint8_t *data) {
+  QueueTextureOp(FramePacket::TextureOp::Kind::kCopy, texture, page, dst, data,
+                 (size_t)dst.w * dst.h * BytesPerPixel(texture.format));
+}
 
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0,
-               TextureFormatToOpenGLEnum(format), GL_UNSIGNED_BYTE, data);
+void RenderContext::QueueTextureOp(FramePacket::TextureOp::Kind kind,
+                                   const GPUTexture &texture, uint page,
+                                   Rect dst, const uint8_t *data,
+                                   size_t size) {
+  FramePacket &out = Packet();
+  const size_t offset = out.pixels.size();
+  if (data != nullptr) {
+    out.pixels.insert(out.pixels.end(), data, data + size);
+  } else {
+    size = 0;
+  }
+  out.texture_ops.push_back({kind, texture, page, dst, offset, size});
+}
 
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+void RenderContext::ApplyTextureOps(const FramePacket &frame) {
+  using Kind = FramePacket::TextureOp::Kind;
+  for (const FramePacket::TextureOp &op : frame.texture_ops) {
+    const GPUTexture &texture = op.texture;
+    const uint8_t *data =
+        op.data_size > 0 ? frame.pixels.data() + op.data_offset : nullptr;
+    if (op.kind == Kind::kCreate) {
+      if (texture_names.size() <= texture.id) {
+        texture_names.resize(texture.id + 1, 0);
+      }
+      glGenTextures(1, &texture_names[texture.id]);
+    }
 
-  return texture;
+    /* TODO: mismatch between GPuTexture.format and how opengl works, because
+     * you can upload data to a texture in any format, regardless of whether
+     * or not the two formats match */
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_names[texture.id]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const GLenum format = TextureFormatToOpenGLEnum(texture.format);
+    if (op.kind == Kind::kCopy) {
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, op.dst.x, op.dst.y, op.page,
+                      op.dst.w, op.dst.h, 1, format, GL_UNSIGNED_BYTE, data);
+      continue;
+    }
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, texture.size.x,
+                 texture.size.y, texture.pages, 0, format, GL_UNSIGNED_BYTE,
+                 data);
+    if (op.kind == Kind::kCreate) {
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+  }
 }
 
-void RenderContext::ReallocTexture(GPUTexture &texture, uint w, uint h,
-                                   uint8_t *data) {
-  glBindTexture(GL_TEXTURE_2D, texture.id);
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0,
-               TextureFormatToOpenGLEnum(texture.format), GL_UNSIGNED_BYTE,
-               data);
-}
-
-void RenderContext::CopyIntoTexture(GPUTexture &texture, Rect dst,
-                                    uint8_t *data) {
-  /* TODO: mismatch between GPuTexture.format and how opengl works, because you
-   * can upload data to a texture in any format, regardless of whether or not
-   * the two formats match */
-  glBindTexture(GL_TEXTURE_2D, texture.id);
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glTexSubImage2D(GL_TEXTURE_2D, 0, dst.x, dst.y, dst.w, dst.h,
-                  TextureFormatToOpenGLEnum(texture.format), GL_UNSIGNED_BYTE,
-                  data);
-}
-
-void RenderContext::PushQuad(Batch *batch, RenderLayerIdx z, Point dst,
-                             Point src, uint w, uint h, Color color) {
+uint8_t *RenderContext::ReserveQuad(BatchID batch_id, RenderLayerIdx layer) {
+  FramePacket &out = Packet();
+  Batch *batch = &batches[batch_id];
+  const size_t quad_size = instanced ? sizeof(Instance) : 4 * sizeof(Vertex);
+
+  /* the most recent block of the layer, batches are drawn on few layers */
+  Batch::Block *last = nullptr;
+  for (auto block = batch->blocks.rbegin(); block != batch->blocks.rend();
+       block++) {
+    if (block->layer == layer) {
+      last = &*block;
+      break;
+    }
+  }
+
+  /* reserve space in the packet for the batch if the last block is full,
+   * extending the last block if it is directly before the new space */
+  if (last == nullptr || last->count == last->capacity) {
+    constexpr uint32_t n = Batch::kBlockQuads;
+    const size_t offset = out.quads_used;
+    out.quads_used += n * quad_size;
+    /* grown geometrically, since growing zeroes the new space */
+    if (out.quads.size() < out.quads_used) {
+      out.quads.resize(std::max(out.quads.size() * 2, out.quads_used));
+    }
+
+    if (last != nullptr &&
+        last->offset + last->capacity * quad_size == offset) {
+      last->capacity += n;
+    } else {
+      batch->blocks.push_back({offset, 0, n, layer});
+      last = &batch->blocks.back();
+    }
+  }
+
+  return out.quads.data() + last->offset + last->count++ * quad_size;
+}
+
+void RenderContext::PushInstance(BatchID batch, RenderLayerIdx z, Point dst,
+                                 Point src, uint w, uint h, Color color,
+                                 uint8_t page) {
+  /* split quads which are too large to be packed into an instance */
+  if (w > Instance::kMaxExtent) {
+    const int split = Instance::kMaxExtent;
+    PushInstance(batch, z, dst, src, split, h, color, page);
+    PushInstance(batch, z, {dst.x + split, dst.y}, {src.x + split, src.y},
+                 w - split, h, color, page);
+    return;
+  }
+  if (h > Instance::kMaxExtent) {
+    const int split = Instance::kMaxExtent;
+    PushInstance(batch, z, dst, src, w, split, color, page);
+    PushInstance(batch, z, {dst.x, dst.y + split}, {src.x, src.y + split}, w,
+                 h - split, color, page);
+    return;
+  }
+  assert(page < Instance::kMaxPages);
+
+  RenderLayerIdx depth = RENDER_LAYER_IDX_MAX - (base_z + z);
+  Instance instance = {
+      {(int16_t)dst.x, (int16_t)dst.y},
+      {(uint16_t)src.x, (uint16_t)src.y},
+      w | h << 10 | (uint32_t)page << 20 | (uint32_t)depth << 24,
+      color};
+
+  const RenderLayerIdx layer = base_z + z;
+  if (recording) {
+    if (recording_range.batch == kNoBatch) {
+      recording_range.batch = batch;
+      recording_range.layer = layer;
+    }
+    assume(recording_range.batch == batch,
+           "retained quads must belong to the same batch");
+    assume(recording_range.layer == layer,
+           "retained quads must be on the same layer");
+    retained_instances.push_back(instance);
+    recording_range.count++;
+    return;
+  }
+
+  *(Instance *)ReserveQuad(batch, layer) = instance;
+}
+
+void RenderContext::PushQuad(BatchID batch, RenderLayerIdx z, Point dst,
+                             Point src, uint w, uint h, Color color,
+                             uint8_t page) {
   assert((size_t)base_z + (size_t)z < max_z);
+  quads_pushed++;
+  dst = {dst.x + origin.x, dst.y + origin.y};
+  if (instanced) {
+    PushInstance(batch, z, dst, src, w, h, color, page);
+    return;
+  }
   // assert(dst.x + w <= UINT16_MAX && dst.y + h <= UINT16_MAX);
   // assert(src.x + w <= UINT16_MAX && src.y + h <= UINT16_MAX);
 
   RenderLayerIdx depth = RENDER_LAYER_IDX_MAX - (base_z + z);
 
-  assert(vertexes.size() < UINT16_MAX);
-  uint16_t i = vertexes.size();
+  Vertex *v = (Vertex *)ReserveQuad(batch, base_z + z);
   /* clang-format off */
-  vertexes.insert(vertexes.end(), {
-    {
-     {(int16_t) dst.x, (int16_t) dst.y},
-     {(uint16_t) src.x, (uint16_t) src.y},
-     color, depth
-    },
-    {
-     {(int16_t) (dst.x+w), (int16_t) dst.y},
-     {(uint16_t) (src.x+w), (uint16_t) src.y},
-     color, depth
-    },
-    {
-     {(int16_t)(dst.x+w), (int16_t)(dst.y+h)},
-     {(uint16_t)(src.x+w), (uint16_t)(src.y+h)},
-     color, depth
-    },
-    {
-     {(int16_t) dst.x, (int16_t) (dst.y+h)},
-     {(uint16_t) src.x, (uint16_t) (src.y+h)},
-     color, depth
-    }
-  });
-  batch->indices.insert(batch->indices.end(), {
-    i, (VertexIndex)(i+1), (VertexIndex)(i+2), /* top right triangle */
-    i, (VertexIndex)(i+2), (VertexIndex)(i+3), /* bottom left triangle */
-  });
+  v[0] = {
+    {(int16_t) dst.x, (int16_t) dst.y},
+    {(uint16_t) src.x, (uint16_t) src.y},
+    color, depth, page
+  };
+  v[1] = {
+    {(int16_t) (dst.x+w), (int16_t) dst.y},
+    {(uint16_t) (src.x+w), (uint16_t) src.y},
+    color, depth, page
+  };
+  v[2] = {
+    {(int16_t)(dst.x+w), (int16_t)(dst.y+h)},
+    {(uint16_t)(src.x+w), (uint16_t)(src.y+h)},
+    color, depth, page
+  };
+  v[3] = {
+    {(int16_t) dst.x, (int16_t) (dst.y+h)},
+    {(uint16_t) src.x, (uint16_t) (src.y+h)},
+    color, depth, page
+  };
   /* clang-format on */
 }
 
@@ -175,58 +440,516 @@ void RenderContext::DrawRect(RenderLayerIdx z, Rect dst, Color color) {
   PushQuad(rect_batch, z, dst.top_left(), {0, 0}, dst.w, dst.h, color);
 }
 
-void RenderContext::Commit(void) {
-  if (vertexes.size() == 0)
+bool RenderContext::DrawRetained(Hash key, Point offset) {
+  if (!instanced)
+    return false;
+
+  auto range = retained.find(key);
+  if (range == retained.end())
+    return false;
+
+  range->second.last_used_frame = frame;
+  retained_draws.push_back({key, offset});
+  return true;
+}
+
+void RenderContext::BeginRetained(Hash key, Point offset) {
+  assert(!recording);
+  /* there is nowhere to retain quads, so draw them immediately */
+  if (!instanced) {
+    origin = offset;
     return;
+  }
+
+  recording = true;
+  recording_key = key;
+  recording_range = {kNoBatch, 0, (uint32_t)retained_instances.size(), 0,
+                     frame};
+  retained_draws.push_back({key, offset});
+}
 
-  /* Orphan the last VBO
-   * https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming#Buffer_re-specification
-   */
-  if (last_vbo_size > 0) {
-    glBufferData(GL_ARRAY_BUFFER, last_vbo_size, NULL, GL_STREAM_DRAW);
+void RenderContext::EndRetained(void) {
+  if (!instanced) {
+    origin = {0, 0};
+    return;
   }
-  last_vbo_size = vertexes.size();
 
-  glBufferData(GL_ARRAY_BUFFER, vertexes.size() * sizeof(Vertex),
-               vertexes.data(), GL_STREAM_DRAW);
+  assert(recording);
+  recording = false;
+  /* the instances of a replaced range are dropped on the next compaction */
+  retained[recording_key] = recording_range;
+}
 
-  // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glClear(GL_DEPTH_BUFFER_BIT);
+void RenderContext::CompactRetained(void) {
+  std::vector<Instance> live;
+  for (auto it = retained.begin(); it != retained.end();) {
+    RetainedRange &range = it->second;
+    if (range.last_used_frame != frame) {
+      it = retained.erase(it);
+      continue;
+    }
 
-  glEnable(GL_BLEND);
+    const uint32_t first = live.size();
+    live.insert(live.end(), retained_instances.begin() + range.first,
+                retained_instances.begin() + range.first + range.count);
+    range.first = first;
+    it++;
+  }
 
-  for (auto &batch : batches) {
-    if (batch.indices.size() <= 0)
+  retained_instances = std::move(live);
+  retained_uploaded = 0;
+}
+
+void RenderContext::PackRetained(FramePacket &out) {
+  out.retained_first = retained_uploaded;
+  if (retained_instances.size() > retained_capacity) {
+    retained_capacity =
+        std::max(retained_capacity * 2, retained_instances.size());
+    /* growing the buffer drops its contents */
+    out.retained_first = 0;
+  }
+  out.retained_capacity = retained_capacity;
+  out.retained_upload.assign(retained_instances.begin() + out.retained_first,
+                             retained_instances.end());
+  retained_uploaded = retained_instances.size();
+}
+
+void RenderContext::UploadRetained(const FramePacket &frame) {
+  if (frame.retained_upload.empty())
+    return;
+
+  glBindBuffer(GL_ARRAY_BUFFER, retained_buffer);
+  if (frame.retained_capacity != retained_buffer_capacity) {
+    retained_buffer_capacity = frame.retained_capacity;
+    glBufferData(GL_ARRAY_BUFFER, retained_buffer_capacity * sizeof(Instance),
+                 nullptr, GL_DYNAMIC_DRAW);
+  }
+
+  /* instances are only ever appended, so the ranges in use by previous frames
+   * are not touched */
+  glBufferSubData(GL_ARRAY_BUFFER, frame.retained_first * sizeof(Instance),
+                  frame.retained_upload.size() * sizeof(Instance),
+                  frame.retained_upload.data());
+}
+
+void RenderContext::AddDamage(Rect rect) {
+  rect = rect.intersected({0, 0, (int)win_w, (int)win_h});
+  if (!rect.empty()) {
+    damage.push_back(rect);
+  }
+}
+
+void RenderContext::DamageAll(void) { damage_all = true; }
+
+Rect RenderContext::RepairRegion(void) const {
+  const Rect window_rect = {0, 0, (int)win_w, (int)win_h};
+  if (damage_all || last_buffer_age == 0 ||
+      last_buffer_age > kDamageHistory + 1)
+    return window_rect;
+
+  /* the age varies between frames, e.g. with triple buffering, so every
+   * frame which might be missing is repaired */
+  Rect region = {0, 0, 0, 0};
+  if (last_buffer_age > 1) {
+    for (const Rect &rect : committed_damage) {
+      region = region.united(rect);
+    }
+  }
+  return region.intersected(window_rect);
+}
+
+void RenderContext::CommitDamage(FramePacket &out) {
+  const Rect window_rect = {0, 0, (int)win_w, (int)win_h};
+  Rect bounds = {0, 0, 0, 0};
+  /* the compositor is told about every region when there is no damage */
+  if (damage_all) {
+    damage.clear();
+    bounds = window_rect;
+  }
+  for (const Rect &rect : damage) {
+    bounds = bounds.united(rect);
+  }
+  out.repairable = RepairRegion().united(bounds);
+
+  /* keeps the capacity of both */
+  std::swap(out.damage, damage);
+  out.damage_all = damage_all;
+  damage.clear();
+  damage_all = false;
+
+  /* frames without damage are not presented */
+  if (!bounds.empty()) {
+    std::copy_backward(committed_damage,
+                       committed_damage + kDamageHistory - 1,
+                       committed_damage + kDamageHistory);
+    committed_damage[0] = bounds;
+  }
+}
+
+Rect RenderContext::RepaintRegion(const FramePacket &frame,
+                                  uint buffer_age) {
+  const Rect window_rect = {0, 0, (int)frame.win_w, (int)frame.win_h};
+  /* nothing changed, so the frame does not have to be presented */
+  if (!frame.damage_all && frame.damage.empty())
+    return {0, 0, 0, 0};
+  /* the contents of the back buffer are unknown */
+  if (frame.damage_all || buffer_age == 0 ||
+      buffer_age > damage_history_len + 1)
+    return window_rect;
+
+  Rect region = {0, 0, 0, 0};
+  for (const Rect &rect : frame.damage) {
+    region = region.united(rect);
+  }
+  /* the back buffer is missing the damage of the frames presented after it */
+  for (uint i = 0; i + 1 < buffer_age; i++) {
+    region = region.united(damage_history[i]);
+  }
+  return region.intersected(window_rect);
+}
+
+void RenderContext::RecordCommands(FramePacket &out) {
+  std::vector<DrawCommand> &commands = out.commands;
+  commands.clear();
+
+  auto command = [&](BatchID id, RenderLayerIdx layer, bool retained,
+                     size_t offset, uint32_t count,
+                     Point origin) -> DrawCommand {
+    const Batch &batch = batches[id];
+    const uint64_t program = batch.subpixel ? 1 : 0;
+    const uint64_t sort_key = (uint64_t)layer << 48 | program << 40 |
+                              (uint64_t)batch.blend() << 32 |
+                              batch.texture.id;
+    const uint32_t order = commands.size();
+    return {sort_key, id,    batch.texture, batch.subpixel, retained,
+            offset,   count, order,         origin};
+  };
+
+  for (BatchID id = 0; id < batches.size(); id++) {
+    for (auto &block : batches[id].blocks) {
+      commands.push_back(
+          command(id, block.layer, false, block.offset, block.count, {0, 0}));
+    }
+  }
+
+  for (auto &draw : retained_draws) {
+    const RetainedRange &range = retained.at(draw.key);
+    if (range.count == 0)
       continue;
-    GLuint program;
-    if (batch.subpixel) {
+    commands.push_back(command(range.batch, range.layer, true,
+                               range.first * sizeof(Instance), range.count,
+                               draw.offset));
+  }
+
+  /* layers are drawn from the bottom up, see DrawCommand. Within a layer the
+   * depth test keeps the quads pushed first on top, so commands of the same
+   * state keep their order. Unlike std::stable_sort, this does not allocate a
+   * buffer every frame */
+  std::sort(commands.begin(), commands.end(),
+            [](const DrawCommand &a, const DrawCommand &b) {
+              return a.sort_key != b.sort_key ? a.sort_key < b.sort_key
+                                              : a.order < b.order;
+            });
+}
+
+void RenderContext::ApplyState(const FramePacket &frame,
+                               const DrawCommand &command) {
+  const ShaderProgram *program =
+      command.subpixel ? &programs.subpx : &programs.regular;
+  if (program != state.program) {
+    glUseProgram(program->id);
+    gl_calls.program_binds++;
+    state.program = program;
+    /* uniforms are per program */
+    state.projection_set = false;
+    state.texture_size = {0, 0};
+    state.origin = {INT_MIN, INT_MIN};
+  } else {
+    gl_calls.redundant_skipped++;
+  }
+
+  if (command.blend() != state.blend) {
+    if (command.blend() == BlendMode::kSubpixel) {
       glBlendFunc(GL_SRC1_COLOR, GL_ONE_MINUS_SRC1_COLOR);
-      program = programs.subpx;
     } else {
       glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-      program = programs.regular;
     }
-    glBindTexture(GL_TEXTURE_2D, batch.texture.id);
+    gl_calls.blend_changes++;
+    state.blend = command.blend();
+  } else {
+    gl_calls.redundant_skipped++;
+  }
+
+  if (command.texture.id != state.texture) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_names[command.texture.id]);
+    gl_calls.texture_binds++;
+    state.texture = command.texture.id;
+  } else {
+    gl_calls.redundant_skipped++;
+  }
 
-    /* TODO: if last_program != program */
-    glUseProgram(program);
-    glUniform2f(glGetUniformLocation(program, "u_texture_size"),
-                batch.texture.size.x, batch.texture.size.y);
-    glUniformMatrix4fv(glGetUniformLocation(program, "u_projection_matrix"), 1,
-                       GL_FALSE, (const GLfloat *)projection_matrix.data);
+  if (!state.projection_set) {
+    glUniformMatrix4fv(program->u_projection_matrix, 1, GL_FALSE,
+                       (const GLfloat *)frame.projection_matrix.data);
+    gl_calls.uniform_updates++;
+    state.projection_set = true;
+  }
+  if (command.texture.size.x != state.texture_size.x ||
+      command.texture.size.y != state.texture_size.y) {
+    glUniform2f(program->u_texture_size, command.texture.size.x,
+                command.texture.size.y);
+    gl_calls.uniform_updates++;
+    state.texture_size = command.texture.size;
+  } else {
+    gl_calls.redundant_skipped++;
+  }
+  if (instanced && (command.origin.x != state.origin.x ||
+                    command.origin.y != state.origin.y)) {
+    glUniform2f(program->u_offset, command.origin.x, command.origin.y);
+    gl_calls.uniform_updates++;
+    state.origin = command.origin;
+  } else if (instanced) {
+    gl_calls.redundant_skipped++;
+  }
 
-    glDrawElements(GL_TRIANGLES, batch.indices.size(), GL_UNSIGNED_SHORT,
-                   batch.indices.data());
+  const GLuint buffer = command.retained ? retained_buffer : vertex_stream.id;
+  if (buffer != state.array_buffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    gl_calls.buffer_binds++;
+    state.array_buffer = buffer;
+    /* without instancing every quad is addressed with a base vertex, so the
+     * attributes only depend on the buffer */
+    if (!instanced) {
+      BindVBOAttribs(0);
+      gl_calls.attrib_setups++;
+    }
+  } else {
+    gl_calls.redundant_skipped++;
   }
+}
 
-  /* flush to gpu */
-  SDL_GL_SwapWindow(window);
+void RenderContext::Draw(const FramePacket &frame,
+                         const DrawCommand &command) {
+  ApplyState(frame, command);
+  const size_t offset =
+      command.offset + (command.retained ? 0 : vertex_stream.SegmentOffset());
+
+  if (instanced) {
+    BindInstanceAttribs(offset);
+    gl_calls.attrib_setups++;
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, command.count);
+    gl_calls.draw_calls++;
+    return;
+  }
 
-  for (auto &batch : batches) {
-    batch.indices.clear();
+  /* split blocks which can not be addressed with VertexIndex, the segment
+   * and block sizes are multiples of the vertex size */
+  for (uint32_t first = 0; first < command.count; first += kMaxQuadsPerDraw) {
+    const uint32_t n = std::min(command.count - first, kMaxQuadsPerDraw);
+    const GLint base_vertex = offset / sizeof(Vertex) + first * 4;
+    glDrawElementsBaseVertex(GL_TRIANGLES, n * 6, GL_UNSIGNED_SHORT, nullptr,
+                             base_vertex);
+    gl_calls.draw_calls++;
+  }
+}
+
+void RenderContext::CollectGPUStats(void) {
+  uint64_t timed_frame;
+  if (!gpu_timer.Poll(timed_frame, gpu_spans))
+    return;
+
+  GPUFrameStats &stats = gpu_stats;
+  /* assigned one by one, so that batches keeps its capacity and polling does
+   * not allocate */
+  stats.frame = timed_frame;
+  stats.total_ns = 0;
+  stats.upload_ns = 0;
+  stats.clear_ns = 0;
+  stats.batches.clear();
+  for (const GPUTimer::Span &span : gpu_spans) {
+    stats.total_ns += span.ns;
+    if (span.tag == kUploadSpan) {
+      stats.upload_ns += span.ns;
+      continue;
+    }
+    if (span.tag == kClearSpan) {
+      stats.clear_ns += span.ns;
+      continue;
+    }
+
+    /* batches only have a few commands each */
+    auto it = std::find_if(
+        stats.batches.begin(), stats.batches.end(),
+        [&](const GPUBatchStats &batch) { return batch.batch == span.tag; });
+    if (it == stats.batches.end()) {
+      stats.batches.push_back({span.tag, 0, 0, 0, 0, 0});
+      it = stats.batches.end() - 1;
+    }
+    const uint32_t draws =
+        instanced ? 1 : (span.count + kMaxQuadsPerDraw - 1) / kMaxQuadsPerDraw;
+    it->draw_calls += draws;
+    it->quads += span.count;
+    it->vertices += span.count * 4;
+    it->indices += instanced ? 0 : span.count * 6;
+    it->ns += span.ns;
   }
+  PROFILE_COUNTER("gpu frame ns", stats.total_ns);
 
+  std::lock_guard<std::mutex> lock(packets_mutex);
+  shared_gpu_stats = stats;
+}
+
+void RenderContext::Commit(void) {
+  PROFILE_ZONE("Commit");
+  PROFILE_COUNTER("quads pushed", quads_pushed);
+  PROFILE_COUNTER("retained draws", retained_draws.size());
+  PROFILE_COUNTER("frame arena bytes", frame_arena.used);
+  quads_pushed = 0;
+  frame_arena.Reset();
+  FramePacket &out = Packet();
+  if (out.quads_used == 0 && retained_draws.empty())
+    return;
+
+  if (retained_instances.size() > kMaxRetainedInstances) {
+    CompactRetained();
+  }
+  PackRetained(out);
+  RecordCommands(out);
+
+  out.frame = frame;
+  out.win_w = win_w;
+  out.win_h = win_h;
+  out.projection_matrix = projection_matrix;
+  CommitDamage(out);
+
+  retained_draws.clear();
+  for (auto &batch : batches) {
+    batch.blocks.clear();
+  }
   /* reset drawing state */
   base_z = 2;
-  vertexes.clear();
+  frame++;
+  packet = nullptr;
+
+  if (render_thread.joinable()) {
+    std::lock_guard<std::mutex> lock(packets_mutex);
+    packets_submitted++;
+    packets_changed.notify_all();
+  } else {
+    Submit(out);
+    std::lock_guard<std::mutex> lock(packets_mutex);
+    packets_submitted++;
+    packets_executed++;
+  }
+
+  std::lock_guard<std::mutex> lock(packets_mutex);
+  last_gl_calls = shared_gl_calls;
+  PROFILE_COUNTER("gl calls", last_gl_calls.Total());
+  PROFILE_COUNTER("gl draw calls", last_gl_calls.draw_calls);
+  if (shared_gpu_stats.frame != last_gpu_stats.frame) {
+    last_gpu_stats = shared_gpu_stats;
+  }
+  last_buffer_age = shared_buffer_age;
+  last_render_allocations = shared_render_allocations;
+  if (shared_repair_failed) {
+    shared_repair_failed = false;
+    DamageAll();
+  }
+}
+
+void RenderContext::Submit(const FramePacket &frame) {
+  PROFILE_ZONE("Submit");
+  CollectGPUStats();
+  ApplyTextureOps(frame);
+  if (frame.win_w != viewport.x || frame.win_h != viewport.y) {
+    glViewport(0, 0, frame.win_w, frame.win_h);
+    viewport = {frame.win_w, frame.win_h};
+  }
+
+  /* has to be queried before drawing into the back buffer */
+  const uint buffer_age = SwapWindowBufferAge(window);
+  const Rect repaint = RepaintRegion(frame, buffer_age);
+  {
+    std::lock_guard<std::mutex> lock(packets_mutex);
+    shared_buffer_age = buffer_age;
+  }
+  if (repaint.empty()) {
+    /* nothing changed, so there is nothing to draw or present, but later
+     * frames draw the retained quads */
+    UploadRetained(frame);
+    return;
+  }
+
+  /* views only push their quads for the regions they expect to be repaired,
+   * the rest of a larger repaint would be left empty. The frame is dropped,
+   * and so are the following ones until the views pushed every quad */
+  if (!frame.damage_all &&
+      (repair_failed || !frame.repairable.contains(repaint))) {
+    repair_failed = true;
+    UploadRetained(frame);
+    std::lock_guard<std::mutex> lock(packets_mutex);
+    shared_repair_failed = true;
+    return;
+  }
+  repair_failed = false;
+
+  gpu_timer.BeginFrame(frame.frame);
+  const bool streamed = frame.quads_used > 0;
+  if (streamed) {
+    memcpy(vertex_stream.Reserve(frame.quads_used), frame.quads.data(),
+           frame.quads_used);
+    vertex_stream.End();
+  }
+  UploadRetained(frame);
+  gpu_timer.Mark(kUploadSpan, 0);
+
+  /* everything outside of the repaint region is still correct in the back
+   * buffer, the scissor also limits the depth clear */
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(repaint.x, frame.win_h - repaint.y - repaint.h, repaint.w,
+            repaint.h);
+
+  // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  gpu_timer.Mark(kClearSpan, 0);
+
+  glEnable(GL_BLEND);
+
+  gl_calls = {};
+  /* buffers are replaced when they grow, and textures are bound outside of
+   * Draw, so nothing can be assumed to be bound */
+  state = {};
+  state.blend = (BlendMode)UINT8_MAX;
+  state.texture = UINT_MAX;
+  state.array_buffer = UINT_MAX;
+
+  for (const DrawCommand &command : frame.commands) {
+    Draw(frame, command);
+    gpu_timer.Mark(command.batch, command.count);
+  }
+  gpu_timer.EndFrame();
+
+  /* the segment can only be reused once the GPU is done drawing from it */
+  if (streamed) {
+    vertex_stream.Fence();
+  }
+
+  /* flush to gpu, the compositor only needs the damage of this frame, even
+   * if more had to be repaired in the back buffer */
+  Rect damage_bounds = {0, 0, 0, 0};
+  if (frame.damage_all) {
+    damage_bounds = {0, 0, (int)frame.win_w, (int)frame.win_h};
+  }
+  for (const Rect &rect : frame.damage) {
+    damage_bounds = damage_bounds.united(rect);
+  }
+  SwapWindowWithDamage(window, frame.damage);
+
+  std::copy_backward(damage_history, damage_history + kDamageHistory - 1,
+                     damage_history + kDamageHistory);
+  damage_history[0] = damage_bounds;
+  damage_history_len = std::min(damage_history_len + 1, kDamageHistory);
+
+  std::lock_guard<std::mutex> lock(packets_mutex);
+  shared_gl_calls = gl_calls;
 }
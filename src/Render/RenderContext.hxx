@@ -1,11 +1,18 @@
 #pragma once
 
 #include "SDL.h"
+#include "../Util/Arena.hxx"
+#include "../Util/Hash.hxx"
+#include "GPUTimer.hxx"
 #include "Shader.hxx"
+#include "StreamBuffer.hxx"
 #include "Types.hxx"
+#include <condition_variable>
 #include <cstdint>
-#include <list>
+#include <mutex>
 #include <sys/types.h>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #define GL_GLEXT_PROTOTYPES
@@ -24,76 +31,477 @@
  * - proper line height detection
  */
 
-/* puts an upper bound on the number of vertices */
+/* puts an upper bound on the number of vertices in a single draw call when not
+ * instanced, larger batches are split into multiple draw calls */
 typedef uint16_t VertexIndex;
 
+/* Collects the quads of a frame from the views, and draws them with GL.
+ *
+ * The views push their quads into a FramePacket, which Commit hands over to
+ * the render thread once the frame is complete. The render thread owns the GL
+ * context and submits packets in order, so that the thread drawing the views,
+ * which also handles input, never waits for uploads or for the window to be
+ * swapped. There are kFramePackets packets, so the views draw the next frame
+ * while the render thread submits the previous one, and only wait for it once
+ * they are a whole packet ahead.
+ *
+ * Until Start is called, or after Stop, packets are submitted by Commit on
+ * the calling thread instead */
 struct RenderContext {
+  enum class BlendMode : uint8_t { kAlpha, kSubpixel };
+
   struct Batch {
+    /* contiguous range of quads of a single layer in the frame packet */
+    struct Block {
+      /* byte offset into the quads of the packet */
+      size_t offset;
+      /* number of quads */
+      uint32_t count;
+      uint32_t capacity;
+      /* base_z + z of the quads */
+      RenderLayerIdx layer;
+    };
+    /* number of quads reserved at once for a batch, so that quads of a batch
+     * are contiguous and can be drawn with as few calls as possible */
+    static constexpr uint32_t kBlockQuads = 1024;
+
     GPUTexture texture;
     bool subpixel;
-    std::vector<uint16_t> indices;
+    std::vector<Block> blocks;
 
     Batch(GPUTexture texture, bool subpixel)
         : texture(texture), subpixel(subpixel){};
-    // Batch(Batch const &) = delete;
-    // Batch &operator=(RenderContext const &) = delete;
 
-    void PushQuad(RenderLayerIdx z, Point dst, Point src, uint w, uint h,
-                  vec4<uint8_t> color, std::vector<uint16_t> *indexes);
+    BlendMode blend(void) const {
+      return subpixel ? BlendMode::kSubpixel : BlendMode::kAlpha;
+    }
+  };
+  /* index into batches, stable unlike pointers into it */
+  typedef uint32_t BatchID;
+  static constexpr BatchID kNoBatch = UINT32_MAX;
+
+  /* a single draw call, recorded during Commit and sorted by the state it
+   * needs so that state changes are minimized */
+  struct DrawCommand {
+    /* layer, program, blend mode and texture, in order of significance. Quads
+     * are blended, so layers have to be drawn from the bottom up: the depth
+     * test would reject the quads of a lower layer drawn later, leaving the
+     * blended edges of the quads above over whatever was below */
+    uint64_t sort_key;
+    BatchID batch;
+    /* state of the batch when the frame was committed */
+    GPUTexture texture;
+    bool subpixel;
+    /* the quads are in the retained buffer rather than the vertex stream */
+    bool retained;
+    /* byte offset of the first quad into the quads of the packet, or into the
+     * retained buffer */
+    size_t offset;
+    /* number of quads */
+    uint32_t count;
+    /* index of the command when recorded, which orders commands with the same
+     * sort_key */
+    uint32_t order;
+    /* origin of the quads, only used for retained quads */
+    Point origin;
+
+    BlendMode blend(void) const {
+      return subpixel ? BlendMode::kSubpixel : BlendMode::kAlpha;
+    }
   };
 
+  /* everything the render thread needs to submit a frame. Packets are reused,
+   * so their buffers keep their capacity from frame to frame */
+  struct FramePacket {
+    /* textures are created and written in the order the ops were queued,
+     * before anything is drawn */
+    struct TextureOp {
+      enum class Kind : uint8_t { kCreate, kRealloc, kCopy };
+
+      Kind kind;
+      /* the texture as of after the op */
+      GPUTexture texture;
+      /* destination of kCopy */
+      uint page;
+      Rect dst;
+      /* range of pixels, empty for an uninitialized texture */
+      size_t data_offset;
+      size_t data_size;
+    };
+
+    uint64_t frame;
+    uint win_w, win_h;
+    mat4<float> projection_matrix;
+
+    std::vector<TextureOp> texture_ops;
+    std::vector<uint8_t> pixels;
+
+    /* vertexes or instances of every batch, in the blocks of the batches.
+     * Only grows, the first quads_used bytes belong to the frame */
+    std::vector<uint8_t> quads;
+    size_t quads_used;
+    /* instances written into the retained buffer at retained_first, after
+     * growing it to retained_capacity instances */
+    std::vector<Instance> retained_upload;
+    size_t retained_first;
+    size_t retained_capacity;
+
+    std::vector<DrawCommand> commands;
+
+    std::vector<Rect> damage;
+    bool damage_all;
+    /* every view overlapping this region pushed its quads, so that it can be
+     * repaired in back buffers which miss the damage of earlier frames */
+    Rect repairable;
+
+    void Clear(void);
+  };
+  /* a packet is filled while the previous one is submitted */
+  static constexpr uint kFramePackets = 2;
+
+  /* the GL state as last set by Submit, used to filter out redundant state
+   * changes. Reset every frame, since other code may touch the state */
+  struct StateCache {
+    const ShaderProgram *program;
+    BlendMode blend;
+    GLuint texture;
+    GLuint array_buffer;
+    /* uniforms of the bound program */
+    bool projection_set;
+    vec2<uint> texture_size;
+    Point origin;
+  };
+
+  /* number of GL calls issued by Submit, per kind */
+  struct GLCallStats {
+    uint32_t draw_calls;
+    uint32_t program_binds;
+    uint32_t blend_changes;
+    uint32_t texture_binds;
+    uint32_t buffer_binds;
+    uint32_t attrib_setups;
+    uint32_t uniform_updates;
+    /* filtered out by the state cache */
+    uint32_t redundant_skipped;
+
+    uint32_t Total(void) const {
+      return draw_calls + program_binds + blend_changes + texture_binds +
+             buffer_binds + attrib_setups + uniform_updates;
+    }
+  };
+
+  /* GPU time of a committed frame, read back a few frames after it was
+   * drawn */
+  struct GPUBatchStats {
+    BatchID batch;
+    uint32_t draw_calls;
+    uint32_t quads;
+    uint32_t vertices;
+    /* 0 when instanced */
+    uint32_t indices;
+    uint64_t ns;
+  };
+  struct GPUFrameStats {
+    uint64_t frame;
+    /* uploading retained quads and copying the vertex stream */
+    uint64_t upload_ns;
+    uint64_t clear_ns;
+    /* from the start of the upload to the last draw */
+    uint64_t total_ns;
+    /* in the order of their first draw */
+    std::vector<GPUBatchStats> batches;
+  };
+  /* tags of the GPU timer spans which are not draws of a batch */
+  static constexpr uint32_t kUploadSpan = UINT32_MAX;
+  static constexpr uint32_t kClearSpan = UINT32_MAX - 1;
+
   SDL_Window *window;
-  uint win_w, win_h;
 
+  /* draw each quad as a single Instance expanded by the vertex shader instead
+   * of 4 vertexes and 6 indices, must be set before Init */
+  bool instanced;
+  /* time the upload and every draw on the GPU, must be set before Init */
+  bool gpu_timing;
+
+  /* The members below are only used by the thread drawing the views */
+
+  uint win_w, win_h;
   mat4<float> projection_matrix;
 
-  ShaderPrograms programs;
+  std::vector<Batch> batches;
+  BatchID rect_batch;
 
-  std::vector<Vertex> vertexes;
-  std::list<Batch> batches;
+  /* packet being filled, taken by Packet on first use in a frame */
+  FramePacket *packet;
+  /* handles of textures, mapped to GL textures by the render thread */
+  GLuint textures_created;
 
-  Batch *rect_batch;
+  /* stats of the most recent frame the render thread submitted, copied on
+   * Commit */
+  GLCallStats last_gl_calls;
+  /* most recent frame read back from the GPU timer, frame is UINT64_MAX until
+   * the first one is */
+  GPUFrameStats last_gpu_stats;
 
-  GLuint vao;
-  GLuint vbo;
-  /* used for buffer orphaning */
-  GLsizeiptr last_vbo_size;
+  /* number of frames committed so far */
+  uint64_t frame;
+  /* quads pushed since the previous Commit, including retained ones */
+  uint32_t quads_pushed;
+
+  /* quads which are kept on the GPU across frames and drawn at an offset, so
+   * that content which did not change does not have to be pushed again.
+   * Only used when instanced */
+  struct RetainedRange {
+    BatchID batch;
+    /* base_z + z of every quad of the range */
+    RenderLayerIdx layer;
+    /* index of the first instance in retained_instances */
+    uint32_t first;
+    uint32_t count;
+    uint64_t last_used_frame;
+  };
+  struct RetainedDraw {
+    Hash key;
+    Point offset;
+  };
+  /* once the retained instances grow past this, the ranges which were not
+   * drawn in the current frame are dropped */
+  static constexpr size_t kMaxRetainedInstances = 1 << 18;
+
+  std::unordered_map<Hash, RetainedRange> retained;
+  std::vector<RetainedDraw> retained_draws;
+  /* copy of the retained buffer, so that it can be compacted */
+  std::vector<Instance> retained_instances;
+  /* size the retained buffer has as of the packets committed so far, in
+   * instances */
+  size_t retained_capacity;
+  /* number of instances at the start of retained_instances already committed
+   */
+  size_t retained_uploaded;
+
+  /* state of the range being recorded between BeginRetained and EndRetained
+   */
+  bool recording;
+  Hash recording_key;
+  RetainedRange recording_range;
+  /* offset added to pushed quads, used for drawing retained content
+   * immediately when instancing is unavailable */
+  Point origin;
+
+  /* regions of the window which changed this frame, reported by the views.
+   * Views still push all of their quads when they are damaged, but only the
+   * damaged regions are redrawn, and passed on to the compositor */
+  std::vector<Rect> damage;
+  /* the whole window has to be redrawn, e.g. after a resize */
+  bool damage_all;
+  /* bounds of the damage of the most recently committed frames which had
+   * any, most recent first. Back buffers are repaired from the damage of the
+   * frames presented after them */
+  static constexpr uint kDamageHistory = 4;
+  Rect committed_damage[kDamageHistory];
+  /* age of the back buffer the render thread drew the most recent frame
+   * into, copied on Commit */
+  uint last_buffer_age;
+  /* heap allocations the render thread made up to the most recent frame it
+   * submitted, copied on Commit. See ProfileAllocations */
+  uint64_t last_render_allocations;
+
+  /* scratch memory of the views while they draw a frame, so that drawing
+   * does not allocate from the heap. Reset by Commit */
+  static constexpr size_t kFrameArenaSize = 64 << 20;
+  Arena frame_arena;
 
   /* TODO: change z values to uint8 */
   /* UpdateProjection must be called after changing max z */
   RenderLayerIdx max_z;
   RenderLayerIdx base_z;
 
+  /* The members below are shared with the render thread */
+
+  FramePacket packets[kFramePackets];
+  std::mutex packets_mutex;
+  std::condition_variable packets_changed;
+  /* packets are taken in order, packet i is packets[i % kFramePackets] */
+  uint64_t packets_submitted;
+  uint64_t packets_executed;
+  bool stopping;
+  /* Finish waits for the render thread to clear it */
+  bool finish_requested;
+  GLCallStats shared_gl_calls;
+  GPUFrameStats shared_gpu_stats;
+  uint shared_buffer_age;
+  uint64_t shared_render_allocations;
+  /* set when the render thread dropped a frame, as it had to repair more of
+   * the back buffer than the views pushed quads for */
+  bool shared_repair_failed;
+  std::thread render_thread;
+  SDL_GLContext gl_context;
+
+  /* The members below are only used by the thread which owns the GL context
+   */
+
+  ShaderPrograms programs;
+  StateCache state;
+  /* stats of the frame being submitted */
+  GLCallStats gl_calls;
+  GPUTimer gpu_timer;
+  GPUFrameStats gpu_stats;
+  std::vector<GPUTimer::Span> gpu_spans;
+
+  GLuint vao;
+  /* the quads of a packet are copied into the vertex stream when it is
+   * submitted */
+  StreamBuffer vertex_stream;
+  /* every quad uses the same index pattern, so the indices for the largest
+   * possible draw call are generated once, and draw calls use a base vertex.
+   * Only used when not instanced */
+  GLuint quad_index_buffer;
+  static constexpr uint32_t kMaxQuadsPerDraw =
+      ((size_t)1 << (8 * sizeof(VertexIndex))) / 4;
+
+  GLuint retained_buffer;
+  /* in instances */
+  size_t retained_buffer_capacity;
+  /* GL textures by handle */
+  std::vector<GLuint> texture_names;
+  /* size of the window as of the most recently submitted packet */
+  vec2<uint> viewport;
+
+  /* bounds of the damage of the most recently presented frames, most recent
+   * first, used to repair back buffers which are more than a frame old */
+  Rect damage_history[kDamageHistory];
+  uint damage_history_len;
+  /* frames are dropped after a failed repair, until one damages everything */
+  bool repair_failed;
+
   RenderContext(SDL_Window *window)
-      : window(window), last_vbo_size(0), max_z(255), base_z(2){};
+      : window(window), instanced(true), gpu_timing(true), rect_batch(kNoBatch),
+        packet(nullptr), textures_created(0), last_gl_calls(),
+        last_gpu_stats({UINT64_MAX, 0, 0, 0, {}}), frame(0), quads_pushed(0),
+        retained_capacity(0), retained_uploaded(0), recording(false),
+        origin({0, 0}), damage_all(true), committed_damage(),
+        last_buffer_age(0), last_render_allocations(0),
+        frame_arena(kFrameArenaSize), max_z(255), base_z(2),
+        packets_submitted(0), packets_executed(0), stopping(false),
+        finish_requested(false), shared_gl_calls(),
+        shared_gpu_stats({UINT64_MAX, 0, 0, 0, {}}), shared_buffer_age(0),
+        shared_render_allocations(0), shared_repair_failed(false),
+        gl_context(nullptr), state(), gl_calls(),
+        gpu_stats({UINT64_MAX, 0, 0, 0, {}}), retained_buffer(0),
+        retained_buffer_capacity(0), viewport({0, 0}), damage_history_len(0),
+        repair_failed(false){};
   RenderContext(RenderContext const &) = delete;
   RenderContext &operator=(RenderContext const &) = delete;
+  ~RenderContext();
 
+  /* sets up GL on the current context of the window */
   void Init(void);
+  /* moves the current GL context to the render thread, which submits the
+   * packets from then on */
+  void Start(void);
+  /* stops the render thread once it submitted every committed packet, and
+   * makes the GL context current on the calling thread again */
+  void Stop(void);
+  /* whether a frame can be drawn without waiting for the render thread */
+  bool FrameReady(void);
+  /* waits until the GPU is done with every committed frame */
+  void Finish(void);
 
+  /* also damages the whole window */
   void UpdateProjection();
 
-  Batch *NewBatch(GPUTexture, bool subpixel);
+  void AddDamage(Rect);
+  void DamageAll(void);
+  /* Region outside of the damage of the frame which the render thread may
+   * have to repaint, as the back buffer it draws into can miss the damage of
+   * the frames presented after it. Views which skip pushing their quads have
+   * to push them when they overlap it. The whole window while the age of
+   * back buffers is unknown */
+  Rect RepairRegion(void) const;
+
+  BatchID NewBatch(GPUTexture, bool subpixel);
 
   /* TODO: destructor? make members of GPUTexture? refcount/non-movable/ */
 
-  /* data may be NULL for an unitinitalized texture */
-  static GPUTexture CreateTexture(GPUTexture::Format, uint w, uint h,
-                                  uint8_t *data);
+  /* Textures are created and written by the render thread before the frame
+   * is drawn, data is copied and may be freed right away */
+
+  /* creates a texture, reading the contents of every page from data
+   *
+   * data may be NULL for an unitinitalized texture */
+  GPUTexture CreateTexture(GPUTexture::Format, uint w, uint h, uint pages,
+                           const uint8_t *data);
   /* reallocates the storage of a texture, destroying the old contents, reading
-   * the new contents from data if non-null
+   * the new contents of every page from data if non-null
    *
    * data may be NULL for an unitinitalized texture */
-  static void ReallocTexture(GPUTexture &, uint w, uint h, uint8_t *data);
+  void ReallocTexture(GPUTexture &, uint w, uint h, uint pages,
+                      const uint8_t *data);
   /* data must not be null */
-  static void CopyIntoTexture(GPUTexture &, Rect dst, uint8_t *data);
+  void CopyIntoTexture(const GPUTexture &, uint page, Rect dst,
+                       const uint8_t *data);
 
-  void PushQuad(Batch *, RenderLayerIdx z, Point dst, Point src, uint w, uint h,
-                Color);
+  /* page is the page of the batch texture to read from */
+  void PushQuad(BatchID, RenderLayerIdx z, Point dst, Point src, uint w, uint h,
+                Color, uint8_t page = 0);
+  void PushInstance(BatchID, RenderLayerIdx z, Point dst, Point src, uint w,
+                    uint h, Color, uint8_t page);
+  /* returns space for a single quad in the packet which will be drawn with
+   * the batch, on layer base_z + z */
+  uint8_t *ReserveQuad(BatchID, RenderLayerIdx layer);
 
   void DrawRect(RenderLayerIdx z, Rect dst, Color color);
 
+  /* draws the quads retained under key, with their origin at offset.
+   * Returns false if nothing is retained under key */
+  bool DrawRetained(Hash key, Point offset);
+  /* quads pushed until EndRetained are relative to offset, and are retained
+   * under key, as well as drawn at offset. All quads must belong to the same
+   * batch and layer */
+  void BeginRetained(Hash key, Point offset);
+  void EndRetained(void);
+  /* drops the retained ranges which were not drawn in the current frame */
+  void CompactRetained(void);
+
   // TODO: vec3 color, no text alpha
 
+  /* hands the frame over to the render thread */
   void Commit(void);
-};
\ No newline at end of file
+
+  /* the packet being filled, waiting for the render thread to release one
+   * if this is the first use in the frame */
+  FramePacket &Packet(void) {
+    if (packet == nullptr) {
+      AcquirePacket();
+    }
+    return *packet;
+  }
+  void AcquirePacket(void);
+  void QueueTextureOp(FramePacket::TextureOp::Kind, const GPUTexture &,
+                      uint page, Rect dst, const uint8_t *data, size_t size);
+  /* adds the retained instances which are not on the GPU yet to the packet */
+  void PackRetained(FramePacket &);
+  /* records the draw commands of the frame into the packet, and sorts them by
+   * state */
+  void RecordCommands(FramePacket &);
+  /* moves the damage of the frame into the packet, along with the region the
+   * views pushed their quads for */
+  void CommitDamage(FramePacket &);
+
+  /* Called by the thread which owns the GL context */
+
+  /* draws the packet and swaps the window */
+  void Submit(const FramePacket &);
+  void RenderThread(void);
+  /* region of the back buffer which has to be redrawn for the packet, given
+   * the age of the back buffer */
+  Rect RepaintRegion(const FramePacket &, uint buffer_age);
+  void ApplyTextureOps(const FramePacket &);
+  void UploadRetained(const FramePacket &);
+  /* sets up the GL state for drawing the command, skipping state which is
+   * already set */
+  void ApplyState(const FramePacket &, const DrawCommand &);
+  void Draw(const FramePacket &, const DrawCommand &);
+  /* updates gpu_stats if the GPU timer has a new frame */
+  void CollectGPUStats(void);
+};
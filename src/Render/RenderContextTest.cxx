@@ -0,0 +1,269 @@
+#include "RenderContext.hxx"
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch2/catch.hpp"
+
+#include "SDL.h"
+#include <mutex>
+#include <string>
+
+/* creates a hidden window with the same GL context that the editor uses,
+ * returns nullptr if there is no display to create it on */
+static SDL_Window *CreateHiddenGLWindow(void) {
+  if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    return nullptr;
+
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+  SDL_Window *window =
+      SDL_CreateWindow("test", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                       3840, 2160, SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL);
+  if (window == nullptr)
+    return nullptr;
+
+  if (SDL_GL_CreateContext(window) == nullptr) {
+    SDL_DestroyWindow(window);
+    return nullptr;
+  }
+  SDL_GL_SetSwapInterval(0);
+  return window;
+}
+
+TEST_CASE("render 200k glyphs", "[RenderContext]") {
+  static SDL_Window *window = CreateHiddenGLWindow();
+  if (window == nullptr) {
+    WARN("skipping, could not create a GL context: " << SDL_GetError());
+    return;
+  }
+
+  const bool instanced = GENERATE(false, true);
+  constexpr size_t num_glyphs = 200 * 1000;
+
+  RenderContext rctx(window);
+  rctx.instanced = instanced;
+  rctx.Init();
+
+  /* glyphs are drawn from a subpixel atlas, like RenderFont does */
+  static uint8_t atlas_data[16 * 16 * 3] = {};
+  GPUTexture atlas =
+      rctx.CreateTexture(GPUTexture::Format::kRGB, 16, 16, 1, atlas_data);
+  RenderContext::BatchID batch = rctx.NewBatch(atlas, true);
+
+  /* interleave rects with glyphs, so that the glyph batch is not contiguous in
+   * the stream */
+  auto draw_frame = [&] {
+    rctx.DamageAll();
+    for (size_t i = 0; i < num_glyphs; i++) {
+      const int x = (i * 7) % rctx.win_w;
+      const int y = ((i * 7) / rctx.win_w * 14) % rctx.win_h;
+      rctx.PushQuad(batch, 2, {x, y}, {0, 0}, 7, 14, RGB(0x111111));
+      if (i % 1000 == 0) {
+        rctx.DrawRect(1, {x, y, 2, 14}, RGB(0x555555));
+      }
+    }
+    rctx.Commit();
+  };
+
+  draw_frame();
+  REQUIRE(glGetError() == GL_NO_ERROR);
+  /* commands of a layer are sorted by state, so every program and texture is
+   * only bound once, no matter how the batches are interleaved */
+  REQUIRE(rctx.last_gl_calls.program_binds == 2);
+  REQUIRE(rctx.last_gl_calls.texture_binds == 2);
+
+  /* timer queries are read back on a later commit once they are available */
+  glFinish();
+  draw_frame();
+  const RenderContext::GPUFrameStats &gpu = rctx.last_gpu_stats;
+  REQUIRE(gpu.frame == 0);
+  REQUIRE(gpu.batches.size() == 2);
+  const RenderContext::GPUBatchStats &glyphs =
+      gpu.batches[0].batch == batch ? gpu.batches[0] : gpu.batches[1];
+  REQUIRE(glyphs.batch == batch);
+  REQUIRE(glyphs.quads == num_glyphs);
+  REQUIRE(glyphs.vertices == num_glyphs * 4);
+  REQUIRE(glyphs.indices == (instanced ? 0 : num_glyphs * 6));
+  REQUIRE(gpu.total_ns >= glyphs.ns);
+
+  BENCHMARK(std::string(instanced ? "instanced" : "indexed") + " - " +
+            std::to_string(num_glyphs) + " glyphs") {
+    draw_frame();
+  };
+  REQUIRE(glGetError() == GL_NO_ERROR);
+}
+
+TEST_CASE("render thread", "[RenderContext]") {
+  static SDL_Window *window = CreateHiddenGLWindow();
+  if (window == nullptr) {
+    WARN("skipping, could not create a GL context: " << SDL_GetError());
+    return;
+  }
+
+  RenderContext rctx(window);
+  rctx.Init();
+  rctx.Start();
+
+  /* textures are created and written by the render thread */
+  static uint8_t pixels[8 * 8 * 4] = {};
+  GPUTexture texture =
+      rctx.CreateTexture(GPUTexture::Format::kRGBA, 8, 8, 1, pixels);
+  RenderContext::BatchID batch = rctx.NewBatch(texture, false);
+
+  auto draw_frame = [&] {
+    rctx.DamageAll();
+    rctx.CopyIntoTexture(texture, 0, {0, 0, 4, 4}, pixels);
+    for (int i = 0; i < 1000; i++) {
+      rctx.PushQuad(batch, 1, {i % 100, i / 100}, {0, 0}, 8, 8, RGB(0x111111));
+      rctx.DrawRect(2, {i, 0, 1, 1}, RGB(0x222222));
+    }
+    rctx.Commit();
+  };
+
+  constexpr int num_frames = 50;
+  for (int i = 0; i < num_frames; i++) {
+    draw_frame();
+    /* the views never get more than a packet ahead */
+    std::lock_guard<std::mutex> lock(rctx.packets_mutex);
+    REQUIRE(rctx.packets_submitted - rctx.packets_executed <=
+            RenderContext::kFramePackets);
+  }
+
+  rctx.Finish();
+  {
+    std::lock_guard<std::mutex> lock(rctx.packets_mutex);
+    REQUIRE(rctx.packets_executed == num_frames);
+  }
+  /* stats of submitted frames are handed back on commit */
+  draw_frame();
+  REQUIRE(rctx.last_gl_calls.program_binds == 1);
+  REQUIRE(rctx.last_gl_calls.texture_binds == 2);
+
+  rctx.Stop();
+  /* the context is current on this thread again */
+  REQUIRE(glGetError() == GL_NO_ERROR);
+}
+
+TEST_CASE("repaint region", "[RenderContext]") {
+  RenderContext rctx(nullptr);
+  rctx.win_w = 800;
+  rctx.win_h = 600;
+  const Rect window_rect = {0, 0, 800, 600};
+  auto equal = [](Rect a, Rect b) {
+    return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+  };
+  /* the damage collected so far, as Commit would hand it over */
+  RenderContext::FramePacket packet;
+  auto repaint = [&](uint buffer_age) {
+    packet.win_w = rctx.win_w;
+    packet.win_h = rctx.win_h;
+    packet.damage = rctx.damage;
+    packet.damage_all = rctx.damage_all;
+    return rctx.RepaintRegion(packet, buffer_age);
+  };
+
+  /* the first frame is always fully redrawn */
+  rctx.AddDamage({10, 10, 5, 5});
+  REQUIRE(equal(repaint(1), window_rect));
+
+  rctx.damage_all = false;
+  rctx.damage_history[0] = {100, 100, 10, 10};
+  rctx.damage_history_len = 1;
+
+  SECTION("unknown buffer contents") {
+    REQUIRE(equal(repaint(0), window_rect));
+    REQUIRE(equal(repaint(3), window_rect));
+  }
+  SECTION("previous frame") {
+    REQUIRE(equal(repaint(1), {10, 10, 5, 5}));
+  }
+  SECTION("older frame") {
+    REQUIRE(equal(repaint(2), {10, 10, 100, 100}));
+  }
+  SECTION("damage is clipped to the window") {
+    rctx.damage.clear();
+    rctx.AddDamage({790, -10, 20, 20});
+    REQUIRE(equal(repaint(1), {790, 0, 10, 10}));
+  }
+  SECTION("no damage") {
+    rctx.damage.clear();
+    rctx.AddDamage({900, 900, 20, 20});
+    REQUIRE(repaint(1).empty());
+    /* nothing is presented, so older buffers are not repaired either */
+    REQUIRE(repaint(2).empty());
+    REQUIRE(repaint(0).empty());
+  }
+}
+
+TEST_CASE("repair region", "[RenderContext]") {
+  RenderContext rctx(nullptr);
+  rctx.win_w = 800;
+  rctx.win_h = 600;
+  auto equal = [](Rect a, Rect b) {
+    return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+  };
+  const Rect window_rect = {0, 0, 800, 600};
+
+  /* frames without damage are not recorded */
+  RenderContext::FramePacket packet;
+  rctx.CommitDamage(packet);
+  REQUIRE(packet.damage_all);
+  REQUIRE(equal(packet.repairable, window_rect));
+  rctx.CommitDamage(packet);
+  rctx.AddDamage({10, 10, 5, 5});
+  rctx.CommitDamage(packet);
+  rctx.AddDamage({100, 100, 10, 10});
+  rctx.CommitDamage(packet);
+  REQUIRE(equal(rctx.committed_damage[0], {100, 100, 10, 10}));
+  REQUIRE(equal(rctx.committed_damage[1], {10, 10, 5, 5}));
+  REQUIRE(equal(rctx.committed_damage[2], window_rect));
+
+  SECTION("unknown buffer age") {
+    rctx.last_buffer_age = 0;
+    REQUIRE(equal(rctx.RepairRegion(), window_rect));
+  }
+  SECTION("previous frame") {
+    rctx.last_buffer_age = 1;
+    REQUIRE(rctx.RepairRegion().empty());
+    rctx.AddDamage({20, 20, 5, 5});
+    rctx.CommitDamage(packet);
+    REQUIRE(equal(packet.repairable, {20, 20, 5, 5}));
+  }
+  SECTION("older frames") {
+    rctx.last_buffer_age = 2;
+    rctx.committed_damage[2] = {0, 0, 0, 0};
+    REQUIRE(equal(rctx.RepairRegion(), {10, 10, 100, 100}));
+  }
+  SECTION("damage of the whole window") {
+    rctx.last_buffer_age = 1;
+    rctx.DamageAll();
+    REQUIRE(equal(rctx.RepairRegion(), window_rect));
+  }
+}
+
+TEST_CASE("layers are drawn from the bottom up", "[RenderContext]") {
+  RenderContext rctx(nullptr);
+  const bool instanced = GENERATE(false, true);
+  rctx.instanced = instanced;
+
+  /* the texture of the upper layer is created first, so sorting by state
+   * alone would draw it first */
+  const GPUTexture glyphs = {1, {16, 16}, 1, GPUTexture::Format::kRGB};
+  const GPUTexture image = {2, {16, 16}, 1, GPUTexture::Format::kRGBA};
+  const RenderContext::BatchID upper = rctx.NewBatch(glyphs, true);
+  const RenderContext::BatchID lower = rctx.NewBatch(image, false);
+
+  for (int i = 0; i < 10; i++) {
+    rctx.PushQuad(upper, 3, {i, 0}, {0, 0}, 8, 8, RGB(0x111111));
+    rctx.PushQuad(lower, 1, {i, 0}, {0, 0}, 8, 8, RGB(0x222222));
+    rctx.PushQuad(lower, 5, {i, 0}, {0, 0}, 8, 8, RGB(0x333333));
+  }
+
+  RenderContext::FramePacket &packet = rctx.Packet();
+  rctx.RecordCommands(packet);
+  REQUIRE(packet.commands.size() == 3);
+  REQUIRE(packet.commands[0].batch == lower);
+  REQUIRE(packet.commands[1].batch == upper);
+  REQUIRE(packet.commands[2].batch == lower);
+  REQUIRE(packet.commands[0].count == 10);
+}
@@ -1,85 +1,147 @@
 #include "RenderFont.hxx"
+#include "../Platform/CacheDirectory.hxx"
 #include "../Util/Assert.hxx"
+#include "../Util/Profile.hxx"
 #include "RenderContext.hxx"
 
+#include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <cstring>
+#include <limits>
 #include <optional>
 #include <string>
+#include <thread>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_ADVANCES_H
 #include "freetype/ftimage.h"
 
+#include <hb-ft.h>
+#include <hb.h>
+
 static FT_Library library = nullptr;
 
-/* WARNING: due to the way freetype works, calling this function will invalidate
- * any previously returned FT_bitmaps */
-static std::optional<FT_Bitmap>
-RenderFreeTypeGlyph(FT_Face face, RenderFont::GlyphID g, bool subpixel) {
+/* the placeholder is an outlined box, half as wide as it is high */
+static GlyphBitmap CreatePlaceholder(vec2<uint> em_size, bool subpixel) {
+  const size_t bytes_per_pixel = subpixel ? 3 : 1;
+  const vec2<uint> size = {std::max(em_size.y / 2, 3u),
+                           std::max(em_size.y, 3u)};
+
+  GlyphBitmap placeholder = {RenderFont::kPlaceholderKey, true, size,
+                             {0, (int)size.y}, {}};
+  placeholder.pixels.resize(size.x * size.y * bytes_per_pixel);
+  for (uint y = 0; y < size.y; y++) {
+    for (uint x = 0; x < size.x; x++) {
+      const bool border =
+          x == 0 || y == 0 || x == size.x - 1 || y == size.y - 1;
+      memset(&placeholder.pixels[(y * size.x + x) * bytes_per_pixel],
+             border ? 0xff : 0, bytes_per_pixel);
+    }
+  }
+  return placeholder;
+}
 
-  int32_t flags = FT_LOAD_RENDER;
-  if (subpixel) {
-    flags |= FT_LOAD_TARGET_LCD;
-  } else {
-    /* TODO: investigate whether or not this actually disables subpixel
-     * rendering entirely */
-    flags |= FT_LOAD_TARGET_NORMAL;
+static FT_Library Library(void) {
+  if (library == nullptr) {
+    FT_Error err = FT_Init_FreeType(&library);
+    assume(err == FT_Err_Ok, "freetype failed to init");
   }
+  return library;
+}
 
-  FT_Error err = FT_Load_Char(face, g, flags);
-  expect(err == FT_Err_Ok);
+static double NanosecondsSince(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - t)
+      .count();
+}
 
-  FT_Bitmap bitmap = face->glyph->bitmap;
-  if (subpixel) {
-    /* TODO: should we round up? */
-    bitmap.width = bitmap.width / 3u;
+std::unique_ptr<RenderFont> LoadFont(RenderContext *rctx, std::string path,
+                                     double pt_size) {
+  auto rf = std::make_unique<RenderFont>();
+  rf->subpixel = true;
+  rf->rctx = rctx;
+  rf->path = path;
+  rf->pt_size = pt_size;
+
+  auto t = std::chrono::steady_clock::now();
+  std::unique_ptr<AtlasCache> cache;
+  rf->cache_key = AtlasCacheKeyForFont(path, pt_size, kFontDPI, rf->subpixel);
+  std::optional<std::string> cache_dir = CacheDirectory();
+  if (rf->cache_key && cache_dir) {
+    rf->cache_path = *cache_dir + "/" + AtlasCacheFileName(*rf->cache_key);
+    cache = ReadAtlasCache(rf->cache_path, *rf->cache_key);
+    if (cache && cache->bytes_per_pixel != rf->BytesPerPixel()) {
+      cache.reset();
+    }
+    rf->cache_outdated = cache == nullptr;
   }
+  rf->load_stats.cache_hit = cache != nullptr;
+  rf->load_stats.read_cache = NanosecondsSince(t);
+
+  t = std::chrono::steady_clock::now();
+  if (cache) {
+    rf->RestoreAtlas(*cache);
+    rf->OpenFaceInBackground();
+  } else if (!rf->PrepareAtlas()) {
+    return nullptr;
+  }
+  rf->load_stats.prepare_atlas = NanosecondsSince(t);
 
-  return bitmap;
-}
+  GPUTexture::Format format;
+  if (rf->subpixel) {
+    format = GPUTexture::Format::kRGB;
+  } else {
+    format = GPUTexture::Format::kGrayscale;
+  }
 
-std::optional<RenderFont> LoadFont(RenderContext *rctx, std::string path,
-                                   double pt_size) {
-  if (library == nullptr) {
-    FT_Error err = FT_Init_FreeType(&library);
-    assume(err == FT_Err_Ok, "freetype failed to init");
+  /* every page is uploaded at once, directly from the cache file if there is
+   * one */
+  t = std::chrono::steady_clock::now();
+  const vec2<uint> page_size = rf->atlas_space.PageSize();
+  std::vector<uint8_t> contents;
+  const uint8_t *pixels = cache ? cache->pixels : nullptr;
+  if (pixels == nullptr) {
+    for (auto &page : rf->atlas_pages) {
+      contents.insert(contents.end(), page.begin(), page.end());
+    }
+    pixels = contents.data();
   }
+  rf->atlas = rctx->CreateTexture(format, page_size.x, page_size.y,
+                                  rf->atlas_pages.size(), pixels);
+  rf->load_stats.upload = NanosecondsSince(t);
 
-  FT_Error err;
-  RenderFont rf;
-  rf.subpixel = true;
-  rf.rctx = rctx;
+  rf->batch = rctx->NewBatch(rf->atlas, true);
 
-  err = FT_New_Face(library, path.c_str(), 0, &rf.ft_face);
-  expect(err == FT_Err_Ok);
+  return rf;
+}
 
-  err = FT_Set_Char_Size(rf.ft_face,
-                         /* default char width */
-                         0,
-                         /* char_height in 1/64th of points */
-                         (uint32_t)(pt_size * 64),
-                         /* dpi TODO: look up dpi in registry */
-                         96, 96);
+bool RenderFont::PrepareAtlas(void) {
+  if (Face() == nullptr)
+    return false;
 
   /* freetype uses 26.6 fixed point for line height values */
-  rf.line_height = (float)rf.ft_face->size->metrics.height / (float)(1 << 6);
+  line_height = (float)ft_face->size->metrics.height / (float)(1 << 6);
 
   /* determine slot size */
-  auto em_bitmap = RenderFreeTypeGlyph(rf.ft_face, 'M', rf.subpixel);
-  expect(em_bitmap);
+  auto em_bitmap =
+      RasterizeGlyph(ft_face, FT_Get_Char_Index(ft_face, 'M'), subpixel);
+  if (!em_bitmap)
+    return false;
 
   constexpr uint x_sections = 6;
   constexpr uint y_sections = 3;
-  rf.tile_dimensions = {DivideRoundUp(em_bitmap->width, x_sections),
-                        DivideRoundUp(em_bitmap->rows, y_sections)};
+  const vec2<uint> tile_dimensions = {
+      DivideRoundUp(em_bitmap->size.x, x_sections),
+      DivideRoundUp(em_bitmap->size.y, y_sections)};
 
-  /* size texture and bitmatrices to accomodate 256 M
-   * sized characters */
+  /* size the pages to accomodate 256 M sized characters each */
   constexpr size_t target_num_glyphs = 256;
 
   size_t major_sections;
   size_t minor_sections;
-  if constexpr (rf.used_space.axis == BitMatrix2DFixedAxis::kWidth) {
+  if constexpr (GlyphAtlas::Matrix::axis == BitMatrix2DFixedAxis::kWidth) {
     major_sections = x_sections;
     minor_sections = y_sections;
   } else {
@@ -88,98 +150,311 @@ std::optional<RenderFont> LoadFont(RenderContext *rctx, std::string path,
   }
 
   size_t num_glyphs_per_row =
-      DivideRoundUp((size_t)rf.used_space.major_len, major_sections);
+      DivideRoundUp((size_t)GlyphAtlas::Matrix::major_len, major_sections);
   size_t rows_needed = DivideRoundUp(target_num_glyphs, num_glyphs_per_row);
 
-  rf.used_space.Resize(rows_needed * 2 * minor_sections);
-  rf.damaged_space.Resize(rows_needed * 2 * minor_sections);
-
-  GPUTexture::Format format;
-  if (rf.subpixel) {
-    format = GPUTexture::Format::kRGB;
-  } else {
-    format = GPUTexture::Format::kGrayscale;
+  atlas_space.Init(tile_dimensions, rows_needed * 2 * minor_sections,
+                   Instance::kMaxPages);
+
+  /* the placeholder is uploaded along with the first page */
+  const vec2<uint> page_size = atlas_space.PageSize();
+  atlas_pages.emplace_back(page_size.x * page_size.y * BytesPerPixel());
+  GlyphBitmap placeholder = CreatePlaceholder(em_bitmap->size, subpixel);
+  const GlyphAtlas::Entry *entry = atlas_space.Insert(
+      placeholder.glyph_id, placeholder.size.x, placeholder.size.y, true, 0);
+  assume(entry != nullptr, "placeholder glyph does not fit into the atlas");
+  CopyIntoPage(entry->slot.page, entry->slot.region, placeholder.pixels.data());
+
+  /* printable ASCII (0-127) is used for layout all the time, so it's advances
+   * are looked up once. This only loads metrics, so it is cheap */
+  for (uint c = 0; c < 128; c++) {
+    ascii_advances[c] =
+        Advance(FT_Get_Char_Index(ft_face, std::isprint(c) ? c : '?'));
   }
 
-  rf.atlas = RenderContext::CreateTexture(
-      format, rf.used_space.width() * rf.tile_dimensions.x,
-      rf.used_space.height() * rf.tile_dimensions.y, nullptr);
+  if (!StartRasterizer())
+    return false;
 
-  /* load permanently mapped characters (ASCII printable
-   * 0-127) */
+  /* printable ASCII is permanently mapped, but rasterized in the background
+   * like every other glyph */
   for (char c = 0; c < 127; c++) {
     if (std::isprint(c)) {
-      Rect region = rf.GetGlyph(c, true).texture_region;
+      RequestGlyph(FT_Get_Char_Index(ft_face, c), true);
+    }
+  }
+  return true;
+}
 
-      size_t extent;
-      if constexpr (rf.used_space.axis == BitMatrix2DFixedAxis::kWidth) {
-        extent = region.x + region.w;
-      } else {
-        extent = region.y + region.h;
-      }
+void RenderFont::RestoreAtlas(AtlasCache &cache) {
+  line_height = cache.line_height;
+  memcpy(ascii_advances, cache.ascii_advances, sizeof(ascii_advances));
+  atlas_space = std::move(cache.atlas);
 
-      rf.permanent_region_extent = std::max(rf.permanent_region_extent, extent);
+  for (const AtlasCacheGlyph &glyph : cache.glyphs) {
+    if (glyph.key <= std::numeric_limits<GlyphID>::max()) {
+      glyphs[glyph.key] = {glyph.bitmap_size, glyph.offset};
     }
   }
 
-  rf.batch = rctx->NewBatch(rf.atlas, true);
+  /* the copies of the pages are needed when pages are added later */
+  const vec2<uint> page_size = atlas_space.PageSize();
+  const size_t page_len = page_size.x * page_size.y * BytesPerPixel();
+  for (size_t i = 0; i < atlas_space.pages.size(); i++) {
+    const uint8_t *page = cache.pixels + i * page_len;
+    atlas_pages.emplace_back(page, page + page_len);
+  }
+}
 
-  return rf;
+bool RenderFont::WriteCache(void) {
+  std::vector<AtlasCacheGlyph> cached;
+  for (const auto &[key, entry] : atlas_space.entries) {
+    AtlasCacheGlyph glyph = {
+        key, entry.slot, entry.permanent, {0, 0}, {0, 0}};
+    auto metrics = glyphs.find(key);
+    if (key <= std::numeric_limits<GlyphID>::max() &&
+        metrics != glyphs.end()) {
+      glyph.bitmap_size = metrics->second.bitmap_size;
+      glyph.offset = metrics->second.offset;
+    }
+    cached.push_back(glyph);
+  }
+
+  return WriteAtlasCache(cache_path, *cache_key, line_height, ascii_advances,
+                         atlas_space, cached, atlas_pages, BytesPerPixel());
 }
 
-RenderFont::Glyph RenderFont::GetGlyph(GlyphID glyph_id, bool permanent) {
-  /* TODO: use permanent_region_extent and handle overflows */
-  auto glyph_idx = glyphs.find(glyph_id);
-  if (glyph_idx != glyphs.end()) {
-    return glyph_idx->second;
+hb_font_t *RenderFont::ShapingFont(void) {
+  if (hb_font == nullptr && Face() != nullptr) {
+    hb_font = hb_ft_font_create_referenced(ft_face);
+    /* uses the same hinting as rasterizing, so that the advances match */
+    hb_ft_font_set_load_flags(hb_font, subpixel ? FT_LOAD_TARGET_LCD
+                                                : FT_LOAD_TARGET_NORMAL);
   }
+  return hb_font;
+}
 
-  auto bitmap = RenderFreeTypeGlyph(ft_face, glyph_id, subpixel);
-  /* TODO: handle this without panicing */
-  assume(bitmap, "freetype could not provide glyph");
+RenderFont::~RenderFont() {
+  if (face_opener.joinable()) {
+    face_opener.join();
+  }
+}
 
-  size_t tile_w = DivideRoundUp(bitmap->width, tile_dimensions.x);
-  size_t tile_h = DivideRoundUp(bitmap->rows, tile_dimensions.y);
-  auto pos = used_space.FindUnsetRect(tile_w, tile_h);
-  /* TODO: handle this without panicing */
-  assume(pos, "could not find space in bitmatrix");
-  used_space.SetRect({(int)pos->x, (int)pos->y, (int)tile_w, (int)tile_h});
+void RenderFont::OpenFaceInBackground(void) {
+  /* the main thread does not use freetype until Face joins the thread */
+  face_opener = std::thread([this] {
+    PROFILE_THREAD_NAME("font face");
+    const auto t = std::chrono::steady_clock::now();
+    if (!OpenFontFace(Library(), path, pt_size, &ft_face)) {
+      ft_face = nullptr;
+    }
+    load_stats.open_face = NanosecondsSince(t);
+  });
+}
+
+FT_Face RenderFont::Face(void) {
+  if (face_opener.joinable()) {
+    const auto t = std::chrono::steady_clock::now();
+    face_opener.join();
+    load_stats.wait_face = NanosecondsSince(t);
+  }
+  if (ft_face == nullptr && !OpenFontFace(Library(), path, pt_size, &ft_face)) {
+    ft_face = nullptr;
+  }
+  return ft_face;
+}
+
+bool RenderFont::StartRasterizer(void) {
+  if (rasterizer_started)
+    return true;
+
+  const uint num_threads =
+      std::clamp(std::thread::hardware_concurrency(), 1u, 4u);
+  rasterizer_started = rasterizer.Start(path, pt_size, subpixel, num_threads);
+  return rasterizer_started;
+}
+
+float RenderFont::Advance(GlyphID glyph_id) {
+  auto advance = advances.find(glyph_id);
+  if (advance != advances.end()) {
+    return advance->second;
+  }
 
-  /* freetype uses 26.6 fixed point for advance values */
-  float advance = (float)ft_face->glyph->advance.x / (float)(1 << 6);
+  FT_Face face = Face();
+  if (face == nullptr)
+    return 0;
+
+  /* uses the same hinting as rasterizing, so that the advance matches */
+  FT_Int32 flags = subpixel ? FT_LOAD_TARGET_LCD : FT_LOAD_TARGET_NORMAL;
+  FT_Fixed value = 0;
+  FT_Error err = FT_Get_Advance(face, glyph_id, flags, &value);
+  /* freetype uses 16.16 fixed point for scaled advance values */
+  const float result = err == FT_Err_Ok ? (float)value / (float)(1 << 16) : 0;
+  advances.insert({glyph_id, result});
+  return result;
+}
+
+float RenderFont::NonASCIIAdvance(uint32_t codepoint) {
+  auto advance = char_advances.find(codepoint);
+  if (advance != char_advances.end()) {
+    return advance->second;
+  }
+
+  FT_Face face = Face();
+  const float result =
+      face == nullptr ? 0 : Advance(FT_Get_Char_Index(face, codepoint));
+  char_advances.insert({codepoint, result});
+  return result;
+}
+
+void RenderFont::RequestGlyph(GlyphID glyph_id, bool permanent) {
+  auto it = dropped.find(glyph_id);
+  if (it != dropped.end()) {
+    if (rctx->frame - it->second < kDroppedRetryFrames)
+      return;
+    dropped.erase(it);
+  }
+
+  if (pending.insert(glyph_id).second) {
+    /* fonts loaded from the cache start the rasterizer on the first glyph
+     * outside of the cache */
+    const bool started = StartRasterizer();
+    assume(started, "failed to open font for rasterizing");
+    rasterizer.Push({glyph_id, permanent});
+  }
+}
 
-  Glyph glyph = {{(int)pos->x * (int)tile_dimensions.x,
-                  (int)pos->y * (int)tile_dimensions.y, (int)bitmap->width,
-                  (int)bitmap->rows},
-                 {ft_face->glyph->bitmap_left, ft_face->glyph->bitmap_top},
-                 advance,
-                 permanent};
+void RenderFont::CopyIntoPage(uint page, Rect region, const uint8_t *pixels) {
+  const size_t bytes_per_pixel = BytesPerPixel();
+  const size_t page_w = atlas_space.PageSize().x;
+  const size_t row_len = region.w * bytes_per_pixel;
+  std::vector<uint8_t> &dst = atlas_pages[page];
+  for (size_t i = 0; i < (size_t)region.h; i++) {
+    memcpy(&dst[((region.y + i) * page_w + region.x) * bytes_per_pixel],
+           pixels + i * row_len, row_len);
+  }
+}
 
-  glyphs.insert({glyph_id, glyph});
+void RenderFont::Update(void) {
+  PlaceArrivedGlyphs();
 
-  /* copy the freetype bitmap into our own buffer, since the pitch of it's
-   * bitmap does not correspond with the width, and can also be negative, which
-   * opengl has difficulty with */
-  std::vector<uint8_t> bitmap_copy(bitmap->width * 3 * 3 * bitmap->rows);
-  uint8_t *src = bitmap->buffer;
-  uint8_t *dst = bitmap_copy.data();
-  for (size_t i = 0; i < bitmap->rows; i++) {
-    memcpy(dst, src, bitmap->pitch);
-    src += bitmap->pitch;
-    dst += bitmap->width * 3;
+  /* written once every permanent glyph is placed, so that the next start
+   * does not have to rasterize them */
+  if (cache_outdated && pending.empty()) {
+    cache_outdated = false;
+    WriteCache();
   }
+}
 
-  RenderContext::CopyIntoTexture(atlas, glyph.texture_region,
-                                 bitmap_copy.data());
+void RenderFont::PlaceArrivedGlyphs(void) {
+  arrived.clear();
+  arrived.swap(unplaced);
+  rasterizer.TakeFinished(arrived);
+  if (arrived.empty())
+    return;
+  PROFILE_ZONE("PlaceArrivedGlyphs");
+
+  const vec2<uint> page_size = atlas_space.PageSize();
+  const size_t num_pages = atlas_space.pages.size();
+  /* scratch memory is copied by the render context, so it only has to live
+   * until the end of the frame */
+  Arena &scratch = rctx->frame_arena;
+  ArenaVector<Rect> dirty(Instance::kMaxPages, {0, 0, 0, 0}, scratch);
+
+  for (GlyphBitmap &bitmap : arrived) {
+    /* glyphs which can never fit are drawn as empty glyphs */
+    if (bitmap.size.x > page_size.x || bitmap.size.y > page_size.y) {
+      bitmap.size = {0, 0};
+    }
 
-  return glyph;
+    const GlyphAtlas::Entry *entry =
+        atlas_space.Insert(bitmap.glyph_id, bitmap.size.x, bitmap.size.y,
+                           bitmap.permanent, rctx->frame);
+    const GlyphID glyph_id = bitmap.glyph_id;
+    /* the atlas is full of glyphs used in this frame, which may be the case
+     * for as long as the view does not change */
+    if (entry == nullptr) {
+      if (++place_attempts[glyph_id] < kPlaceAttempts) {
+        unplaced.push_back(std::move(bitmap));
+      } else {
+        place_attempts.erase(glyph_id);
+        pending.erase(glyph_id);
+        dropped[glyph_id] = rctx->frame;
+      }
+      continue;
+    }
+
+    place_attempts.erase(glyph_id);
+    glyphs[glyph_id] = {bitmap.size, bitmap.offset};
+    pending.erase(glyph_id);
+
+    const Rect region = entry->slot.region;
+    if (region.empty())
+      continue;
+    while (atlas_pages.size() < atlas_space.pages.size()) {
+      atlas_pages.emplace_back(page_size.x * page_size.y * BytesPerPixel());
+    }
+    CopyIntoPage(entry->slot.page, region, bitmap.pixels.data());
+    dirty[entry->slot.page] = dirty[entry->slot.page].united(region);
+  }
+  placed_epoch++;
+
+  if (atlas_space.pages.size() != num_pages) {
+    /* reallocating the texture destroys it's contents, so every page is
+     * uploaded from the copies */
+    ArenaVector<uint8_t> contents(scratch);
+    contents.reserve(atlas_pages.size() * atlas_pages[0].size());
+    for (auto &page : atlas_pages) {
+      contents.insert(contents.end(), page.begin(), page.end());
+    }
+    rctx->ReallocTexture(atlas, page_size.x, page_size.y, atlas_pages.size(),
+                         contents.data());
+    return;
+  }
+
+  /* a single upload of the region covering every new glyph per page */
+  const size_t bytes_per_pixel = BytesPerPixel();
+  ArenaVector<uint8_t> region_copy(scratch);
+  for (uint page = 0; page < atlas_pages.size(); page++) {
+    const Rect region = dirty[page];
+    if (region.empty())
+      continue;
+
+    const size_t row_len = region.w * bytes_per_pixel;
+    region_copy.resize(row_len * region.h);
+    for (size_t i = 0; i < (size_t)region.h; i++) {
+      memcpy(&region_copy[i * row_len],
+             &atlas_pages[page][((region.y + i) * page_size.x + region.x) *
+                                bytes_per_pixel],
+             row_len);
+    }
+    rctx->CopyIntoTexture(atlas, page, region, region_copy.data());
+  }
 }
 
 void RenderFont::DrawGlyph(RenderLayerIdx z, Point dst, GlyphID glyph_id,
                            Color color) {
-  Glyph glyph = GetGlyph(glyph_id, false);
+  const GlyphAtlas::Entry *entry = atlas_space.Find(glyph_id, rctx->frame);
+  if (entry == nullptr) {
+    RequestGlyph(glyph_id, false);
+    /* the placeholder sits on the baseline, like most glyphs */
+    const GlyphAtlas::Entry &placeholder =
+        atlas_space.entries.at(kPlaceholderKey);
+    const Rect region = placeholder.slot.region;
+    rctx->PushQuad(batch, z, {dst.x + 1, dst.y - region.h}, region.top_left(),
+                   region.w, region.h, color, placeholder.slot.page);
+    return;
+  }
+
+  const Rect region = entry->slot.region;
+  if (region.empty())
+    return;
 
+  const Glyph &glyph = glyphs.at(glyph_id);
   rctx->PushQuad(batch, z, {dst.x + glyph.offset.x, dst.y - glyph.offset.y},
-                 glyph.texture_region.top_left(), glyph.texture_region.w,
-                 glyph.texture_region.h, color);
-}
\ No newline at end of file
+                 region.top_left(), region.w, region.h, color,
+                 entry->slot.page);
+}
+
+void RenderFont::TouchGlyph(GlyphID glyph_id) {
+  atlas_space.Touch(glyph_id, rctx->frame);
+}
@@ -1,69 +1,181 @@
 #pragma once
 
+#include "AtlasCache.hxx"
 #include "BitMatrix2D.hxx"
+#include "GlyphAtlas.hxx"
+#include "GlyphRasterizer.hxx"
 #include "RenderContext.hxx"
 #include "Types.hxx"
+#include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <thread>
 
 #include <ft2build.h>
 #include <unordered_map>
+#include <unordered_set>
 #include FT_FREETYPE_H
 #include "freetype/ftimage.h"
 
+/* from hb.h, which is only needed by the implementation */
+struct hb_font_t;
+
 #define GL_GLEXT_PROTOTYPES
 #include "SDL_opengl.h"
 #include "SDL_opengl_glext.h"
 
+/* Glyphs are identified by their index in the font, as produced by shaping,
+ * not by the characters they were shaped from */
 struct RenderFont {
   /* OpenType/TrueType allows a maximum of 65,536 glyphs in a font */
   using GlyphID = uint16_t;
 
+  /* metrics of a rasterized glyph, which are kept even if its bitmap is
+   * evicted from the atlas */
   struct Glyph {
-    Rect texture_region;
+    vec2<uint> bitmap_size;
     vec2<int> offset;
-    float advance;
+  };
 
-    bool permanent;
+  /* atlas key of the box drawn in place of glyphs which are not rasterized
+   * yet, outside of the range of GlyphID */
+  static constexpr GlyphAtlas::Key kPlaceholderKey = 1 << 16;
+  /* frames a rasterized glyph is kept for when the atlas is full of glyphs
+   * in use, before it is dropped and drawn as the placeholder */
+  static constexpr uint kPlaceAttempts = 8;
+  /* frames until a dropped glyph is rasterized again when it is drawn, by
+   * when the glyphs filling the atlas may not be in use anymore */
+  static constexpr uint64_t kDroppedRetryFrames = 120;
+
+  /* time spent in the steps of LoadFont, in nanoseconds */
+  struct LoadStats {
+    bool cache_hit;
+    double read_cache;
+    /* opening the face and rasterizing the placeholder, or restoring the atlas
+     * from the cache */
+    double prepare_atlas;
+    double upload;
+    /* fonts loaded from the cache open ft_face on a thread, as the first draw
+     * needs it for shaping. Zero if it was opened by PrepareAtlas */
+    double open_face;
+    /* time Face waited for that thread */
+    double wait_face;
   };
 
   RenderContext *rctx;
+  std::string path;
+  double pt_size;
 
+  /* only used for metrics and shaping, glyphs are rasterized by the rasterizer
+   * threads. Fonts loaded from the atlas cache open it on face_opener, so that
+   * it is not on the startup path */
   FT_Face ft_face;
+  std::thread face_opener;
+  /* shapes text using ft_face, created on first use */
+  hb_font_t *hb_font;
   float line_height;
   /* TODO: renderfont stores it's own indices, but puts vertices into the
    * rendercontext
    * TODO: renderfont.DrawFrame*/
 
-  RenderContext::Batch *batch;
+  RenderContext::BatchID batch;
   GPUTexture atlas;
   bool subpixel;
-  size_t permanent_region_extent;
-  // std::vector<uint16_t> *indices;
 
-  BitMatrix2D<BitMatrix2DFixedAxis::kHeight, uint32_t> used_space;
-  BitMatrix2D<BitMatrix2DFixedAxis::kHeight, uint32_t> damaged_space;
-  vec2<uint> tile_dimensions;
+  /* where the glyph bitmaps are in the atlas texture */
+  GlyphAtlas atlas_space;
+  /* copy of every atlas page, used to restore the contents of the texture when
+   * pages are added */
+  std::vector<std::vector<uint8_t>> atlas_pages;
 
   std::unordered_map<GlyphID, Glyph> glyphs;
+  /* advances of the glyphs of ASCII characters, indexed by character.
+   * Control characters are drawn as '?', and have it's advance */
+  float ascii_advances[128];
+  std::unordered_map<GlyphID, float> advances;
+  std::unordered_map<uint32_t, float> char_advances;
+
+  GlyphRasterizer rasterizer;
+  bool rasterizer_started;
+  /* glyphs requested from the rasterizer, but not placed in the atlas yet */
+  std::unordered_set<GlyphID> pending;
+  /* rasterized glyphs which did not fit into the atlas yet */
+  std::vector<GlyphBitmap> unplaced;
+  /* the glyphs placed by PlaceArrivedGlyphs, swapped with unplaced so that
+   * neither allocates once they grew */
+  std::vector<GlyphBitmap> arrived;
+  /* failed placements of the unplaced glyphs */
+  std::unordered_map<GlyphID, uint> place_attempts;
+  /* frames the glyphs which could not be placed were dropped in */
+  std::unordered_map<GlyphID, uint64_t> dropped;
+  /* incremented whenever rasterized glyphs are placed in the atlas */
+  uint64_t placed_epoch;
 
-  /* TODO: prevent used glyphs from being evicted until the next frame,
-   * just draw unknown char for now, but could store a boolean with each
-   * glyph to tell if it was used since the previous frame draw, or a
-   * counter telling the last frame it was used on, or a counter telling how
-   * many frames ago it was last used. DO not resize texture if at all possible
-   */
-
-  /*
-   * bool HasGlyph(uint16_t glyph_id);
-   * uint16_t GetGlyphId(uint32_t codepoint);
-   */
-  Glyph GetGlyph(GlyphID, bool permanent);
+  /* empty if there is no cache directory */
+  std::string cache_path;
+  std::optional<AtlasCacheKey> cache_key;
+  /* true until the permanent glyphs were written to the cache */
+  bool cache_outdated;
+  LoadStats load_stats;
+
+  RenderFont()
+      : ft_face(nullptr), hb_font(nullptr), rasterizer_started(false),
+        placed_epoch(0),
+        cache_outdated(false), load_stats(){};
+  RenderFont(RenderFont const &) = delete;
+  RenderFont &operator=(RenderFont const &) = delete;
+  ~RenderFont();
+
+  float Advance(GlyphID);
+  /* advance of the glyph of a character, without shaping. Used for layout */
+  float CharAdvance(uint32_t codepoint) {
+    if (codepoint < 128)
+      return ascii_advances[codepoint];
+    return NonASCIIAdvance(codepoint);
+  }
+  float NonASCIIAdvance(uint32_t codepoint);
+  /* draws a placeholder if the glyph is not rasterized yet */
   void DrawGlyph(RenderLayerIdx z, Point dst, GlyphID, Color color);
+  /* marks a glyph as used in the current frame, so that it is not evicted
+   * while drawn from retained quads */
+  void TouchGlyph(GlyphID);
+  /* places the glyphs rasterized since the previous call into the atlas, and
+   * uploads them with a single copy per atlas page. Should be called once per
+   * frame, before drawing */
+  void Update(void);
+  void PlaceArrivedGlyphs(void);
+  /* true while requested glyphs are still being rasterized or placed */
+  bool GlyphsPending(void) const { return !pending.empty(); }
+  /* changes whenever glyphs drawn from the atlas might look different, e.g.
+   * after placeholders are replaced by rasterized glyphs */
+  uint64_t Epoch(void) const { return atlas_space.Epoch() + placed_epoch; }
+  size_t BytesPerPixel(void) const { return subpixel ? 3 : 1; }
+
+  /* opens ft_face on face_opener, Face waits for it */
+  void OpenFaceInBackground(void);
+  /* opens the face if it is not open yet, returns nullptr on failure */
+  FT_Face Face(void);
+  /* returns nullptr if the face could not be opened */
+  hb_font_t *ShapingFont(void);
+  /* returns false if the font could not be opened */
+  bool StartRasterizer(void);
+  void RequestGlyph(GlyphID, bool permanent);
+  /* sets up the atlas from a font file, requesting the permanent glyphs.
+   * Returns false on failure */
+  bool PrepareAtlas(void);
+  void RestoreAtlas(AtlasCache &);
+  /* writes every glyph in the atlas to the cache, returns false on failure */
+  bool WriteCache(void);
+  /* copies the bitmap into the page copy at region */
+  void CopyIntoPage(uint page, Rect region, const uint8_t *pixels);
 };
 
 /* TODO: embed https://github.com/unicode-org/last-resort-font or hex codes */
 
-/* THREAD-UNSAFE due to freetype, could be fixed with mutex */
-std::optional<RenderFont> LoadFont(RenderContext *, std::string path,
-                                   double pt_size);
\ No newline at end of file
+/* Loads the atlas from the atlas cache if it was written for the same font
+ * file and settings, otherwise rasterizes the permanent glyphs in the
+ * background and writes them to the cache once they are all placed.
+ * THREAD-UNSAFE due to freetype, could be fixed with mutex */
+std::unique_ptr<RenderFont> LoadFont(RenderContext *, std::string path,
+                                     double pt_size);
\ No newline at end of file
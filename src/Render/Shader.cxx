@@ -7,6 +7,7 @@
 
 static std::string vertex_shader = R"(
   out vec2 v_texture_pos;
+  flat out float v_page;
   out vec4 v_color;
 
   uniform mat4 u_projection_matrix;
@@ -14,6 +15,31 @@ static std::string vertex_shader = R"(
   void main() {
       gl_Position = u_projection_matrix * vec4(screen_coord, -depth, 1.0);
       v_texture_pos = texture_coord;
+      v_page = page;
+      v_color = color;
+  }
+)";
+
+static std::string instanced_vertex_shader = R"(
+  out vec2 v_texture_pos;
+  flat out float v_page;
+  out vec4 v_color;
+
+  uniform mat4 u_projection_matrix;
+  /* origin of retained quads */
+  uniform vec2 u_offset;
+
+  void main() {
+      /* corners of the quad, in triangle strip order */
+      vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+      vec2 size = vec2(size_page_depth & 0x3ffu,
+                       (size_page_depth >> 10) & 0x3ffu);
+      float depth = float(size_page_depth >> 24) / 255.0;
+
+      gl_Position = u_projection_matrix *
+                    vec4(u_offset + dst_pos + corner * size, -depth, 1.0);
+      v_texture_pos = src_pos + corner * size;
+      v_page = float((size_page_depth >> 20) & 0xfu);
       v_color = color;
   }
 )";
@@ -22,19 +48,21 @@ static std::string fragment_shader = R"(
   #version 330 core
 
   in vec2 v_texture_pos;
+  flat in float v_page;
   in vec4 v_color;
 
   out vec4 o_color;
   out vec4 o_alpha;
 
   uniform float texture_saturation;
-  uniform sampler2D texture1;
+  /* every texture is an array of pages */
+  uniform sampler2DArray texture1;
   uniform vec2 u_texture_size;
 
   void main() {
-    /* TODO: fix texture blending */
-    o_color = v_color; // *
-    //o_color = texture(texture1, v_texture_pos/u_texture_size);
+    /* rects use a single white texel */
+    o_color = v_color *
+        texture(texture1, vec3(v_texture_pos / u_texture_size, v_page));
     o_alpha = vec4(1, 1, 1, 1);
   }
 )";
@@ -71,12 +99,13 @@ static std::string subpx_fragment_shader = R"(
   #version 330 core
 
   in vec2 v_texture_pos;
+  flat in float v_page;
   in vec4 v_color;
 
   layout(location = 0, index = 0) out vec4 o_color;
   layout(location = 0, index = 1) out vec4 o_alpha;
 
-  uniform sampler2D texture1;
+  uniform sampler2DArray texture1;
   uniform vec2 u_texture_size;
 
   const float gamma_lut[256] = float[256](
@@ -140,7 +169,8 @@ static std::string subpx_fragment_shader = R"(
 
   void main() {
     o_color = vec4(v_color.xyz, 1.0);
-    o_alpha = gamma_correct_subpx(v_color, texture(texture1, v_texture_pos/u_texture_size));
+    vec3 texture_pos = vec3(v_texture_pos/u_texture_size, v_page);
+    o_alpha = gamma_correct_subpx(v_color, texture(texture1, texture_pos));
   }
 )";
 
@@ -166,28 +196,33 @@ static void CompileShader(GLuint shader_id, std::string shader_name,
   }
 }
 
-ShaderPrograms LoadShaders(void) {
-  ShaderPrograms programs = {glCreateProgram(), glCreateProgram()};
+static ShaderProgram LinkProgram(GLuint vs, GLuint fs) {
+  ShaderProgram program;
+  program.id = glCreateProgram();
+  glAttachShader(program.id, vs);
+  glAttachShader(program.id, fs);
+  glLinkProgram(program.id);
+
+  program.u_projection_matrix =
+      glGetUniformLocation(program.id, "u_projection_matrix");
+  program.u_texture_size = glGetUniformLocation(program.id, "u_texture_size");
+  program.u_offset = glGetUniformLocation(program.id, "u_offset");
+  return program;
+}
 
+ShaderPrograms LoadShaders(bool instanced) {
   GLuint vs, fs, subpx_fs;
   vs = glCreateShader(GL_VERTEX_SHADER);
   fs = glCreateShader(GL_FRAGMENT_SHADER);
   subpx_fs = glCreateShader(GL_FRAGMENT_SHADER);
 
   std::string vert_shader =
-      "#version 330 core\n" + GenerateVertexShaderHeader() + vertex_shader;
+      "#version 330 core\n" + GenerateVertexShaderHeader(instanced) +
+      (instanced ? instanced_vertex_shader : vertex_shader);
 
   CompileShader(vs, "vertex shader", vert_shader);
-  glAttachShader(programs.regular, vs);
-  glAttachShader(programs.subpx, vs);
-
   CompileShader(fs, "default fragment shader", fragment_shader);
-  glAttachShader(programs.regular, fs);
-  glLinkProgram(programs.regular);
-
   CompileShader(subpx_fs, "subpixel fragment shader", subpx_fragment_shader);
-  glAttachShader(programs.subpx, subpx_fs);
-  glLinkProgram(programs.subpx);
 
-  return programs;
+  return {LinkProgram(vs, fs), LinkProgram(vs, subpx_fs)};
 }
\ No newline at end of file
@@ -6,9 +6,21 @@
 #include <string>
 #include <vector>
 
+struct ShaderProgram {
+  GLuint id;
+
+  /* uniform locations, resolved once after linking. -1 if the program does
+   * not use the uniform, which makes setting it a no-op */
+  GLint u_projection_matrix;
+  GLint u_texture_size;
+  GLint u_offset;
+};
+
 struct ShaderPrograms {
-  GLuint regular;
-  GLuint subpx;
+  ShaderProgram regular;
+  ShaderProgram subpx;
 };
 
-ShaderPrograms LoadShaders(void);
\ No newline at end of file
+/* the vertex shader reads Instance records if instanced is true, otherwise
+ * Vertex records */
+ShaderPrograms LoadShaders(bool instanced);
\ No newline at end of file
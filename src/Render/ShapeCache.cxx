@@ -0,0 +1,102 @@
+#include "ShapeCache.hxx"
+#include "../Util/Assert.hxx"
+#include "../Util/Profile.hxx"
+#include <chrono>
+
+#include <hb.h>
+
+ShapeCache::ShapeCache(size_t max_bytes)
+    : max_bytes(max_bytes), bytes(0), stats() {
+  buffer = hb_buffer_create();
+  assume(hb_buffer_allocation_successful(buffer),
+         "harfbuzz failed to create buffer");
+}
+
+ShapeCache::~ShapeCache() { hb_buffer_destroy(buffer); }
+
+const ShapedRun &ShapeCache::Shape(RenderFont &font, std::string_view text,
+                                   uint32_t features) {
+  const Hash key = HashOf(&font, features, text);
+
+  auto found = entries.find(key);
+  if (found != entries.end()) {
+    stats.hits++;
+    lru.splice(lru.begin(), lru, found->second);
+    return found->second->run;
+  }
+
+  stats.misses++;
+  const auto t0 = std::chrono::steady_clock::now();
+  ShapedRun run = ShapeUncached(font, text, features);
+  stats.shaping_time += std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - t0)
+                            .count();
+
+  /* the node of the list and the map, roughly */
+  const size_t entry_bytes = sizeof(Entry) + 4 * sizeof(void *) +
+                             sizeof(Hash) +
+                             run.glyphs.capacity() * sizeof(ShapedGlyph);
+  lru.push_front({key, std::move(run), entry_bytes});
+  entries[key] = lru.begin();
+  bytes += entry_bytes;
+
+  /* the new run is never evicted, so that it can be returned */
+  while (bytes > max_bytes && lru.size() > 1) {
+    const Entry &evicted = lru.back();
+    bytes -= evicted.bytes;
+    entries.erase(evicted.key);
+    lru.pop_back();
+    stats.evictions++;
+  }
+
+  return lru.front().run;
+}
+
+ShapedRun ShapeCache::ShapeUncached(RenderFont &font, std::string_view text,
+                                    uint32_t features) {
+  PROFILE_ZONE("ShapeUncached");
+  ShapedRun run = {{}, 0};
+  hb_font_t *hb_font = font.ShapingFont();
+  if (hb_font == nullptr)
+    return run;
+
+  hb_buffer_clear_contents(buffer);
+  hb_buffer_add_utf8(buffer, text.data(), text.size(), 0, text.size());
+  /* TODO: runs should be split by script and direction */
+  hb_buffer_guess_segment_properties(buffer);
+
+  const bool ligatures = features & kShapeLigatures;
+  const bool kerning = features & kShapeKerning;
+  const hb_feature_t hb_features[] = {
+      {HB_TAG('l', 'i', 'g', 'a'), ligatures, HB_FEATURE_GLOBAL_START,
+       HB_FEATURE_GLOBAL_END},
+      {HB_TAG('c', 'l', 'i', 'g'), ligatures, HB_FEATURE_GLOBAL_START,
+       HB_FEATURE_GLOBAL_END},
+      {HB_TAG('c', 'a', 'l', 't'), ligatures, HB_FEATURE_GLOBAL_START,
+       HB_FEATURE_GLOBAL_END},
+      {HB_TAG('k', 'e', 'r', 'n'), kerning, HB_FEATURE_GLOBAL_START,
+       HB_FEATURE_GLOBAL_END},
+  };
+  hb_shape(hb_font, buffer, hb_features,
+           sizeof(hb_features) / sizeof(hb_features[0]));
+
+  unsigned int len;
+  const hb_glyph_info_t *infos = hb_buffer_get_glyph_infos(buffer, &len);
+  const hb_glyph_position_t *positions =
+      hb_buffer_get_glyph_positions(buffer, &len);
+
+  /* positions are in freetype's 26.6 fixed point, with y pointing up */
+  run.glyphs.reserve(len);
+  float x = 0;
+  float y = 0;
+  for (unsigned int i = 0; i < len; i++) {
+    const hb_glyph_position_t &pos = positions[i];
+    run.glyphs.push_back({(RenderFont::GlyphID)infos[i].codepoint,
+                          infos[i].cluster, x + pos.x_offset / 64.0f,
+                          y - pos.y_offset / 64.0f});
+    x += pos.x_advance / 64.0f;
+    y -= pos.y_advance / 64.0f;
+  }
+  run.advance = x;
+  return run;
+}
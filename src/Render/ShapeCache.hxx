@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../Util/Hash.hxx"
+#include "RenderFont.hxx"
+#include <cstdint>
+#include <list>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/* from hb.h, which is only needed by the implementation */
+struct hb_buffer_t;
+
+/* a glyph of a shaped run, positioned relative to the start of the run in
+ * pixels */
+struct ShapedGlyph {
+  RenderFont::GlyphID glyph_id;
+  /* byte offset of the first character the glyph was shaped from */
+  uint32_t cluster;
+  float x;
+  float y;
+};
+
+struct ShapedRun {
+  std::vector<ShapedGlyph> glyphs;
+  float advance;
+};
+
+/* OpenType features applied while shaping */
+enum ShapeFeatures : uint32_t {
+  kShapeLigatures = 1 << 0,
+  kShapeKerning = 1 << 1,
+  kShapeDefault = kShapeLigatures | kShapeKerning,
+};
+
+/* Shapes runs of UTF-8 text with HarfBuzz, and keeps the shaped runs so that
+ * they are reused across frames, and by every line with the same contents.
+ *
+ * Runs are keyed by a hash of the text, font and features. Once the runs take
+ * up more than max_bytes, the least recently used runs are evicted. */
+struct ShapeCache {
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    /* time spent shaping runs which were not cached, in nanoseconds */
+    double shaping_time;
+  };
+
+  size_t max_bytes;
+  /* estimated memory used by the cached runs */
+  size_t bytes;
+  Stats stats;
+
+  ShapeCache(size_t max_bytes);
+  ShapeCache(ShapeCache const &) = delete;
+  ShapeCache &operator=(ShapeCache const &) = delete;
+  ~ShapeCache();
+
+  /* the returned run is valid until the next call */
+  const ShapedRun &Shape(RenderFont &, std::string_view text,
+                         uint32_t features = kShapeDefault);
+
+private:
+  struct Entry {
+    Hash key;
+    ShapedRun run;
+    size_t bytes;
+  };
+
+  ShapedRun ShapeUncached(RenderFont &, std::string_view text,
+                          uint32_t features);
+
+  /* most recently used first */
+  std::list<Entry> lru;
+  std::unordered_map<Hash, std::list<Entry>::iterator> entries;
+  /* reused for every run, to avoid allocating */
+  hb_buffer_t *buffer;
+};
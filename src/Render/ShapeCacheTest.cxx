@@ -0,0 +1,75 @@
+#include "ShapeCache.hxx"
+#include "../Platform/LocateFont.hxx"
+#include "catch2/catch.hpp"
+
+static std::optional<std::string> LocateTestFont(void) {
+  static bool initialized = LocateFontInit();
+  if (!initialized)
+    return std::nullopt;
+  return LocateFontFile(
+      {"monospace", 12.0, FontFaceProperties::WEIGHT_REGULAR,
+       FontFaceProperties::STRETCH_MEDIUM, FontFaceProperties::SLANT_NORMAL});
+}
+
+TEST_CASE("shape cache", "[ShapeCache]") {
+  std::optional<std::string> path = LocateTestFont();
+  if (!path) {
+    WARN("skipping, could not locate a font");
+    return;
+  }
+
+  /* shaping only needs the face, not the atlas */
+  RenderFont font;
+  font.path = *path;
+  font.pt_size = 12.0;
+  font.subpixel = true;
+  REQUIRE(font.Face() != nullptr);
+
+  ShapeCache shapes(1 << 20);
+
+  SECTION("runs are shaped into glyph indices") {
+    const ShapedRun &run = shapes.Shape(font, "abc");
+    REQUIRE(run.glyphs.size() == 3);
+    float x = 0;
+    for (size_t i = 0; i < 3; i++) {
+      const ShapedGlyph &glyph = run.glyphs[i];
+      REQUIRE(glyph.glyph_id == FT_Get_Char_Index(font.ft_face, "abc"[i]));
+      REQUIRE(glyph.cluster == i);
+      REQUIRE(glyph.x == Approx(x));
+      x += font.Advance(glyph.glyph_id);
+    }
+    REQUIRE(run.advance == Approx(x));
+  }
+
+  SECTION("identical runs are shaped once") {
+    const float advance = shapes.Shape(font, "int main(void) {").advance;
+    REQUIRE(shapes.stats.misses == 1);
+    REQUIRE(shapes.Shape(font, "int main(void) {").advance == advance);
+    REQUIRE(shapes.Shape(font, "int main(void) {").advance == advance);
+    REQUIRE(shapes.stats.hits == 2);
+    REQUIRE(shapes.stats.shaping_time > 0);
+
+    /* different features are shaped separately */
+    shapes.Shape(font, "int main(void) {", kShapeKerning);
+    REQUIRE(shapes.stats.misses == 2);
+  }
+
+  SECTION("memory is bounded") {
+    shapes.Shape(font, "line 0");
+    const size_t run_bytes = shapes.bytes;
+    shapes.max_bytes = run_bytes * 4;
+
+    for (int i = 1; i < 100; i++) {
+      shapes.Shape(font, "line " + std::to_string(i));
+      REQUIRE(shapes.bytes <= shapes.max_bytes);
+    }
+    REQUIRE(shapes.stats.evictions >= 90);
+
+    /* the most recently used runs are kept */
+    const uint64_t misses = shapes.stats.misses;
+    shapes.Shape(font, "line 99");
+    REQUIRE(shapes.stats.misses == misses);
+    shapes.Shape(font, "line 0");
+    REQUIRE(shapes.stats.misses == misses + 1);
+  }
+}
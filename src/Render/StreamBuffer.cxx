@@ -0,0 +1,164 @@
+#include "StreamBuffer.hxx"
+#include "../Util/Assert.hxx"
+#include <cassert>
+#include <cstring>
+
+#define GL_GLEXT_PROTOTYPES
+#include "SDL_opengl.h"
+#include "SDL_opengl_glext.h"
+
+/* glBufferStorage is GL 4.4, so it has to be looked up at runtime to avoid
+ * failing to link against implementations which don't export it */
+static PFNGLBUFFERSTORAGEPROC BufferStorage = nullptr;
+
+/* nanoseconds to wait on a fence before giving up and checking again */
+constexpr GLuint64 kFenceTimeout = 1000 * 1000 * 1000;
+
+static void WaitForFence(GLsync fence) {
+  while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout) ==
+         GL_TIMEOUT_EXPIRED)
+    ;
+}
+
+void StreamBuffer::Init(GLenum buffer_target, size_t size,
+                        bool use_buffer_storage) {
+  target = buffer_target;
+  segment_size = size;
+
+  if (use_buffer_storage && BufferStorage == nullptr) {
+    BufferStorage =
+        (PFNGLBUFFERSTORAGEPROC)SDL_GL_GetProcAddress("glBufferStorage");
+  }
+  persistent = use_buffer_storage && BufferStorage != nullptr;
+
+  if (!persistent) {
+    staging.resize(segment_size);
+  }
+
+  Allocate();
+}
+
+void StreamBuffer::Allocate(void) {
+  const GLsizeiptr total_size = segment_size * kNumSegments;
+
+  glGenBuffers(1, &id);
+  glBindBuffer(target, id);
+
+  if (persistent) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    BufferStorage(target, total_size, nullptr, flags);
+    mapped = (uint8_t *)glMapBufferRange(target, 0, total_size, flags);
+    assume(mapped != nullptr, "could not persistently map stream buffer");
+  } else {
+    glBufferData(target, total_size, nullptr, GL_STREAM_DRAW);
+  }
+}
+
+void StreamBuffer::WaitForSegment(void) {
+  GLsync &fence = fences[segment];
+  if (fence != nullptr) {
+    WaitForFence(fence);
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+}
+
+void StreamBuffer::ClearFences(void) {
+  for (GLsync &fence : fences) {
+    if (fence != nullptr) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+}
+
+void StreamBuffer::Begin(void) {
+  assert(!active);
+  active = true;
+  used = 0;
+
+  /* the staging buffer is only copied into the segment on End, so there is no
+   * need to wait until then */
+  if (persistent) {
+    WaitForSegment();
+  }
+}
+
+void StreamBuffer::End(void) {
+  if (!active)
+    return;
+  active = false;
+
+  /* persistent mappings are coherent, so writes are already visible */
+  if (persistent || used == 0)
+    return;
+
+  if (realloc_pending) {
+    /* the old buffer is only freed once the GPU is done with it */
+    glDeleteBuffers(1, &id);
+    ClearFences();
+    segment = 0;
+    Allocate();
+    realloc_pending = false;
+  }
+
+  WaitForSegment();
+  glBindBuffer(target, id);
+  /* the fence guarantees the GPU is no longer reading this segment, so there
+   * is no need for the driver to synchronize */
+  void *dst = glMapBufferRange(target, SegmentOffset(), used,
+                               GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                   GL_MAP_INVALIDATE_RANGE_BIT);
+  assume(dst != nullptr, "could not map stream buffer segment");
+  memcpy(dst, staging.data(), used);
+  glUnmapBuffer(target);
+}
+
+void StreamBuffer::Fence(void) {
+  assert(!active);
+  assert(fences[segment] == nullptr);
+  fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  segment = (segment + 1) % kNumSegments;
+  used = 0;
+}
+
+void StreamBuffer::Grow(size_t min_segment_size) {
+  while (segment_size < min_segment_size) {
+    segment_size *= 2;
+  }
+
+  if (!persistent) {
+    /* nothing has been written to the GPU buffer yet this frame, so it can be
+     * replaced on End */
+    staging.resize(segment_size);
+    realloc_pending = true;
+    return;
+  }
+
+  GLuint old_id = id;
+  size_t old_offset = SegmentOffset();
+  glBindBuffer(target, old_id);
+  glUnmapBuffer(target);
+
+  /* the old buffer is only freed once the GPU is done with it, so the fences
+   * for the other segments are no longer needed */
+  ClearFences();
+  segment = 0;
+  Allocate();
+
+  /* move the data written this frame into the first segment of the new buffer
+   */
+  glBindBuffer(GL_COPY_READ_BUFFER, old_id);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, old_offset, 0,
+                      used);
+  glDeleteBuffers(1, &old_id);
+
+  /* the copy must land before the CPU continues writing into the copied range,
+   * otherwise it could overwrite the new writes. Growing is rare, so stalling
+   * here is fine */
+  GLsync copy_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  WaitForFence(copy_fence);
+  glDeleteSync(copy_fence);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "SDL.h"
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+#define GL_GLEXT_PROTOTYPES
+#include "SDL_opengl.h"
+
+/* GPU buffer used for data that is rewritten every frame.
+ *
+ * The buffer is split into kNumSegments segments which are used as a ring, so
+ * that the CPU can write the next frame while the GPU still reads from the
+ * previous ones. Each segment is protected by a fence which is waited on before
+ * the segment is reused, which means no orphaning or implicit synchronization
+ * by the driver is needed.
+ *
+ * When GL_ARB_buffer_storage is available, the buffer is persistently mapped
+ * once and written directly. Otherwise the frame is written into a staging
+ * buffer, which is copied into the segment on End by mapping it with
+ * glMapBufferRange using unsynchronized writes, which is safe since the fence
+ * guarantees the GPU is done with it.
+ *
+ * If a frame does not fit into a segment, the buffer is grown, and the data
+ * written so far this frame keeps its offset relative to the segment start.
+ * Offsets therefore remain valid across calls to Reserve, but pointers do
+ * not. */
+struct StreamBuffer {
+  static constexpr uint kNumSegments = 3;
+
+  GLenum target;
+  GLuint id;
+  bool persistent;
+
+  size_t segment_size;
+  uint segment;
+  /* number of bytes written into the current segment */
+  size_t used;
+  /* true between Begin and End */
+  bool active;
+
+  /* start of the whole buffer, only used when persistent */
+  uint8_t *mapped;
+  /* contents of the current segment, only used when not persistent */
+  std::vector<uint8_t> staging;
+  /* the GPU buffer is smaller than segment_size, only used when not persistent
+   */
+  bool realloc_pending;
+
+  GLsync fences[kNumSegments];
+
+  StreamBuffer()
+      : target(0), id(0), persistent(false), segment_size(0), segment(0),
+        used(0), active(false), mapped(nullptr), realloc_pending(false),
+        fences(){};
+  StreamBuffer(StreamBuffer const &) = delete;
+  StreamBuffer &operator=(StreamBuffer const &) = delete;
+
+  /* persistent mapping is only used if GL_ARB_buffer_storage is supported */
+  void Init(GLenum target, size_t segment_size, bool use_buffer_storage);
+
+  /* offset of the current segment from the start of the buffer, used for draw
+   * call offsets */
+  size_t SegmentOffset(void) const { return segment * segment_size; }
+
+  /* returns a pointer to the data at offset into the current segment, valid
+   * until the next call to Reserve */
+  inline uint8_t *At(size_t offset) {
+    if (persistent) {
+      return mapped + SegmentOffset() + offset;
+    } else {
+      return staging.data() + offset;
+    }
+  }
+
+  /* returns a pointer to len writable bytes, valid until the next call to
+   * Reserve, the offset of the region in the segment is used - len afterwards
+   */
+  inline uint8_t *Reserve(size_t len) {
+    if (!active)
+      Begin();
+    if (used + len > segment_size)
+      Grow(used + len);
+
+    uint8_t *region = At(used);
+    used += len;
+    return region;
+  }
+
+  /* starts writing into the current segment, waiting for the GPU to release it
+   * if needed. Called by Reserve if needed */
+  void Begin(void);
+  /* makes the written data visible to the GPU, must be called before issuing
+   * draw calls which use the current segment */
+  void End(void);
+  /* fences the current segment and advances to the next one, must be called
+   * after all draw calls using the current segment are issued */
+  void Fence(void);
+
+private:
+  void Grow(size_t min_segment_size);
+  void Allocate(void);
+  void WaitForSegment(void);
+  void ClearFences(void);
+};
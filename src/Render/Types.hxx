@@ -45,6 +45,34 @@ struct Point {
 struct Rect {
   int x, y, w, h;
   Point top_left() const { return {x, y}; };
+  bool empty() const { return w <= 0 || h <= 0; };
+
+  /* smallest rect containing both rects, empty rects are ignored */
+  Rect united(const Rect &o) const {
+    if (empty())
+      return o;
+    if (o.empty())
+      return *this;
+    const int x0 = x < o.x ? x : o.x;
+    const int y0 = y < o.y ? y : o.y;
+    const int x1 = x + w > o.x + o.w ? x + w : o.x + o.w;
+    const int y1 = y + h > o.y + o.h ? y + h : o.y + o.h;
+    return {x0, y0, x1 - x0, y1 - y0};
+  };
+
+  Rect intersected(const Rect &o) const {
+    const int x0 = x > o.x ? x : o.x;
+    const int y0 = y > o.y ? y : o.y;
+    const int x1 = x + w < o.x + o.w ? x + w : o.x + o.w;
+    const int y1 = y + h < o.y + o.h ? y + h : o.y + o.h;
+    return {x0, y0, x1 - x0, y1 - y0};
+  };
+
+  /* empty rects are contained in every rect */
+  bool contains(const Rect &o) const {
+    return o.empty() || (!empty() && o.x >= x && o.y >= y &&
+                         o.x + o.w <= x + w && o.y + o.h <= y + h);
+  };
 };
 
 struct Color {
@@ -63,9 +91,11 @@ constexpr Color RGB(uint32_t lit) {
   return {(uint8_t)(lit >> 16), (uint8_t)(lit >> 8), (uint8_t)(lit), 255};
 }
 
+/* a 2D texture array, where every page has the same size */
 struct GPUTexture {
   GLuint id;
   vec2<uint> size;
+  uint pages;
   enum class Format { kRGB, kRGBA, kGrayscale } format;
 };
 
@@ -39,41 +39,79 @@ template <typename T> static GLenum ToGLTypeEnum(T x) {
   }
 }
 
-void BindVBOAttribs(void) {
-#define ATTR(attr_name, attr_type, attr_normalized)                            \
-  glEnableVertexAttribArray((GLuint)Vertex::Attribute::k##attr_name);
-  VERTEX_FORMAT
-#undef ATTR
+template <typename T>
+static void BindAttrib(GLuint idx, T x, AttribKind kind, GLsizei stride,
+                       size_t offset, GLuint divisor) {
+  glEnableVertexAttribArray(idx);
+  if (kind == AttribKind::kInteger) {
+    glVertexAttribIPointer(idx, GetNumComponents(x), ToGLTypeEnum(x), stride,
+                           (void *)offset);
+  } else {
+    glVertexAttribPointer(idx, GetNumComponents(x), ToGLTypeEnum(x),
+                          kind == AttribKind::kNormalized, stride,
+                          (void *)offset);
+  }
+  glVertexAttribDivisor(idx, divisor);
+}
 
+void BindVBOAttribs(size_t offset) {
   Vertex v;
-#define ATTR(attr_name, attr_type, attr_normalized)                            \
-  glVertexAttribPointer((GLuint)Vertex::Attribute::k##attr_name,               \
-                        GetNumComponents(v.attr_name),                         \
-                        ToGLTypeEnum(v.attr_name), attr_normalized,            \
-                        sizeof(Vertex), (void *)offsetof(Vertex, attr_name));
+#define ATTR(attr_name, attr_type, attr_kind)                                  \
+  BindAttrib((GLuint)Vertex::Attribute::k##attr_name, v.attr_name,             \
+             AttribKind::attr_kind, sizeof(Vertex),                            \
+             offset + offsetof(Vertex, attr_name), 0);
   VERTEX_FORMAT
 #undef ATTR
 }
 
-template <typename T> static std::string ToGLSLType(T x) {
+void BindInstanceAttribs(size_t offset) {
+  Instance i;
+#define ATTR(attr_name, attr_type, attr_kind)                                  \
+  BindAttrib((GLuint)Instance::Attribute::k##attr_name, i.attr_name,           \
+             AttribKind::attr_kind, sizeof(Instance),                          \
+             offset + offsetof(Instance, attr_name), 1);
+  INSTANCE_FORMAT
+#undef ATTR
+}
+
+template <typename T> static std::string ToGLSLType(T x, AttribKind kind) {
   if constexpr (std::is_integral<T>::value ||
                 std::is_floating_point<T>::value) {
+    if (kind == AttribKind::kInteger) {
+      return std::is_signed<T>::value ? "int" : "uint";
+    }
     return "float";
   } else {
-    return "vec" + std::to_string(GetNumComponents(x));
+    std::string prefix;
+    if (kind == AttribKind::kInteger) {
+      prefix = std::is_signed<typename T::value_type>::value ? "i" : "u";
+    }
+    return prefix + "vec" + std::to_string(GetNumComponents(x));
   }
 }
 
-std::string GenerateVertexShaderHeader(void) {
+std::string GenerateVertexShaderHeader(bool instanced) {
   std::string header;
-  Vertex v;
 
-#define ATTR(attr_name, attr_type, attr_normalized)                            \
+  if (instanced) {
+    Instance i;
+#define ATTR(attr_name, attr_type, attr_kind)                                  \
+  header += "layout(location = " +                                             \
+            std::to_string((uint)Instance::Attribute::k##attr_name) +          \
+            ") in " + ToGLSLType(i.attr_name, AttribKind::attr_kind) + " " +   \
+            #attr_name + ";\n";
+    INSTANCE_FORMAT
+#undef ATTR
+  } else {
+    Vertex v;
+#define ATTR(attr_name, attr_type, attr_kind)                                  \
   header += "layout(location = " +                                             \
             std::to_string((uint)Vertex::Attribute::k##attr_name) + ") in " +  \
-            ToGLSLType(v.attr_name) + " " + #attr_name + ";\n";
-  VERTEX_FORMAT
+            ToGLSLType(v.attr_name, AttribKind::attr_kind) + " " +             \
+            #attr_name + ";\n";
+    VERTEX_FORMAT
 #undef ATTR
+  }
 
   return header;
-}
\ No newline at end of file
+}
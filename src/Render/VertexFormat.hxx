@@ -3,22 +3,65 @@
 #include "Types.hxx"
 #include <string>
 
+/* how an attribute is read in the shader */
+enum class AttribKind {
+  /* converted to float */
+  kFloat,
+  /* converted to float and normalized to [0, 1] or [-1, 1] */
+  kNormalized,
+  /* read as an integer */
+  kInteger
+};
+
 #define VERTEX_FORMAT                                                          \
-  /* name, type, normalize in shader */                                        \
-  ATTR(screen_coord, vec2<int16_t>, false)                                     \
-  ATTR(texture_coord, vec2<uint16_t>, false)                                   \
-  ATTR(color, vec4<uint8_t>, true)                                             \
-  ATTR(depth, uint8_t, true)
+  /* name, type, kind */                                                       \
+  ATTR(screen_coord, vec2<int16_t>, kFloat)                                    \
+  ATTR(texture_coord, vec2<uint16_t>, kFloat)                                  \
+  ATTR(color, vec4<uint8_t>, kNormalized)                                      \
+  ATTR(depth, uint8_t, kNormalized)                                            \
+  ATTR(page, uint8_t, kFloat)
+
+/* a single record per quad, expanded into the 4 corners of the quad by the
+ * instanced vertex shader
+ * size_page_depth packs the width and height of the quad as 10 bits each in
+ * the low 20 bits, the texture page in the next 4 bits, and the depth in the
+ * high 8 bits */
+#define INSTANCE_FORMAT                                                        \
+  /* name, type, kind */                                                       \
+  ATTR(dst_pos, vec2<int16_t>, kFloat)                                         \
+  ATTR(src_pos, vec2<uint16_t>, kFloat)                                        \
+  ATTR(size_page_depth, uint32_t, kInteger)                                    \
+  ATTR(color, vec4<uint8_t>, kNormalized)
 
 struct Vertex {
-#define ATTR(attr_name, attr_type, attr_normalized) attr_type attr_name;
+#define ATTR(attr_name, attr_type, attr_kind) attr_type attr_name;
   VERTEX_FORMAT
 #undef ATTR
 
-#define ATTR(attr_name, attr_type, attr_normalized) k##attr_name,
+#define ATTR(attr_name, attr_type, attr_kind) k##attr_name,
   enum class Attribute { VERTEX_FORMAT };
 #undef ATTR
 };
 
-void BindVBOAttribs(void);
-std::string GenerateVertexShaderHeader(void);
\ No newline at end of file
+struct Instance {
+  /* maximum width or height of an instance */
+  static constexpr uint kMaxExtent = (1 << 10) - 1;
+  /* number of texture pages which can be addressed */
+  static constexpr uint kMaxPages = 1 << 4;
+
+#define ATTR(attr_name, attr_type, attr_kind) attr_type attr_name;
+  INSTANCE_FORMAT
+#undef ATTR
+
+#define ATTR(attr_name, attr_type, attr_kind) k##attr_name,
+  enum class Attribute { INSTANCE_FORMAT };
+#undef ATTR
+};
+
+/* offset is the byte offset of the first vertex in the bound VBO */
+void BindVBOAttribs(size_t offset);
+/* offset is the byte offset of the first instance in the bound VBO */
+void BindInstanceAttribs(size_t offset);
+/* declares the attributes of the instance format if instanced is true,
+ * otherwise of the vertex format */
+std::string GenerateVertexShaderHeader(bool instanced);
@@ -0,0 +1,207 @@
+#include "Highlighter.hxx"
+#include "../TextBuffer/LineReader.hxx"
+#include "../Util/Profile.hxx"
+#include <algorithm>
+#include <chrono>
+
+Highlighter::Highlighter()
+    : stopping(false), epoch(0), dirty_begin(kClean), dirty_end(0), version(0),
+      stats{0, 0} {}
+
+Highlighter::~Highlighter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_available.notify_all();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void Highlighter::Start(void) {
+  worker = std::thread(&Highlighter::Work, this);
+}
+
+void Highlighter::Update(TextBuffer &buffer) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spans && buffer.epoch == epoch)
+      return;
+
+    /* edits are only replayed if none of them were dropped from the log */
+    const std::vector<TextBuffer::Edit> &edits = buffer.edits;
+    const bool replay =
+        spans && !edits.empty() && edits.front().epoch <= epoch + 1;
+    if (!replay) {
+      line_states.assign(buffer.num_lines + 1, kLexNormal);
+      dirty_begin = 0;
+      dirty_end = line_states.size();
+    }
+
+    for (const TextBuffer::Edit &edit : edits) {
+      if (!replay || edit.epoch <= epoch)
+        continue;
+
+      /* the state at the start of the changed line stays the same, the states
+       * after it are lexed again */
+      const size_t line = edit.line;
+      const auto after = line_states.begin() + line + 1;
+      if (edit.lines_added > 0) {
+        line_states.insert(after, edit.lines_added, kLexNormal);
+      } else if (edit.lines_added < 0) {
+        line_states.erase(after, after - edit.lines_added);
+      }
+
+      const size_t changed_end =
+          line + 1 + std::max<ptrdiff_t>(edit.lines_added, 0);
+      if (dirty_begin == kClean) {
+        dirty_begin = line;
+        dirty_end = changed_end;
+      } else {
+        if (dirty_end > line) {
+          dirty_end = std::max<ptrdiff_t>(dirty_end + edit.lines_added,
+                                          line + 1);
+        }
+        dirty_begin = std::min(dirty_begin, line);
+        dirty_end = std::max(dirty_end, changed_end);
+      }
+    }
+
+    epoch = buffer.epoch;
+    spans = buffer.SpansSnapshot();
+    version++;
+  }
+  work_available.notify_one();
+}
+
+bool Highlighter::Lex(size_t max_lines) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (dirty_begin == kClean)
+    return true;
+
+  /* the lines are lexed without holding the lock, and the result is thrown
+   * away if the buffer changed or another thread lexed them first */
+  const size_t begin = dirty_begin;
+  const size_t end = dirty_end;
+  const size_t lexed_epoch = epoch;
+  const size_t num_lines = line_states.size();
+  const size_t count = std::min(max_lines, num_lines - begin);
+  const std::shared_ptr<const std::vector<TextBuffer::Span>> snapshot = spans;
+  const std::vector<LexState> previous(
+      line_states.begin() + begin + 1,
+      line_states.begin() + std::min(begin + count + 1, num_lines));
+  LexState state = line_states[begin];
+  lock.unlock();
+
+  PROFILE_ZONE("Highlighter::Lex");
+  const auto t0 = std::chrono::steady_clock::now();
+  LineReader reader(*snapshot, begin);
+  std::string line;
+  std::vector<LexState> lexed;
+  bool converged = false;
+  for (size_t i = begin; i < begin + count; i++) {
+    reader.Next(line);
+    state = LexLine(state, line, nullptr);
+    if (i + 1 == num_lines ||
+        (i + 1 >= end && state == previous[i - begin])) {
+      converged = true;
+      break;
+    }
+    lexed.push_back(state);
+  }
+  const double lexing_time = std::chrono::duration<double, std::nano>(
+                                 std::chrono::steady_clock::now() - t0)
+                                 .count();
+
+  lock.lock();
+  stats.lexing_time += lexing_time;
+  if (epoch != lexed_epoch || dirty_begin != begin)
+    return false;
+
+  std::copy(lexed.begin(), lexed.end(), line_states.begin() + begin + 1);
+  stats.lines_lexed += lexed.size() + converged;
+  dirty_begin = converged ? kClean : begin + lexed.size();
+  version++;
+  return converged;
+}
+
+bool Highlighter::LineState(size_t line, LexState *state) {
+  while (true) {
+    size_t behind;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (line >= line_states.size())
+        return false;
+      if (dirty_begin == kClean || line <= dirty_begin) {
+        *state = line_states[line];
+        return true;
+      }
+      behind = line - dirty_begin;
+    }
+    if (behind > kMaxSyncLines)
+      return false;
+    Lex(behind);
+  }
+}
+
+bool Highlighter::LineTokens(size_t line, size_t max_len,
+                             std::vector<Token> &tokens, Arena &scratch) {
+  tokens.clear();
+  LexState state;
+  if (!LineState(line, &state))
+    return false;
+
+  std::shared_ptr<const std::vector<TextBuffer::Span>> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    snapshot = spans;
+  }
+  ArenaString text(scratch);
+  LineReader(*snapshot, line).Next(text, max_len);
+  LexLine(state, text, &tokens);
+  return true;
+}
+
+bool Highlighter::UpToDateStates(size_t buffer_epoch,
+                                 std::vector<LexState> &states) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!spans || buffer_epoch != epoch)
+    return false;
+
+  /* the state at the start of dirty_begin is known, the ones after are not */
+  const size_t known = dirty_begin == kClean ? line_states.size()
+                                             : dirty_begin + 1;
+  states.assign(line_states.begin(), line_states.begin() + known);
+  return true;
+}
+
+bool Highlighter::UpToDate(void) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return dirty_begin == kClean;
+}
+
+uint64_t Highlighter::Version(void) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return version;
+}
+
+Highlighter::Stats Highlighter::GetStats(void) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
+
+void Highlighter::Work(void) {
+  PROFILE_THREAD_NAME("highlighter");
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    work_available.wait(lock,
+                        [&] { return stopping || dirty_begin != kClean; });
+    if (stopping)
+      break;
+
+    lock.unlock();
+    Lex(kLinesPerStep);
+    lock.lock();
+  }
+}
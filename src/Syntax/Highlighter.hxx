@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../TextBuffer/TextBuffer.hxx"
+#include "../Util/Arena.hxx"
+#include "Lexer.hxx"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Keeps the lexer state at the start of every line of a TextBuffer up to date,
+ * so that any line can be lexed on its own when it is drawn.
+ *
+ * After an edit, lines are lexed again from the first changed line until the
+ * state at the start of a line after the changed ones is the same as before,
+ * as every following line lexes the same from there on. Lexing runs on a
+ * worker thread against a snapshot of the spans of the buffer, which stays
+ * valid since the contents of spans are never modified or moved. Lines close
+ * to the ones the worker reached are lexed on the calling thread when asked
+ * for, so that the lines being edited don't wait for the worker */
+struct Highlighter {
+  struct Stats {
+    uint64_t lines_lexed;
+    /* time spent lexing, on every thread, in nanoseconds */
+    double lexing_time;
+  };
+
+  /* lines lexed by the worker before it checks for new edits */
+  static constexpr size_t kLinesPerStep = 1024;
+  /* lines LineState lexes on the calling thread at most */
+  static constexpr size_t kMaxSyncLines = 512;
+
+  Highlighter();
+  Highlighter(Highlighter const &) = delete;
+  Highlighter &operator=(Highlighter const &) = delete;
+  ~Highlighter();
+
+  /* starts the worker thread, without it lines are only lexed by LineState
+   * and Lex */
+  void Start(void);
+
+  /* takes the edits made to buffer since the previous call into account.
+   * Called on the thread which edits the buffer */
+  void Update(TextBuffer &buffer);
+
+  /* sets state to the state at the start of line and returns true, unless
+   * the line is further than kMaxSyncLines behind the lines which are up to
+   * date */
+  bool LineState(size_t line, LexState *state);
+  /* lexes up to the first max_len bytes of line into tokens, returns false if
+   * the state at its start is not known yet. The text of the line is read
+   * into scratch */
+  bool LineTokens(size_t line, size_t max_len, std::vector<Token> &tokens,
+                  Arena &scratch);
+  /* copies the states at the start of the lines which are up to date, from
+   * the first line on, into states. Returns false if the states are not for
+   * the buffer at epoch */
+  bool UpToDateStates(size_t epoch, std::vector<LexState> &states);
+
+  /* lexes up to max_lines lines which are out of date, returns true once
+   * every line is up to date */
+  bool Lex(size_t max_lines);
+
+  bool UpToDate(void);
+  /* changes whenever the state of any line changes */
+  uint64_t Version(void);
+  Stats GetStats(void);
+
+private:
+  static constexpr size_t kClean = SIZE_MAX;
+
+  void Work(void);
+
+  std::mutex mutex;
+  std::condition_variable work_available;
+  bool stopping;
+  std::thread worker;
+
+  /* epoch of the buffer the states are for, and its spans at that epoch */
+  size_t epoch;
+  std::shared_ptr<const std::vector<TextBuffer::Span>> spans;
+
+  /* state at the start of every line */
+  std::vector<LexState> line_states;
+  /* Lines from dirty_begin on are out of date. They are lexed at least up to
+   * dirty_end, then until the states are the same as before. dirty_begin is
+   * kClean if every line is up to date */
+  size_t dirty_begin;
+  size_t dirty_end;
+
+  uint64_t version;
+  Stats stats;
+};
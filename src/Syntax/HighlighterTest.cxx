@@ -0,0 +1,164 @@
+#include "Highlighter.hxx"
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <thread>
+
+/* states at the start of every line, lexed from scratch */
+static std::vector<LexState> ReferenceStates(TextBuffer &tb) {
+  std::string text(tb.begin(), tb.end());
+  std::vector<LexState> states = {kLexNormal};
+  std::istringstream lines(text);
+  std::string line;
+  for (size_t i = 0; i < tb.num_lines; i++) {
+    std::getline(lines, line);
+    states.push_back(LexLine(states.back(), line, nullptr));
+  }
+  return states;
+}
+
+static std::vector<LexState> States(Highlighter &highlighter, size_t lines) {
+  std::vector<LexState> states(lines);
+  for (size_t i = 0; i < lines; i++) {
+    REQUIRE(highlighter.LineState(i, &states[i]));
+  }
+  return states;
+}
+
+static void Insert(TextBuffer &tb, size_t line, size_t col,
+                   std::string_view text) {
+  tb.InsertAt(tb.AtLineCol(line, col), text.begin(), text.end());
+}
+
+/* generates a C++ source file with a block comment every few functions */
+static std::string GenerateSource(size_t num_lines) {
+  std::string source;
+  for (size_t i = 0; source.size() < num_lines * 24 || i % 8 != 0; i++) {
+    if (i % 16 == 0) {
+      source += "/* helpers for the\n   values below */\n";
+    }
+    source += "static int Value" + std::to_string(i) + "(int x) {\n";
+    source += "  return x * " + std::to_string(i) + "; // scaled\n";
+    source += "}\n\n";
+  }
+  return source;
+}
+
+TEST_CASE("highlighter", "[Highlighter]") {
+  TextBuffer tb;
+  const std::string source = GenerateSource(1000);
+  tb.InsertAt(tb.AtByteOffset(0), source.begin(), source.end());
+
+  Highlighter highlighter;
+  highlighter.Update(tb);
+  REQUIRE(!highlighter.UpToDate());
+  REQUIRE(highlighter.Lex(SIZE_MAX));
+  REQUIRE(States(highlighter, tb.num_lines + 1) == ReferenceStates(tb));
+
+  SECTION("edits which do not change any state converge immediately") {
+    const uint64_t lexed = highlighter.GetStats().lines_lexed;
+    Insert(tb, 500, 2, "x");
+    highlighter.Update(tb);
+    REQUIRE(highlighter.Lex(SIZE_MAX));
+    REQUIRE(highlighter.GetStats().lines_lexed - lexed == 1);
+  }
+
+  SECTION("opening a comment lexes until it is closed") {
+    Insert(tb, 2, 0, "/*\n");
+    highlighter.Update(tb);
+
+    /* lines close to the up to date ones are lexed when asked for */
+    LexState state;
+    REQUIRE(highlighter.LineState(4, &state));
+    REQUIRE(state == kLexBlockComment);
+    REQUIRE(highlighter.Lex(SIZE_MAX));
+    REQUIRE(States(highlighter, tb.num_lines + 1) == ReferenceStates(tb));
+  }
+
+  SECTION("random edits") {
+    std::mt19937 rng(3);
+    const std::string_view snippets[] = {"/*", "*/", "\n", "\"", "//", "x\n",
+                                         "#define A \\\n", "\\"};
+    for (int i = 0; i < 200; i++) {
+      /* several edits between updates, like a frame with fast typing */
+      for (int j = 0; j < 1 + i % 3; j++) {
+        const size_t line = rng() % (tb.num_lines + 1);
+        const std::string_view snippet = snippets[rng() % 8];
+        Insert(tb, line, 0, snippet);
+      }
+      highlighter.Update(tb);
+      REQUIRE(highlighter.Lex(SIZE_MAX));
+      REQUIRE(States(highlighter, tb.num_lines + 1) == ReferenceStates(tb));
+    }
+  }
+
+  SECTION("the edit log was truncated") {
+    for (size_t i = 0; i < TextBuffer::kMaxEdits + 1; i++) {
+      Insert(tb, 0, 0, "/");
+    }
+    highlighter.Update(tb);
+    REQUIRE(highlighter.Lex(SIZE_MAX));
+    REQUIRE(States(highlighter, tb.num_lines + 1) == ReferenceStates(tb));
+  }
+}
+
+TEST_CASE("highlighter worker", "[Highlighter]") {
+  TextBuffer tb;
+  const std::string source = GenerateSource(20000);
+  tb.InsertAt(tb.AtByteOffset(0), source.begin(), source.end());
+
+  Highlighter highlighter;
+  highlighter.Start();
+  highlighter.Update(tb);
+
+  /* the beginning is lexed on this thread if needed, while the worker lexes
+   * the rest */
+  LexState state;
+  REQUIRE(highlighter.LineState(Highlighter::kMaxSyncLines, &state));
+
+  for (int i = 0; i < 20; i++) {
+    Insert(tb, 100 + i * 700, 0, i % 2 ? "*/" : "/*");
+    highlighter.Update(tb);
+  }
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!highlighter.UpToDate() &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  REQUIRE(highlighter.UpToDate());
+  REQUIRE(States(highlighter, tb.num_lines + 1) == ReferenceStates(tb));
+}
+
+TEST_CASE("highlighter performance", "[Highlighter]") {
+  TextBuffer tb;
+  const std::string source = GenerateSource(100000);
+  tb.InsertAt(tb.AtByteOffset(0), source.begin(), source.end());
+  const size_t middle = tb.num_lines / 2;
+
+  BENCHMARK("lex 100k lines") {
+    Highlighter highlighter;
+    highlighter.Update(tb);
+    return highlighter.Lex(SIZE_MAX);
+  };
+
+  Highlighter highlighter;
+  highlighter.Update(tb);
+  highlighter.Lex(SIZE_MAX);
+
+  /* from the edit until every line is up to date again */
+  BENCHMARK("single character edit in the middle of 100k lines") {
+    Insert(tb, middle, 2, "x");
+    highlighter.Update(tb);
+    return highlighter.Lex(SIZE_MAX);
+  };
+
+  BENCHMARK("opening a comment in the middle of 100k lines") {
+    Insert(tb, middle, 0, "/*");
+    highlighter.Update(tb);
+    return highlighter.Lex(SIZE_MAX);
+  };
+}
@@ -0,0 +1,195 @@
+#include "Lexer.hxx"
+#include <algorithm>
+#include <iterator>
+
+/* sorted, so that they can be binary searched */
+static constexpr std::string_view kKeywords[] = {
+    "alignas", "alignof", "asm", "break", "case", "catch", "class", "co_await",
+    "co_return", "co_yield", "concept", "const", "const_cast", "consteval",
+    "constexpr", "constinit", "continue", "decltype", "default", "delete", "do",
+    "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false",
+    "final", "for", "friend", "goto", "if", "import", "inline", "module",
+    "mutable", "namespace", "new", "noexcept", "nullptr", "operator",
+    "override", "private", "protected", "public", "register",
+    "reinterpret_cast", "requires", "return", "sizeof", "static",
+    "static_assert", "static_cast", "struct", "switch", "template", "this",
+    "thread_local", "throw", "true", "try", "typedef", "typeid", "typename",
+    "union", "using", "virtual", "volatile", "while"};
+
+static constexpr std::string_view kTypes[] = {
+    "auto", "bool", "char", "char16_t", "char32_t", "char8_t", "double",
+    "float", "int", "int16_t", "int32_t", "int64_t", "int8_t", "intptr_t",
+    "long", "nullptr_t", "ptrdiff_t", "short", "signed", "size_t", "ssize_t",
+    "uint", "uint16_t", "uint32_t", "uint64_t", "uint8_t", "uintptr_t",
+    "unsigned", "void", "wchar_t"};
+
+static_assert(std::is_sorted(std::begin(kKeywords), std::end(kKeywords)));
+static_assert(std::is_sorted(std::begin(kTypes), std::end(kTypes)));
+
+static TokenKind IdentifierKind(std::string_view identifier) {
+  if (std::binary_search(std::begin(kKeywords), std::end(kKeywords),
+                         identifier))
+    return kTokenKeyword;
+  if (std::binary_search(std::begin(kTypes), std::end(kTypes), identifier))
+    return kTokenType;
+  return kTokenDefault;
+}
+
+static bool IsDigit(uint8_t c) { return c >= '0' && c <= '9'; }
+
+/* non-ASCII bytes are treated as part of identifiers */
+static bool IsIdentifierStart(uint8_t c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+         c >= 0x80;
+}
+
+static bool IsIdentifier(uint8_t c) {
+  return IsIdentifierStart(c) || IsDigit(c);
+}
+
+/* returns the offset after the closing quote, or the length of the line if
+ * the literal is not terminated on this line */
+static size_t SkipQuoted(std::string_view line, size_t i, char quote,
+                         bool *terminated) {
+  while (i < line.size()) {
+    if (line[i] == '\\') {
+      i += 2;
+    } else if (line[i] == quote) {
+      *terminated = true;
+      return i + 1;
+    } else {
+      i++;
+    }
+  }
+  *terminated = false;
+  return line.size();
+}
+
+static bool CommentStartsAt(std::string_view line, size_t i) {
+  return line[i] == '/' && i + 1 < line.size() &&
+         (line[i + 1] == '/' || line[i + 1] == '*');
+}
+
+LexState LexLine(LexState state, std::string_view line,
+                 std::vector<Token> *tokens) {
+  const size_t len = line.size();
+  const bool continued = len > 0 && line[len - 1] == '\\';
+  size_t i = 0;
+
+  auto emit = [&](size_t start, TokenKind kind) {
+    if (tokens != nullptr && i > start) {
+      tokens->push_back({start, i - start, kind});
+    }
+  };
+
+  bool directive = false;
+  switch (state) {
+  case kLexNormal:
+    break;
+  case kLexBlockComment: {
+    const size_t end = line.find("*/");
+    i = end == std::string_view::npos ? len : end + 2;
+    emit(0, kTokenComment);
+    if (end == std::string_view::npos)
+      return kLexBlockComment;
+    break;
+  }
+  case kLexLineComment:
+    i = len;
+    emit(0, kTokenComment);
+    return continued ? kLexLineComment : kLexNormal;
+  case kLexString: {
+    bool terminated;
+    i = SkipQuoted(line, 0, '"', &terminated);
+    emit(0, kTokenString);
+    if (!terminated)
+      return continued ? kLexString : kLexNormal;
+    break;
+  }
+  case kLexPreprocessor:
+    directive = true;
+    break;
+  }
+
+  /* preprocessor directives start with the first token of a line */
+  bool first_token = state == kLexNormal;
+
+  while (i < len) {
+    const uint8_t c = line[i];
+    const size_t start = i;
+
+    if (c == ' ' || c == '\t') {
+      i++;
+      continue;
+    }
+
+    if (c == '/' && i + 1 < len && line[i + 1] == '/') {
+      i = len;
+      emit(start, kTokenComment);
+      return continued ? kLexLineComment : kLexNormal;
+    }
+    if (c == '/' && i + 1 < len && line[i + 1] == '*') {
+      const size_t end = line.find("*/", i + 2);
+      i = end == std::string_view::npos ? len : end + 2;
+      emit(start, kTokenComment);
+      if (end == std::string_view::npos)
+        return kLexBlockComment;
+      continue;
+    }
+
+    if (c == '#' && first_token) {
+      directive = true;
+    }
+    first_token = false;
+
+    /* the rest of a directive is highlighted as a whole, up to comments */
+    if (directive) {
+      while (i < len && !CommentStartsAt(line, i)) {
+        i++;
+      }
+      emit(start, kTokenPreprocessor);
+      continue;
+    }
+
+    if (c == '"' || c == '\'') {
+      bool terminated;
+      i = SkipQuoted(line, i + 1, c, &terminated);
+      emit(start, kTokenString);
+      if (!terminated && c == '"' && continued)
+        return kLexString;
+      continue;
+    }
+
+    if (IsDigit(c) || (c == '.' && i + 1 < len && IsDigit(line[i + 1]))) {
+      i++;
+      /* suffixes, hex digits, digit separators and exponents */
+      while (i < len) {
+        const uint8_t d = line[i];
+        const uint8_t prev = line[i - 1];
+        const bool exponent_sign =
+            (d == '+' || d == '-') &&
+            (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P');
+        if (!IsIdentifier(d) && d != '.' && d != '\'' && !exponent_sign)
+          break;
+        i++;
+      }
+      emit(start, kTokenNumber);
+      continue;
+    }
+
+    if (IsIdentifierStart(c)) {
+      while (i < len && IsIdentifier(line[i])) {
+        i++;
+      }
+      const TokenKind kind = IdentifierKind(line.substr(start, i - start));
+      if (kind != kTokenDefault) {
+        emit(start, kind);
+      }
+      continue;
+    }
+
+    i++;
+  }
+
+  return directive && continued ? kLexPreprocessor : kLexNormal;
+}
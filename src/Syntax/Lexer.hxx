@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+enum TokenKind : uint8_t {
+  kTokenDefault,
+  kTokenKeyword,
+  kTokenType,
+  kTokenComment,
+  kTokenString,
+  kTokenNumber,
+  kTokenPreprocessor,
+  kNumTokenKinds
+};
+
+/* state of the lexer at the start of a line, which is all that carries over
+ * from the previous lines */
+enum LexState : uint8_t {
+  kLexNormal,
+  kLexBlockComment,
+  /* line comments, strings and preprocessor directives continued by a
+   * backslash at the end of the previous line */
+  kLexLineComment,
+  kLexString,
+  kLexPreprocessor
+};
+
+/* a span of a line, relative to the start of the line */
+struct Token {
+  size_t offset;
+  size_t len;
+  TokenKind kind;
+};
+
+/* Lexes a line of C or C++, without its newline, starting in state, and
+ * returns the state at the start of the next line. Tokens other than
+ * kTokenDefault are appended to tokens, unless it is nullptr.
+ *
+ * This is a highlighter, not a compiler, so anything it does not recognize is
+ * left as kTokenDefault. Raw string literals are not supported */
+LexState LexLine(LexState state, std::string_view line,
+                 std::vector<Token> *tokens);
@@ -0,0 +1,87 @@
+#include "Lexer.hxx"
+#include "catch2/catch.hpp"
+
+#include <string>
+
+/* lexes a line and renders its tokens as "kind:text" */
+static std::vector<std::string> Lex(LexState state, std::string_view line,
+                                    LexState *next = nullptr) {
+  static const char *kinds[kNumTokenKinds] = {
+      "default", "keyword", "type", "comment", "string", "number", "pp"};
+  std::vector<Token> tokens;
+  const LexState next_state = LexLine(state, line, &tokens);
+  if (next != nullptr) {
+    *next = next_state;
+  }
+
+  std::vector<std::string> out;
+  for (const Token &token : tokens) {
+    out.push_back(std::string(kinds[token.kind]) + ":" +
+                  std::string(line.substr(token.offset, token.len)));
+  }
+  return out;
+}
+
+using Tokens = std::vector<std::string>;
+
+TEST_CASE("lex line", "[Lexer]") {
+  LexState next;
+
+  SECTION("keywords, types, numbers and strings") {
+    REQUIRE(Lex(kLexNormal, "  static const int x = 0x1f + 1.5e-3;", &next) ==
+            Tokens{"keyword:static", "keyword:const", "type:int",
+                   "number:0x1f", "number:1.5e-3"});
+    REQUIRE(next == kLexNormal);
+    REQUIRE(Lex(kLexNormal, "return s == \"a \\\" b\" || c == '\\'';") ==
+            Tokens{"keyword:return", "string:\"a \\\" b\"", "string:'\\''"});
+    /* identifiers which contain keywords */
+    REQUIRE(Lex(kLexNormal, "interface format_int if2 _if").empty());
+  }
+
+  SECTION("comments") {
+    REQUIRE(Lex(kLexNormal, "x = 1; // if (x)", &next) ==
+            Tokens{"number:1", "comment:// if (x)"});
+    REQUIRE(next == kLexNormal);
+    REQUIRE(Lex(kLexNormal, "a /* b */ if", &next) ==
+            Tokens{"comment:/* b */", "keyword:if"});
+    REQUIRE(Lex(kLexNormal, "int a; /* starts", &next) ==
+            Tokens{"type:int", "comment:/* starts"});
+    REQUIRE(next == kLexBlockComment);
+    REQUIRE(Lex(kLexBlockComment, "still in it", &next) ==
+            Tokens{"comment:still in it"});
+    REQUIRE(next == kLexBlockComment);
+    REQUIRE(Lex(kLexBlockComment, "ends */ return", &next) ==
+            Tokens{"comment:ends */", "keyword:return"});
+    REQUIRE(next == kLexNormal);
+  }
+
+  SECTION("preprocessor directives") {
+    REQUIRE(Lex(kLexNormal, "#include <vector> // why", &next) ==
+            Tokens{"pp:#include <vector> ", "comment:// why"});
+    REQUIRE(next == kLexNormal);
+    REQUIRE(Lex(kLexNormal, "  #define MAX(a, b) \\", &next) ==
+            Tokens{"pp:#define MAX(a, b) \\"});
+    REQUIRE(next == kLexPreprocessor);
+    REQUIRE(Lex(kLexPreprocessor, "  ((a) > (b) ? (a) : (b))", &next) ==
+            Tokens{"pp:((a) > (b) ? (a) : (b))"});
+    REQUIRE(next == kLexNormal);
+    /* only at the start of a line */
+    REQUIRE(Lex(kLexNormal, "x # y").empty());
+  }
+
+  SECTION("continued lines") {
+    REQUIRE(Lex(kLexNormal, "const char *s = \"multi \\", &next) ==
+            Tokens{"keyword:const", "type:char", "string:\"multi \\"});
+    REQUIRE(next == kLexString);
+    REQUIRE(Lex(kLexString, "line\"; if", &next) ==
+            Tokens{"string:line\"", "keyword:if"});
+    REQUIRE(next == kLexNormal);
+
+    REQUIRE(Lex(kLexNormal, "// comment \\", &next) ==
+            Tokens{"comment:// comment \\"});
+    REQUIRE(next == kLexLineComment);
+    REQUIRE(Lex(kLexLineComment, "continued", &next) ==
+            Tokens{"comment:continued"});
+    REQUIRE(next == kLexNormal);
+  }
+}
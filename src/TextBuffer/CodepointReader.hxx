@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../Util/UTF8.hxx"
+#include "TextBuffer.hxx"
+#include <algorithm>
+
+/* Reads the codepoints of a TextBuffer forwards from an iterator.
+ *
+ * Runs of ASCII are handed out as views into the contents of a span, so that
+ * callers handle them without decoding or going through the iterator for
+ * every byte. Sequences which cross span boundaries are decoded from a copy */
+struct CodepointReader {
+  /* position of the next codepoint */
+  TextBuffer::iterator pos;
+
+  CodepointReader(TextBuffer::iterator pos) : pos(pos){};
+
+  bool Done(void) const { return pos.IsEOF(); }
+
+  /* Returns the ASCII bytes starting at pos, at most max_len, without
+   * advancing. The view is empty if the next codepoint is not ASCII */
+  ConstView<uint8_t> PeekASCII(size_t max_len) const {
+    const TextBuffer::Span &span = pos.parent->spans[pos.span_idx];
+    const uint8_t *begin = span.contents.begin + pos.byte_offset;
+    const size_t len = std::min(span.contents.len - pos.byte_offset, max_len);
+    return {begin, ASCIIPrefixLength(begin, len)};
+  }
+
+  void Skip(size_t bytes) { pos += bytes; }
+
+  /* Decodes the next codepoint and advances past it. len is set to the number
+   * of bytes of the codepoint. Must not be called when Done */
+  uint32_t Next(size_t *len) {
+    const TextBuffer::Span &span = pos.parent->spans[pos.span_idx];
+    const size_t available = span.contents.len - pos.byte_offset;
+    const uint8_t *begin = span.contents.begin + pos.byte_offset;
+
+    uint32_t codepoint;
+    if (available >= 4 || available >= UTF8SequenceLength(*begin)) {
+      codepoint = DecodeUTF8(begin, available, len);
+    } else {
+      /* the sequence continues in the next span */
+      uint8_t sequence[4];
+      size_t sequence_len = 0;
+      for (TextBuffer::iterator i = pos; sequence_len < 4 && !i.IsEOF(); i++) {
+        sequence[sequence_len++] = *i;
+      }
+      codepoint = DecodeUTF8(sequence, sequence_len, len);
+    }
+
+    pos += *len;
+    return codepoint;
+  }
+};
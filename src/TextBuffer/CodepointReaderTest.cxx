@@ -0,0 +1,121 @@
+#include "CodepointReader.hxx"
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch2/catch.hpp"
+
+#include <cctype>
+#include <random>
+#include <string_view>
+
+/* reads every codepoint, using PeekASCII like layout does */
+static std::vector<uint32_t> ReadAll(TextBuffer &tb) {
+  std::vector<uint32_t> codepoints;
+  CodepointReader reader(tb.begin());
+  while (!reader.Done()) {
+    const ConstView<uint8_t> ascii = reader.PeekASCII(7);
+    if (ascii.len > 0) {
+      codepoints.insert(codepoints.end(), ascii.begin, ascii.begin + ascii.len);
+      reader.Skip(ascii.len);
+      continue;
+    }
+    size_t len;
+    codepoints.push_back(reader.Next(&len));
+  }
+  return codepoints;
+}
+
+TEST_CASE("read codepoints", "[CodepointReader]") {
+  TextBuffer tb;
+
+  SECTION("ascii and multibyte sequences") {
+    std::string_view text =
+        "a\xc3\xa9 \xe2\x82\xac\n0123456789 \xf0\x9f\x98\x80";
+    tb.InsertAt(tb.AtByteOffset(0), text.begin(), text.end());
+    REQUIRE(ReadAll(tb) ==
+            std::vector<uint32_t>{'a', 0xe9, ' ', 0x20ac, '\n', '0', '1', '2',
+                                  '3', '4', '5', '6', '7', '8', '9', ' ',
+                                  0x1f600});
+  }
+
+  SECTION("sequences crossing spans") {
+    /* inserting at the start creates a new span before the old one */
+    std::string_view second = "\x82\xac b";
+    std::string_view first = "a \xe2";
+    tb.InsertAt(tb.AtByteOffset(0), second.begin(), second.end());
+    tb.InsertAt(tb.AtByteOffset(0), first.begin(), first.end());
+    REQUIRE(tb.spans.size() > 2);
+    REQUIRE(ReadAll(tb) == std::vector<uint32_t>{'a', ' ', 0x20ac, ' ', 'b'});
+  }
+
+  SECTION("invalid sequences") {
+    std::string_view text = "\xc3(\xff\xe2\x82";
+    tb.InsertAt(tb.AtByteOffset(0), text.begin(), text.end());
+    REQUIRE(ReadAll(tb) ==
+            std::vector<uint32_t>{kReplacementCharacter, '(',
+                                  kReplacementCharacter, kReplacementCharacter,
+                                  kReplacementCharacter});
+  }
+}
+
+/* generates something that looks like source code, with a share of non-ASCII
+ * characters in comments */
+static std::string GenerateSource(size_t len, int non_ascii_percent) {
+  std::mt19937 rng(7);
+  std::string source;
+  while (source.size() < len) {
+    source += "  if (value->count < limit) {\n    total += Measure(value);\n";
+    if ((int)(rng() % 100) < non_ascii_percent) {
+      source += "    /* gr\xc3\xb6\xc3\x9f" "e \xe2\x86\x92 \xce\xbb */\n";
+    } else {
+      source += "    /* size of the value */\n";
+    }
+    source += "  }\n";
+  }
+  return source;
+}
+
+TEST_CASE("codepoint reader performance", "[CodepointReader]") {
+  /* stands in for RenderFont::CharAdvance */
+  float advances[128];
+  for (int i = 0; i < 128; i++) {
+    advances[i] = 7 + i % 3;
+  }
+
+  for (int non_ascii_percent : {0, 10}) {
+    TextBuffer tb;
+    const std::string source = GenerateSource(1 << 20, non_ascii_percent);
+    tb.InsertAt(tb.AtByteOffset(0), source.begin(), source.end());
+    const std::string name = " (1MiB, " + std::to_string(non_ascii_percent) +
+                             "% lines with non-ASCII)";
+
+    /* how layout measured text before decoding UTF-8 */
+    BENCHMARK("bytes through the iterator" + name) {
+      float x = 0;
+      for (TextBuffer::iterator iter = tb.begin(); !iter.IsEOF(); iter++) {
+        uint8_t c = *iter;
+        if (!isprint(c))
+          c = '?';
+        x += advances[c];
+      }
+      return x;
+    };
+
+    BENCHMARK("codepoints with the ascii fast path" + name) {
+      float x = 0;
+      CodepointReader reader(tb.begin());
+      while (!reader.Done()) {
+        const ConstView<uint8_t> ascii = reader.PeekASCII(256);
+        for (size_t i = 0; i < ascii.len; i++) {
+          x += advances[ascii.begin[i]];
+        }
+        if (ascii.len > 0) {
+          reader.Skip(ascii.len);
+          continue;
+        }
+        size_t len;
+        reader.Next(&len);
+        x += advances['?'];
+      }
+      return x;
+    };
+  }
+}
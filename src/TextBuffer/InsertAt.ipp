@@ -4,6 +4,7 @@ template <typename ForwardIter>
 void TextBuffer::InsertAt(iterator pos, const ForwardIter begin,
                           const ForwardIter end) {
   AssertValidIterator(pos);
+  const size_t line = LineOf(pos);
   NewEpoch();
 
   /* append content and line num offsets into buffer */
@@ -21,6 +22,7 @@ void TextBuffer::InsertAt(iterator pos, const ForwardIter begin,
 
   num_lines += insert_span.newline_ptrs.len;
   num_bytes += insert_span.contents.len;
+  LogEdit({epoch, line, (ptrdiff_t)insert_span.newline_ptrs.len});
 
   /* update spans array */
   Span pos_span = spans[pos.span_idx];
@@ -33,7 +35,7 @@ void TextBuffer::InsertAt(iterator pos, const ForwardIter begin,
         prev.contents.cend() == insert_span.contents.begin &&
         prev.newline_ptrs.cend() == insert_span.newline_ptrs.begin) {
       prev.contents.len += insert_span.contents.len;
-      prev.newline_ptrs.len += insert_span.contents.len;
+      prev.newline_ptrs.len += insert_span.newline_ptrs.len;
       return;
     }
   }
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "TextBuffer.hxx"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Reads the lines of a snapshot of the spans of a TextBuffer.
+ *
+ * The contents of spans are never modified or moved, so a copy of the spans
+ * vector stays readable from other threads while the buffer is edited */
+struct LineReader {
+  const std::vector<TextBuffer::Span> &spans;
+  size_t span_idx;
+  size_t offset;
+
+  /* starts at the beginning of line, or at the end if there is no such line */
+  LineReader(const std::vector<TextBuffer::Span> &spans, size_t line)
+      : spans(spans), span_idx(0), offset(0) {
+    if (line == 0)
+      return;
+
+    size_t lines_traversed = 0;
+    for (; span_idx < spans.size(); span_idx++) {
+      TextBuffer::Span span = spans[span_idx];
+      if (line <= lines_traversed + span.newline_ptrs.len) {
+        const uint8_t *newline = span.newline_ptrs[line - lines_traversed - 1];
+        offset = newline - span.contents.begin + 1;
+        return;
+      }
+      lines_traversed += span.newline_ptrs.len;
+    }
+  }
+
+  /* reads the next line into out, without its newline, and moves to the
+   * following line. Lines longer than max_len are cut off, and the reader is
+   * left inside of them. Returns false at the end of the buffer.
+   *
+   * out may be any string type, e.g. one allocated from an arena */
+  template <typename String>
+  bool Next(String &out, size_t max_len = SIZE_MAX) {
+    out.clear();
+    if (span_idx >= spans.size())
+      return false;
+
+    for (; span_idx < spans.size(); span_idx++, offset = 0) {
+      const TextBuffer::Span &span = spans[span_idx];
+      const size_t available =
+          std::min(span.contents.len - offset, max_len - out.size());
+      if (available == 0)
+        continue;
+
+      const uint8_t *begin = span.contents.begin + offset;
+      const uint8_t *newline = (const uint8_t *)memchr(begin, '\n', available);
+      const size_t len = newline ? newline - begin : available;
+      out.append((const char *)begin, len);
+      if (newline) {
+        offset += len + 1;
+        return true;
+      }
+      if (out.size() == max_len) {
+        offset += len;
+        return true;
+      }
+    }
+    /* the last line is not terminated by a newline */
+    return true;
+  }
+};
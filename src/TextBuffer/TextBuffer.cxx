@@ -7,6 +7,7 @@ TextBuffer::TextBuffer() {
   num_lines = 0;
   num_bytes = 0;
   epoch = 0;
+  spans_snapshot_epoch = 0;
 }
 
 void TextBuffer::NewEpoch() {
@@ -22,6 +23,22 @@ void TextBuffer::NewEpoch() {
   }
 }
 
+void TextBuffer::LogEdit(Edit edit) {
+  if (edits.size() == kMaxEdits) {
+    edits.erase(edits.begin(), edits.begin() + kMaxEdits / 2);
+  }
+  edits.push_back(edit);
+}
+
+std::shared_ptr<const std::vector<TextBuffer::Span>>
+TextBuffer::SpansSnapshot(void) {
+  if (!spans_snapshot || spans_snapshot_epoch != epoch) {
+    spans_snapshot = std::make_shared<const std::vector<Span>>(spans);
+    spans_snapshot_epoch = epoch;
+  }
+  return spans_snapshot;
+}
+
 std::shared_ptr<TextBuffer::iterator> TextBuffer::PersistIterator(iterator i) {
   auto new_iter = std::make_shared<iterator>(i);
   persisted_iterators.push_back(new_iter);
@@ -129,18 +129,45 @@ struct TextBuffer {
   /* TODO: handle dead iterators? RAII remove them from array? */
   std::vector<std::weak_ptr<iterator>> persisted_iterators;
 
+  /* an edit, as seen by consumers which keep state per line, such as syntax
+   * highlighting */
+  struct Edit {
+    /* epoch of the buffer after the edit */
+    size_t epoch;
+    /* first line whose contents changed */
+    size_t line;
+    /* lines inserted after it, negative if lines were removed */
+    ptrdiff_t lines_added;
+  };
+  /* the most recent edits. Consumers which fell further behind have to assume
+   * that every line changed */
+  static constexpr size_t kMaxEdits = 1024;
+  std::vector<Edit> edits;
+
+  /* copy of spans for reading the buffer on other threads, see SpansSnapshot.
+   * Null until it is first asked for in spans_snapshot_epoch */
+  std::shared_ptr<const std::vector<Span>> spans_snapshot;
+  size_t spans_snapshot_epoch;
+
   TextBuffer();
   TextBuffer(const TextBuffer &) = delete;
   TextBuffer &operator=(const TextBuffer &) = delete;
 
   void AssertValidIterator(iterator i);
   void NewEpoch();
+  void LogEdit(Edit);
 
   iterator begin(void);
   iterator end(void);
 
   iterator AtByteOffset(size_t byte_offset);
   iterator AtLineCol(size_t line, size_t col);
+  /* line of the position of an iterator */
+  size_t LineOf(iterator);
+  /* copy of the spans at the current epoch, which stays readable from other
+   * threads while the buffer is edited. It is only copied on the first call
+   * in an epoch, every consumer shares that copy */
+  std::shared_ptr<const std::vector<Span>> SpansSnapshot(void);
 
   std::shared_ptr<iterator> PersistIterator(iterator i);
 
@@ -60,6 +60,96 @@ src/Util/Assert.cxx
   }
 }
 
+TEST_CASE("text buffer last line", "[TextBuffer]") {
+  TextBuffer tb;
+
+  /* a buffer without newlines, such as a minified file, is a single line */
+  REQUIRE(tb.AtLineCol(0, 0).IsEOF());
+  std::string_view line = "{\"minified\":true}";
+  tb.InsertAt(tb.AtByteOffset(0), line.cbegin(), line.cend());
+  REQUIRE(tb.AtLineCol(0, 0) == tb.begin());
+  REQUIRE(*tb.AtLineCol(0, 1) == '"');
+
+  /* the last line is not terminated */
+  std::string_view lines = "first\nsecond\nlast";
+  tb.InsertAt(tb.AtByteOffset(0), lines.cbegin(), lines.cend());
+  REQUIRE(tb.AtLineCol(2, 0) == tb.AtByteOffset(13));
+  REQUIRE(*tb.AtLineCol(2, 4) == '{');
+}
+
+TEST_CASE("text buffer line starts", "[TextBuffer]") {
+  TextBuffer tb;
+  std::string_view lines = "first\nsecond\n";
+  tb.InsertAt(tb.AtByteOffset(0), lines.cbegin(), lines.cend());
+
+  /* text inserted at the start of a line is in a span without newlines,
+   * before the span with the newline ending the line */
+  std::string_view inserted = "new ";
+  tb.InsertAt(tb.AtLineCol(1, 0), inserted.cbegin(), inserted.cend());
+  REQUIRE(*tb.AtLineCol(1, 0) == 'n');
+  REQUIRE(*tb.AtLineCol(1, 4) == 's');
+  REQUIRE(tb.AtLineCol(2, 0).IsEOF());
+}
+
+TEST_CASE("text buffer merges contiguous inserts", "[TextBuffer]") {
+  TextBuffer tb;
+  std::string_view text = "ab";
+  tb.InsertAt(tb.AtByteOffset(0), text.cbegin(), text.cend());
+
+  /* the second insert follows the first in memory and in the buffer, so it
+   * extends the span of the first */
+  std::string_view first = "1\n";
+  std::string_view second = "2\n";
+  tb.InsertAt(tb.AtByteOffset(1), first.cbegin(), first.cend());
+  tb.InsertAt(tb.AtLineCol(1, 0), second.cbegin(), second.cend());
+  /* "a", "1\n2\n", "b" and the EOF span */
+  REQUIRE(tb.spans.size() == 4);
+  REQUIRE(tb.spans[1].contents.len == 4);
+  REQUIRE(tb.spans[1].newline_ptrs.len == 2);
+
+  REQUIRE(tb.num_lines == 2);
+  REQUIRE(*tb.AtLineCol(1, 0) == '2');
+  REQUIRE(*tb.AtLineCol(2, 0) == 'b');
+  REQUIRE(tb.LineOf(tb.end()) == 2);
+}
+
+TEST_CASE("text buffer edit log", "[TextBuffer]") {
+  TextBuffer tb;
+  std::string_view lines = "first\nsecond\nthird\n";
+  tb.InsertAt(tb.AtByteOffset(0), lines.cbegin(), lines.cend());
+  REQUIRE(tb.LineOf(tb.AtByteOffset(0)) == 0);
+  REQUIRE(tb.LineOf(tb.AtByteOffset(5)) == 0);
+  REQUIRE(tb.LineOf(tb.AtByteOffset(6)) == 1);
+  REQUIRE(tb.LineOf(tb.end()) == 3);
+
+  std::string_view inserted = "x\ny";
+  tb.InsertAt(tb.AtLineCol(1, 2), inserted.cbegin(), inserted.cend());
+  REQUIRE(tb.edits.size() == 2);
+  REQUIRE(tb.edits.back().epoch == tb.epoch);
+  REQUIRE(tb.edits.back().line == 1);
+  REQUIRE(tb.edits.back().lines_added == 1);
+  REQUIRE(tb.num_lines == 4);
+}
+
+TEST_CASE("text buffer spans snapshot", "[TextBuffer]") {
+  TextBuffer tb;
+  std::string_view text = "first\nsecond\n";
+  tb.InsertAt(tb.AtByteOffset(0), text.cbegin(), text.cend());
+
+  /* consumers in the same epoch share a single copy */
+  const auto snapshot = tb.SpansSnapshot();
+  REQUIRE(tb.SpansSnapshot() == snapshot);
+  REQUIRE(snapshot->size() == tb.spans.size());
+
+  /* the old copy is left as it was by edits */
+  const size_t num_spans = tb.spans.size();
+  tb.InsertAt(tb.AtLineCol(1, 0), text.cbegin(), text.cend());
+  REQUIRE(snapshot->size() == num_spans);
+  const auto after_edit = tb.SpansSnapshot();
+  REQUIRE(after_edit != snapshot);
+  REQUIRE(after_edit->size() == tb.spans.size());
+}
+
 TEST_CASE("text buffer insert performance", "[TextBuffer]") {
   const size_t num_iter = GENERATE(100, 1000, 10000);
 
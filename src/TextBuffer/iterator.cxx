@@ -1,4 +1,5 @@
 #include "TextBuffer.hxx"
+#include <algorithm>
 #include <cassert>
 
 using iterator = TextBuffer::iterator;
@@ -27,28 +28,67 @@ iterator TextBuffer::AtByteOffset(size_t byte_offset) {
 }
 
 iterator TextBuffer::AtLineCol(size_t line, size_t col) {
+  auto at = [&](iterator start) {
+    /* lines which start at the end of a span start at the next one */
+    if (start.byte_offset == spans[start.span_idx].contents.len &&
+        start.span_idx + 1 < spans.size()) {
+      start = {this, epoch, start.span_idx + 1, 0};
+    }
+    /* TODO: currently allows columns beyond end of the line */
+    if (col > 0)
+      start += col;
+    return start;
+  };
+
+  /* a line starts after the last newline before it. That newline may be in an
+   * earlier span than the first newline of the line, e.g. after text was
+   * inserted at the start of the line, and the last line of the buffer is not
+   * terminated by a newline at all */
+  iterator start = begin();
   size_t lines_traversed = 0;
   for (size_t i = 0; i < spans.size(); i++) {
     Span span = spans[i];
     if (line < lines_traversed + span.newline_ptrs.len) {
-      size_t byte_offset = 0;
       if (line - lines_traversed > 0) {
-        byte_offset = (size_t)(span.newline_ptrs[line - lines_traversed - 1] -
-                               span.contents.begin) +
-                      1;
+        const uint8_t *newline =
+            span.newline_ptrs[line - lines_traversed - 1];
+        start = {this, epoch, i,
+                 (size_t)(newline - span.contents.begin) + 1};
       }
-      iterator iter = {this, epoch, i, byte_offset};
-      /* TODO: currently allows columns beyond end of the line */
-      iter += col;
-      return iter;
+      return at(start);
+    }
+    if (span.newline_ptrs.len > 0) {
+      const uint8_t *last_newline =
+          span.newline_ptrs[span.newline_ptrs.len - 1];
+      start = {this, epoch, i,
+               (size_t)(last_newline - span.contents.begin) + 1};
     }
     lines_traversed += span.newline_ptrs.len;
   }
 
+  if (line == lines_traversed)
+    return at(start);
+
   unreachable(
       "attempted to create iterator with line/col index outside buffer");
 }
 
+size_t TextBuffer::LineOf(iterator i) {
+  AssertValidIterator(i);
+  size_t line = 0;
+  for (size_t span_idx = 0; span_idx < i.span_idx; span_idx++) {
+    line += spans[span_idx].newline_ptrs.len;
+  }
+
+  /* the newlines of a span are in order */
+  Span span = spans[i.span_idx];
+  const uint8_t *pos = span.contents.begin + i.byte_offset;
+  line += std::lower_bound(span.newline_ptrs.cbegin(),
+                           span.newline_ptrs.cend(), pos) -
+          span.newline_ptrs.cbegin();
+  return line;
+}
+
 /* helper methods */
 bool iterator::IsEOF() const {
   return (span_idx + 1 == parent->spans.size() &&
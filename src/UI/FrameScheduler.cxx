@@ -0,0 +1,22 @@
+#include "FrameScheduler.hxx"
+
+bool FrameScheduler::FrameDue(uint64_t now_ns, bool animating) const {
+  return (animating || input_pending) && now_ns >= last_frame_ns + frame_ns;
+}
+
+uint64_t FrameScheduler::WaitNs(uint64_t now_ns, bool animating) const {
+  if (!animating && !input_pending)
+    return UINT64_MAX;
+  const uint64_t due = last_frame_ns + frame_ns;
+  return due > now_ns ? due - now_ns : 0;
+}
+
+void FrameScheduler::FrameDrawn(uint64_t frame_start_ns) {
+  /* after being idle, or when falling behind, the grid starts over */
+  if (frame_start_ns - last_frame_ns >= 2 * frame_ns) {
+    last_frame_ns = frame_start_ns;
+  } else {
+    last_frame_ns += frame_ns;
+  }
+  input_pending = false;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+/* Decides when the main loop draws a frame. Input is coalesced between frames
+ * and frames are drawn at most once per refresh interval of the display, so a
+ * burst of events results in a single frame. When nothing animates and no
+ * input arrived, no frame is due and the loop can wait for events without a
+ * timeout.
+ *
+ * Times are in nanoseconds from any monotonic clock */
+struct FrameScheduler {
+  /* used when the display does not report its refresh rate */
+  static constexpr int kDefaultRefreshRate = 60;
+
+  uint64_t frame_ns;
+  /* start of the most recent frame */
+  uint64_t last_frame_ns;
+  /* input arrived since the most recent frame */
+  bool input_pending;
+
+  FrameScheduler(uint64_t frame_ns)
+      : frame_ns(frame_ns), last_frame_ns(0), input_pending(false){};
+
+  static uint64_t FrameNsForRefreshRate(int hz) {
+    return 1'000'000'000 / (hz > 0 ? hz : kDefaultRefreshRate);
+  }
+
+  void InputArrived(void) { input_pending = true; }
+  /* whether a frame should be drawn now */
+  bool FrameDue(uint64_t now_ns, bool animating) const;
+  /* time to wait for input before a frame is due, UINT64_MAX when idle */
+  uint64_t WaitNs(uint64_t now_ns, bool animating) const;
+  /* frame_start_ns is the time FrameDue was called with, so that frames stay
+   * on the grid of the refresh interval regardless of how long they took */
+  void FrameDrawn(uint64_t frame_start_ns);
+};
@@ -0,0 +1,54 @@
+#include "FrameScheduler.hxx"
+#include "catch2/catch.hpp"
+
+static constexpr uint64_t kMs = 1'000'000;
+
+TEST_CASE("frame scheduler", "[FrameScheduler]") {
+  FrameScheduler scheduler(FrameScheduler::FrameNsForRefreshRate(100));
+  REQUIRE(scheduler.frame_ns == 10 * kMs);
+  REQUIRE(FrameScheduler::FrameNsForRefreshRate(0) ==
+          1'000'000'000 / FrameScheduler::kDefaultRefreshRate);
+
+  uint64_t now = 1000 * kMs;
+
+  SECTION("idle without input or animation") {
+    REQUIRE_FALSE(scheduler.FrameDue(now, false));
+    REQUIRE(scheduler.WaitNs(now, false) == UINT64_MAX);
+  }
+
+  SECTION("input after being idle is drawn right away") {
+    scheduler.InputArrived();
+    REQUIRE(scheduler.FrameDue(now, false));
+    REQUIRE(scheduler.WaitNs(now, false) == 0);
+    scheduler.FrameDrawn(now);
+    REQUIRE_FALSE(scheduler.FrameDue(now, false));
+    REQUIRE(scheduler.WaitNs(now + 3 * kMs, false) == UINT64_MAX);
+  }
+
+  SECTION("a burst of input results in a single frame per interval") {
+    scheduler.InputArrived();
+    scheduler.FrameDrawn(now);
+    int frames = 0;
+    for (uint64_t t = now + kMs; t < now + 10 * kMs; t += kMs) {
+      scheduler.InputArrived();
+      frames += scheduler.FrameDue(t, false);
+    }
+    REQUIRE(frames == 0);
+    REQUIRE(scheduler.WaitNs(now + 4 * kMs, false) == 6 * kMs);
+    REQUIRE(scheduler.FrameDue(now + 10 * kMs, false));
+  }
+
+  SECTION("animation stays on the grid of the refresh interval") {
+    scheduler.FrameDrawn(now);
+    /* frames which start late do not push the following ones back */
+    REQUIRE(scheduler.FrameDue(now + 13 * kMs, true));
+    scheduler.FrameDrawn(now + 13 * kMs);
+    REQUIRE(scheduler.WaitNs(now + 13 * kMs, true) == 7 * kMs);
+    REQUIRE_FALSE(scheduler.FrameDue(now + 19 * kMs, true));
+    REQUIRE(scheduler.FrameDue(now + 20 * kMs, true));
+
+    /* after falling behind by more than a frame, the grid starts over */
+    scheduler.FrameDrawn(now + 55 * kMs);
+    REQUIRE(scheduler.WaitNs(now + 55 * kMs, true) == 10 * kMs);
+  }
+}
@@ -0,0 +1,92 @@
+#include "Gutter.hxx"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+Gutter::Counter::Counter(size_t value) : len(0) {
+  do {
+    digits[len++] = value % 10;
+    value /= 10;
+  } while (value > 0);
+  std::reverse(digits, digits + len);
+}
+
+void Gutter::Counter::Increment(void) {
+  uint i = len;
+  while (i > 0 && digits[i - 1] == 9) {
+    digits[--i] = 0;
+  }
+  if (i > 0) {
+    digits[i - 1]++;
+    return;
+  }
+
+  /* every digit carried, e.g. 999 + 1 */
+  assume(len < kMaxDigits, "line number out of range");
+  memmove(digits + 1, digits, len);
+  digits[0] = 1;
+  len++;
+}
+
+int Gutter::Width(size_t num_lines) {
+  const int advance = font.CharAdvance('0');
+  if (num_lines >= lines_begin && num_lines < lines_end &&
+      advance == digit_width)
+    return width;
+
+  uint num_digits = 1;
+  lines_begin = 0;
+  lines_end = 10;
+  while (num_lines >= lines_end && lines_end <= SIZE_MAX / 10) {
+    num_digits++;
+    lines_begin = lines_end;
+    lines_end *= 10;
+  }
+  if (num_lines >= lines_end) {
+    /* past the largest power of ten */
+    num_digits++;
+    lines_begin = lines_end;
+    lines_end = SIZE_MAX;
+  }
+  digit_width = advance;
+  assert(digit_width > 0);
+  /* 2 digit padding on both sides */
+  width = digit_width * (num_digits + 4);
+  return width;
+}
+
+bool Gutter::ShapeDigits(void) {
+  if (shaped)
+    return true;
+
+  static const char kDigits[] = "0123456789";
+  for (size_t d = 0; d < 10; d++) {
+    const ShapedRun &run = shapes.Shape(font, std::string_view(kDigits + d, 1));
+    if (run.glyphs.size() != 1)
+      return false;
+    digits[d] = {run.glyphs[0].glyph_id, run.glyphs[0].x, run.glyphs[0].y,
+                 run.advance};
+  }
+  shaped = true;
+  return true;
+}
+
+void Gutter::DrawNumber(RenderLayerIdx z, Point dst, const Counter &number,
+                        Color color) {
+  assert(shaped);
+  float x = 0;
+  for (uint i = 0; i < number.len; i++) {
+    const DigitGlyph &digit = digits[number.digits[i]];
+    font.DrawGlyph(z,
+                   {(int)(dst.x + x + digit.x),
+                    (int)(dst.y + digit.y) + (int)font.line_height},
+                   digit.glyph_id, color);
+    x += digit.advance;
+  }
+}
+
+void Gutter::TouchDigits(void) {
+  for (const DigitGlyph &digit : digits) {
+    font.TouchGlyph(digit.glyph_id);
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../Render/RenderFont.hxx"
+#include "../Render/ShapeCache.hxx"
+#include "../Render/Types.hxx"
+#include <cstddef>
+#include <cstdint>
+
+/* Draws the line numbers next to the text of an editor.
+ *
+ * The digits are shaped once, and numbers are drawn straight from their
+ * glyphs. Consecutive lines are numbered by incrementing a Counter in place,
+ * so no strings are formatted or shaped per line. The width of the gutter only
+ * changes with the number of digits of the line count, and is kept until
+ * then */
+struct Gutter {
+  /* decimal digits of a number, most significant first */
+  struct Counter {
+    /* enough for any size_t */
+    static constexpr uint kMaxDigits = 20;
+    uint8_t digits[kMaxDigits];
+    uint len;
+
+    Counter(size_t value);
+    void Increment(void);
+  };
+
+  struct DigitGlyph {
+    RenderFont::GlyphID glyph_id;
+    /* position relative to the pen, and advance of the pen */
+    float x;
+    float y;
+    float advance;
+  };
+
+  RenderFont &font;
+  ShapeCache &shapes;
+  DigitGlyph digits[10];
+  bool shaped;
+
+  /* line counts within [lines_begin, lines_end) have the same number of
+   * digits, and the gutter has width for them */
+  size_t lines_begin;
+  size_t lines_end;
+  int digit_width;
+  int width;
+
+  Gutter(RenderFont &font, ShapeCache &shapes)
+      : font(font), shapes(shapes), shaped(false), lines_begin(0),
+        lines_end(0), digit_width(0), width(0){};
+
+  /* width of the gutter of a buffer with num_lines lines */
+  int Width(size_t num_lines);
+  /* shapes the digits if they are not yet, returns false if the font can not
+   * be shaped */
+  bool ShapeDigits(void);
+  /* draws a number on the line whose top left is at dst, the digits must be
+   * shaped */
+  void DrawNumber(RenderLayerIdx z, Point dst, const Counter &, Color);
+  /* keeps the digits in the atlas while drawn from retained quads */
+  void TouchDigits(void);
+};
@@ -0,0 +1,32 @@
+#include "Gutter.hxx"
+#include "catch2/catch.hpp"
+
+#include <cstdint>
+#include <string>
+
+static std::string Digits(const Gutter::Counter &counter) {
+  std::string s;
+  for (uint i = 0; i < counter.len; i++) {
+    s.push_back('0' + counter.digits[i]);
+  }
+  return s;
+}
+
+TEST_CASE("counters hold the digits of their value", "[Gutter]") {
+  REQUIRE(Digits(Gutter::Counter(0)) == "0");
+  REQUIRE(Digits(Gutter::Counter(7)) == "7");
+  REQUIRE(Digits(Gutter::Counter(1203)) == "1203");
+  REQUIRE(Digits(Gutter::Counter(SIZE_MAX)) == std::to_string(SIZE_MAX));
+}
+
+TEST_CASE("incrementing counters carries", "[Gutter]") {
+  Gutter::Counter counter(0);
+  for (size_t i = 0; i < 100'000; i++) {
+    REQUIRE(Digits(counter) == std::to_string(i));
+    counter.Increment();
+  }
+
+  Gutter::Counter nines(999);
+  nines.Increment();
+  REQUIRE(Digits(nines) == "1000");
+}
@@ -0,0 +1,229 @@
+#include "Input.hxx"
+#include "../Util/Assert.hxx"
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+std::optional<InputEvent> InputEventFromSDL(const SDL_Event &event,
+                                            uint64_t time_ns) {
+  InputEvent input = {};
+  input.time_ns = time_ns;
+  switch (event.type) {
+  case SDL_WINDOWEVENT:
+    expect(event.window.event == SDL_WINDOWEVENT_RESIZED ||
+           event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED);
+    input.type = InputEvent::kResize;
+    input.w = event.window.data1;
+    input.h = event.window.data2;
+    return input;
+  case SDL_MOUSEWHEEL:
+    input.type = InputEvent::kWheel;
+    input.wheel_y = event.wheel.preciseY;
+    return input;
+  case SDL_TEXTINPUT:
+    input.type = InputEvent::kText;
+    input.text = event.text.text;
+    return input;
+  case SDL_KEYDOWN:
+    input.type = InputEvent::kKeyDown;
+    input.key = event.key.keysym.sym;
+    input.mod = event.key.keysym.mod;
+    return input;
+  case SDL_MOUSEBUTTONDOWN:
+  case SDL_QUIT:
+    input.type = InputEvent::kQuit;
+    return input;
+  }
+  return std::nullopt;
+}
+
+void CoalesceInputEvents(std::vector<InputEvent> &events) {
+  size_t kept = 0;
+  for (size_t i = 0; i < events.size(); i++) {
+    InputEvent &event = events[i];
+    InputEvent *previous = kept > 0 ? &events[kept - 1] : nullptr;
+    if (previous != nullptr && previous->type == event.type) {
+      switch (event.type) {
+      case InputEvent::kWheel:
+        previous->wheel_y += event.wheel_y;
+        continue;
+      case InputEvent::kText:
+        previous->text += event.text;
+        continue;
+      case InputEvent::kResize:
+        previous->w = event.w;
+        previous->h = event.h;
+        continue;
+      /* every key press moves the cursor or scrolls on its own */
+      case InputEvent::kKeyDown:
+      case InputEvent::kQuit:
+        break;
+      }
+    }
+    if (kept != i) {
+      events[kept] = std::move(event);
+    }
+    kept++;
+  }
+  events.resize(kept);
+}
+
+/* text is written as hex, so that every line splits on spaces */
+static std::string ToHex(const std::string &s) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (unsigned char c : s) {
+    hex += digits[c >> 4];
+    hex += digits[c & 0xf];
+  }
+  return hex;
+}
+
+static std::optional<std::string> FromHex(const std::string &hex) {
+  expect(hex.size() % 2 == 0);
+  auto value = [](char c) -> int {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    return -1;
+  };
+  std::string s;
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    const int hi = value(hex[i]), lo = value(hex[i + 1]);
+    expect(hi >= 0 && lo >= 0);
+    s += (char)(hi << 4 | lo);
+  }
+  return s;
+}
+
+static constexpr const char *kTraceHeader = "editor-input-trace 1";
+
+bool WriteInputTrace(const std::string &path,
+                     const std::vector<InputEvent> &events) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr)
+    return false;
+
+  fprintf(file, "%s\n", kTraceHeader);
+  for (const InputEvent &event : events) {
+    fprintf(file, "%" PRIu64 " ", event.time_ns);
+    switch (event.type) {
+    case InputEvent::kResize:
+      fprintf(file, "resize %" PRId32 " %" PRId32 "\n", event.w, event.h);
+      break;
+    case InputEvent::kWheel:
+      /* enough digits for the float to be read back exactly */
+      fprintf(file, "wheel %.9g\n", event.wheel_y);
+      break;
+    case InputEvent::kText:
+      fprintf(file, "text %s\n", ToHex(event.text).c_str());
+      break;
+    case InputEvent::kKeyDown:
+      fprintf(file, "key %" PRId32 " %u\n", event.key, (uint)event.mod);
+      break;
+    case InputEvent::kQuit:
+      fprintf(file, "quit\n");
+      break;
+    }
+  }
+  return fclose(file) == 0;
+}
+
+std::optional<std::vector<InputEvent>> ReadInputTrace(const std::string &path) {
+  std::ifstream file(path);
+  std::string line;
+  expect(std::getline(file, line) && line == kTraceHeader);
+
+  std::vector<InputEvent> events;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    InputEvent event = {};
+    std::string type;
+    expect(fields >> event.time_ns >> type);
+    /* events are in order of time */
+    expect(events.empty() || events.back().time_ns <= event.time_ns);
+
+    if (type == "resize") {
+      event.type = InputEvent::kResize;
+      expect(fields >> event.w >> event.h);
+    } else if (type == "wheel") {
+      event.type = InputEvent::kWheel;
+      expect(fields >> event.wheel_y);
+    } else if (type == "text") {
+      event.type = InputEvent::kText;
+      std::string hex;
+      expect(fields >> hex);
+      std::optional<std::string> text = FromHex(hex);
+      expect(text.has_value());
+      event.text = std::move(text.value());
+    } else if (type == "key") {
+      event.type = InputEvent::kKeyDown;
+      expect(fields >> event.key >> event.mod);
+    } else if (type == "quit") {
+      event.type = InputEvent::kQuit;
+    } else {
+      return std::nullopt;
+    }
+    events.push_back(std::move(event));
+  }
+  expect(file.eof());
+  return events;
+}
+
+void InputHandler::Handle(const InputEvent &event) {
+  TextBuffer &tb = editor.buffer;
+  switch (event.type) {
+  case InputEvent::kResize:
+    render.win_w = event.w;
+    render.win_h = event.h;
+    render.UpdateProjection();
+    break;
+  case InputEvent::kWheel:
+    scroll_accum += event.wheel_y;
+    break;
+  case InputEvent::kText:
+    tb.InsertAt(*editor.cursor, event.text.begin(), event.text.end());
+    break;
+  case InputEvent::kKeyDown:
+    switch (event.key) {
+    case SDLK_UP:
+      if (event.mod & KMOD_SHIFT) {
+        editor.PageUp();
+      } else {
+        editor.ScrollLines(-1);
+      }
+      break;
+    case SDLK_DOWN:
+      if (event.mod & KMOD_SHIFT) {
+        editor.PageDown();
+      } else {
+        editor.ScrollLines(1);
+      }
+      break;
+    case SDLK_RIGHT:
+      if (*editor.cursor < tb.end())
+        (*editor.cursor)++;
+      break;
+    case SDLK_LEFT:
+      if (tb.begin() < *editor.cursor)
+        (*editor.cursor)--;
+      break;
+    case SDLK_RETURN: {
+      std::string_view newline = "\n";
+      tb.InsertAt(*editor.cursor, newline.begin(), newline.end());
+      break;
+    }
+    }
+    break;
+  case InputEvent::kQuit:
+    quit = true;
+    break;
+  }
+}
+
+void InputHandler::ApplyScroll(void) {
+  editor.target_px += -scroll_accum * 3 * (int)editor.font.line_height;
+  scroll_accum = 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "SDL.h"
+#include "SDL_events.h"
+#include "ViewEditor.hxx"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/* An input event as the editor handles it. The main loop converts SDL events
+ * into these, so that a session can be recorded into a trace and replayed
+ * without a window, going through the same handling */
+struct InputEvent {
+  enum Type : uint8_t { kResize, kWheel, kText, kKeyDown, kQuit };
+
+  Type type;
+  /* nanoseconds since the start of the recording */
+  uint64_t time_ns;
+  /* kResize */
+  int32_t w, h;
+  /* kWheel, in lines */
+  float wheel_y;
+  /* kKeyDown, SDL keycode and modifiers */
+  int32_t key;
+  uint16_t mod;
+  /* kText, UTF-8 */
+  std::string text;
+};
+
+/* returns nullopt for events the editor does not handle */
+std::optional<InputEvent> InputEventFromSDL(const SDL_Event &,
+                                            uint64_t time_ns);
+
+/* merges runs of wheel, text and resize events which arrived before the same
+ * frame, keeping the time of the first event of a run */
+void CoalesceInputEvents(std::vector<InputEvent> &);
+
+/* a trace is a text file with an event per line, returns false if the file
+ * could not be written */
+bool WriteInputTrace(const std::string &path,
+                     const std::vector<InputEvent> &events);
+/* returns nullopt if the file could not be read or is malformed */
+std::optional<std::vector<InputEvent>> ReadInputTrace(const std::string &path);
+
+/* applies input events to the editor */
+struct InputHandler {
+  ViewEditor &editor;
+  RenderContext &render;
+  /* wheel movement since the previous frame */
+  float scroll_accum;
+  bool quit;
+
+  InputHandler(ViewEditor &editor, RenderContext &render)
+      : editor(editor), render(render), scroll_accum(0), quit(false){};
+
+  void Handle(const InputEvent &);
+  /* turns the wheel movement since the previous frame into scrolling, called
+   * once before drawing a frame */
+  void ApplyScroll(void);
+};
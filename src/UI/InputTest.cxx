@@ -0,0 +1,137 @@
+#include "Input.hxx"
+#include "catch2/catch.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static void RequireEqual(const InputEvent &a, const InputEvent &b) {
+  REQUIRE(a.type == b.type);
+  REQUIRE(a.time_ns == b.time_ns);
+  REQUIRE(a.w == b.w);
+  REQUIRE(a.h == b.h);
+  REQUIRE(a.wheel_y == b.wheel_y);
+  REQUIRE(a.key == b.key);
+  REQUIRE(a.mod == b.mod);
+  REQUIRE(a.text == b.text);
+}
+
+TEST_CASE("input trace round trip", "[Input]") {
+  const std::vector<InputEvent> events = {
+      {InputEvent::kResize, 0, 1280, 720, 0, 0, 0, {}},
+      {InputEvent::kWheel, 16'000'000, 0, 0, -0.3f, 0, 0, {}},
+      {InputEvent::kText, 20'000'000, 0, 0, 0, 0, 0, "a b"},
+      /* multi-byte UTF-8 and characters which would break lines */
+      {InputEvent::kText, 20'000'000, 0, 0, 0, 0, 0, "\xc3\xa9\n\t"},
+      {InputEvent::kKeyDown, 35'000'000, 0, 0, 0, SDLK_DOWN, KMOD_SHIFT, {}},
+      {InputEvent::kQuit, 90'000'000, 0, 0, 0, 0, 0, {}},
+  };
+
+  const std::string path = "input-test-trace.txt";
+  REQUIRE(WriteInputTrace(path, events));
+  const std::optional<std::vector<InputEvent>> read = ReadInputTrace(path);
+  std::remove(path.c_str());
+
+  REQUIRE(read.has_value());
+  REQUIRE(read->size() == events.size());
+  for (size_t i = 0; i < events.size(); i++) {
+    RequireEqual((*read)[i], events[i]);
+  }
+}
+
+TEST_CASE("malformed input traces", "[Input]") {
+  const std::string path = "input-test-malformed.txt";
+  auto read = [&](const std::string &contents) {
+    std::ofstream(path) << contents;
+    const bool ok = ReadInputTrace(path).has_value();
+    std::remove(path.c_str());
+    return ok;
+  };
+
+  REQUIRE(read("editor-input-trace 1\n"));
+  REQUIRE(read("editor-input-trace 1\n0 text 61\n5 quit\n"));
+  REQUIRE_FALSE(read(""));
+  REQUIRE_FALSE(read("editor-input-trace 2\n"));
+  REQUIRE_FALSE(read("editor-input-trace 1\n0 click 1 2\n"));
+  REQUIRE_FALSE(read("editor-input-trace 1\n0 resize 10\n"));
+  REQUIRE_FALSE(read("editor-input-trace 1\n0 text 6\n"));
+  REQUIRE_FALSE(read("editor-input-trace 1\n0 text zz\n"));
+  /* out of order */
+  REQUIRE_FALSE(read("editor-input-trace 1\n5 quit\n0 quit\n"));
+  REQUIRE_FALSE(ReadInputTrace("nonexistent-input-trace.txt").has_value());
+}
+
+TEST_CASE("coalesce input events", "[Input]") {
+  std::vector<InputEvent> events = {
+      {InputEvent::kWheel, 1, 0, 0, 1.5f, 0, 0, {}},
+      {InputEvent::kWheel, 2, 0, 0, -0.5f, 0, 0, {}},
+      {InputEvent::kText, 3, 0, 0, 0, 0, 0, "a"},
+      {InputEvent::kText, 4, 0, 0, 0, 0, 0, "bc"},
+      {InputEvent::kKeyDown, 5, 0, 0, 0, SDLK_DOWN, 0, {}},
+      {InputEvent::kKeyDown, 6, 0, 0, 0, SDLK_DOWN, 0, {}},
+      {InputEvent::kText, 7, 0, 0, 0, 0, 0, "d"},
+      {InputEvent::kResize, 8, 100, 100, 0, 0, 0, {}},
+      {InputEvent::kResize, 9, 200, 150, 0, 0, 0, {}},
+  };
+  CoalesceInputEvents(events);
+
+  REQUIRE(events.size() == 6);
+  REQUIRE(events[0].type == InputEvent::kWheel);
+  REQUIRE(events[0].wheel_y == 1.0f);
+  REQUIRE(events[0].time_ns == 1);
+  REQUIRE(events[1].text == "abc");
+  REQUIRE(events[1].time_ns == 3);
+  /* key presses are not merged */
+  REQUIRE(events[2].type == InputEvent::kKeyDown);
+  REQUIRE(events[3].type == InputEvent::kKeyDown);
+  /* text is only merged with adjacent text, so the order of edits stays */
+  REQUIRE(events[4].text == "d");
+  REQUIRE(events[5].w == 200);
+  REQUIRE(events[5].h == 150);
+  REQUIRE(events[5].time_ns == 8);
+
+  std::vector<InputEvent> none;
+  CoalesceInputEvents(none);
+  REQUIRE(none.empty());
+}
+
+TEST_CASE("input events from SDL", "[Input]") {
+  SDL_Event event;
+
+  memset(&event, 0, sizeof(event));
+  event.type = SDL_TEXTINPUT;
+  strcpy(event.text.text, "xy");
+  std::optional<InputEvent> input = InputEventFromSDL(event, 7);
+  REQUIRE(input.has_value());
+  REQUIRE(input->type == InputEvent::kText);
+  REQUIRE(input->time_ns == 7);
+  REQUIRE(input->text == "xy");
+
+  memset(&event, 0, sizeof(event));
+  event.type = SDL_KEYDOWN;
+  event.key.keysym.sym = SDLK_UP;
+  event.key.keysym.mod = KMOD_SHIFT;
+  input = InputEventFromSDL(event, 0);
+  REQUIRE(input.has_value());
+  REQUIRE(input->type == InputEvent::kKeyDown);
+  REQUIRE(input->key == SDLK_UP);
+  REQUIRE(input->mod == KMOD_SHIFT);
+
+  memset(&event, 0, sizeof(event));
+  event.type = SDL_WINDOWEVENT;
+  event.window.event = SDL_WINDOWEVENT_RESIZED;
+  event.window.data1 = 640;
+  event.window.data2 = 480;
+  input = InputEventFromSDL(event, 0);
+  REQUIRE(input.has_value());
+  REQUIRE(input->type == InputEvent::kResize);
+  REQUIRE(input->w == 640);
+  REQUIRE(input->h == 480);
+
+  /* not handled by the editor */
+  event.window.event = SDL_WINDOWEVENT_MOVED;
+  REQUIRE_FALSE(InputEventFromSDL(event, 0).has_value());
+  memset(&event, 0, sizeof(event));
+  event.type = SDL_KEYUP;
+  REQUIRE_FALSE(InputEventFromSDL(event, 0).has_value());
+}
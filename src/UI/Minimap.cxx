@@ -0,0 +1,326 @@
+#include "Minimap.hxx"
+#include "../TextBuffer/LineReader.hxx"
+#include "../Util/Assert.hxx"
+#include "../Util/Profile.hxx"
+#include "../Util/UTF8.hxx"
+#include "Palette.hxx"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <optional>
+
+/* reduces the first max_columns codepoints of a line into runs of ink, colored
+ * by the tokens of the line */
+static void ReduceLine(std::string_view text, const std::vector<Token> &tokens,
+                       uint max_columns, std::vector<Minimap::PixelRun> &runs) {
+  runs.clear();
+  size_t token_idx = 0;
+  uint column = 0;
+  for (size_t i = 0; i < text.size() && column < max_columns; column++) {
+    const uint8_t c = text[i];
+    const size_t len = std::max<size_t>(UTF8SequenceLength(c), 1);
+    if (c == ' ' || c == '\t') {
+      i += len;
+      continue;
+    }
+
+    while (token_idx < tokens.size() &&
+           tokens[token_idx].offset + tokens[token_idx].len <= i) {
+      token_idx++;
+    }
+    TokenKind kind = kTokenDefault;
+    if (token_idx < tokens.size() && tokens[token_idx].offset <= i) {
+      kind = tokens[token_idx].kind;
+    }
+    i += len;
+
+    if (!runs.empty() && runs.back().kind == kind &&
+        runs.back().column + runs.back().len == column) {
+      runs.back().len++;
+    } else {
+      runs.push_back({(uint8_t)column, 1, kind});
+    }
+  }
+}
+
+static_assert(sizeof(Color) == Minimap::kBytesPerPixel);
+
+/* ink is drawn halfway to the background, so that the overview does not draw
+ * attention away from the text */
+static Color Ink(TokenKind kind) {
+  const Color c = kTokenColors[kind];
+  const Color bg = kMinimapBackground;
+  return {(uint8_t)((c.r + bg.r) / 2), (uint8_t)((c.g + bg.g) / 2),
+          (uint8_t)((c.b + bg.b) / 2), 255};
+}
+
+Minimap::Minimap(Highlighter &highlighter)
+    : highlighter(highlighter), stopping(false), pending(false), epoch(0),
+      num_lines(0), reset(true), highlighter_version(0), w(0), h(0),
+      building(false), published_w(0), published_h(0), changed_begin(kClean),
+      changed_end(0), published_lines_per_row(1), stats{0, 0}, image_w(0),
+      image_h(0), lines_per_row(1) {}
+
+Minimap::~Minimap() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_available.notify_all();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void Minimap::Start(void) { worker = std::thread(&Minimap::Work, this); }
+
+void Minimap::Resize(uint new_w, uint new_h) {
+  new_w = std::min(new_w, kMaxWidth);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (new_w == w && new_h == h)
+      return;
+    w = new_w;
+    h = new_h;
+    pending = true;
+  }
+  work_available.notify_one();
+}
+
+void Minimap::Update(TextBuffer &buffer) {
+  const uint64_t version = highlighter.Version();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spans && buffer.epoch == epoch && version == highlighter_version)
+      return;
+
+    if (!spans || buffer.epoch != epoch) {
+      /* edits are only replayed if none of them were dropped from the log */
+      const std::vector<TextBuffer::Edit> &log = buffer.edits;
+      const bool replay =
+          spans && !log.empty() && log.front().epoch <= epoch + 1;
+      if (replay) {
+        for (const TextBuffer::Edit &edit : log) {
+          if (edit.epoch > epoch) {
+            edits.push_back(edit);
+          }
+        }
+      } else {
+        edits.clear();
+        reset = true;
+      }
+
+      epoch = buffer.epoch;
+      num_lines = buffer.num_lines + 1;
+      spans = buffer.SpansSnapshot();
+    }
+    highlighter_version = version;
+    pending = true;
+  }
+  work_available.notify_one();
+}
+
+size_t Minimap::ReplayEdits(const std::vector<TextBuffer::Edit> &replayed,
+                            bool *lines_moved) {
+  size_t first = SIZE_MAX;
+  for (const TextBuffer::Edit &edit : replayed) {
+    const auto after = lines.begin() + edit.line + 1;
+    if (edit.lines_added > 0) {
+      lines.insert(after, edit.lines_added, Line{{}, kLexNormal, false, false});
+    } else if (edit.lines_added < 0) {
+      lines.erase(after, after - edit.lines_added);
+    }
+    lines[edit.line].reduced = false;
+    *lines_moved |= edit.lines_added != 0;
+    first = std::min(first, edit.line);
+  }
+  return first;
+}
+
+void Minimap::ComposeRows(uint begin, uint end) {
+  Color ink[kNumTokenKinds];
+  for (int kind = 0; kind < kNumTokenKinds; kind++) {
+    ink[kind] = Ink((TokenKind)kind);
+  }
+
+  for (uint row = begin; row < end; row++) {
+    uint8_t *pixels = &image[(size_t)row * image_w * kBytesPerPixel];
+    for (uint x = 0; x < image_w; x++) {
+      memcpy(&pixels[x * kBytesPerPixel], &kMinimapBackground,
+             kBytesPerPixel);
+    }
+
+    /* lines sharing a row are drawn over each other */
+    const size_t first = std::min(row * lines_per_row, lines.size());
+    const size_t last = std::min(first + lines_per_row, lines.size());
+    for (size_t i = first; i < last; i++) {
+      for (const PixelRun &run : lines[i].runs) {
+        const uint run_end = std::min<uint>(run.column + run.len, image_w);
+        for (uint x = run.column; x < run_end; x++) {
+          memcpy(&pixels[x * kBytesPerPixel], &ink[run.kind], kBytesPerPixel);
+        }
+      }
+    }
+  }
+}
+
+void Minimap::Build(void) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (!pending)
+    return;
+
+  pending = false;
+  building = true;
+  const std::shared_ptr<const std::vector<TextBuffer::Span>> snapshot = spans;
+  const size_t built_epoch = epoch;
+  const size_t total_lines = num_lines;
+  std::vector<TextBuffer::Edit> replayed;
+  replayed.swap(edits);
+  const bool built_reset = reset;
+  reset = false;
+  const uint built_w = w;
+  const uint built_h = h;
+  lock.unlock();
+
+  PROFILE_ZONE("Minimap::Build");
+  const auto t0 = std::chrono::steady_clock::now();
+  bool lines_moved = false;
+  size_t first_changed;
+  if (built_reset) {
+    lines.assign(total_lines, Line{{}, kLexNormal, false, false});
+    first_changed = 0;
+    lines_moved = true;
+  } else {
+    first_changed = ReplayEdits(replayed, &lines_moved);
+  }
+  assume(lines.size() == total_lines, "edits replayed onto the wrong lines");
+
+  /* lines past the ones the highlighter reached are reduced without colors,
+   * and colored once their state is known */
+  if (!snapshot || !highlighter.UpToDateStates(built_epoch, states)) {
+    states.clear();
+  }
+
+  std::optional<LineReader> reader;
+  size_t reader_line = SIZE_MAX;
+  std::string text;
+  std::vector<Token> tokens;
+  size_t last_changed = 0;
+  uint64_t reduced = 0;
+  /* a codepoint is at most 4 bytes */
+  const size_t max_bytes = kMaxWidth * 4;
+  for (size_t i = 0; snapshot && i < lines.size(); i++) {
+    Line &line = lines[i];
+    const bool known = i < states.size();
+    if (line.reduced && (!known || (line.colored && line.state == states[i])))
+      continue;
+
+    if (reader_line != i) {
+      reader.emplace(*snapshot, i);
+    }
+    reader->Next(text, max_bytes);
+    /* the reader is left inside of lines which were cut off */
+    reader_line = text.size() < max_bytes ? i + 1 : SIZE_MAX;
+
+    tokens.clear();
+    if (known) {
+      LexLine(states[i], text, &tokens);
+    }
+    ReduceLine(text, tokens, kMaxWidth, line.runs);
+    line.state = known ? states[i] : kLexNormal;
+    line.reduced = true;
+    line.colored = known;
+    first_changed = std::min(first_changed, i);
+    last_changed = i + 1;
+    reduced++;
+  }
+
+  /* every row is built again if the image was resized or lines are shared by
+   * rows differently, rows after lines which moved all change */
+  size_t per_row = 1;
+  if (built_h > 0) {
+    per_row = std::max<size_t>((lines.size() + built_h - 1) / built_h, 1);
+  }
+  uint row_begin = built_h;
+  uint row_end = built_h;
+  if (built_w != image_w || built_h != image_h || per_row != lines_per_row) {
+    image_w = built_w;
+    image_h = built_h;
+    image.assign((size_t)image_w * image_h * kBytesPerPixel, 0);
+    lines_per_row = per_row;
+    row_begin = 0;
+  } else if (first_changed != SIZE_MAX) {
+    row_begin = std::min<size_t>(first_changed / per_row, built_h);
+    if (!lines_moved) {
+      const size_t last_row = (std::max(last_changed, first_changed + 1) - 1) /
+                              per_row;
+      row_end = std::min<size_t>(last_row + 1, built_h);
+    }
+  }
+  ComposeRows(row_begin, row_end);
+  const double build_time = std::chrono::duration<double, std::nano>(
+                                std::chrono::steady_clock::now() - t0)
+                                .count();
+
+  lock.lock();
+  building = false;
+  stats.lines_reduced += reduced;
+  stats.build_time += build_time;
+  if (image_w != published_w || image_h != published_h) {
+    published = image;
+    published_w = image_w;
+    published_h = image_h;
+    changed_begin = image_h > 0 ? 0 : kClean;
+    changed_end = image_h;
+  } else if (row_begin < row_end) {
+    const size_t row_bytes = (size_t)image_w * kBytesPerPixel;
+    std::copy(image.begin() + row_begin * row_bytes,
+              image.begin() + row_end * row_bytes,
+              published.begin() + row_begin * row_bytes);
+    changed_begin = std::min(changed_begin, row_begin);
+    changed_end = std::max(changed_end, row_end);
+  }
+  published_lines_per_row = lines_per_row;
+}
+
+bool Minimap::TakeChangedRows(Rows &rows) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (changed_begin == kClean)
+    return false;
+
+  const size_t row_bytes = (size_t)published_w * kBytesPerPixel;
+  rows.w = published_w;
+  rows.h = published_h;
+  rows.first_row = changed_begin;
+  rows.num_rows = changed_end - changed_begin;
+  rows.lines_per_row = published_lines_per_row;
+  rows.pixels.assign(published.begin() + changed_begin * row_bytes,
+                     published.begin() + changed_end * row_bytes);
+  changed_begin = kClean;
+  changed_end = 0;
+  return true;
+}
+
+bool Minimap::UpToDate(void) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return !pending && !building && changed_begin == kClean;
+}
+
+Minimap::Stats Minimap::GetStats(void) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
+
+void Minimap::Work(void) {
+  PROFILE_THREAD_NAME("minimap");
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    work_available.wait(lock, [&] { return stopping || pending; });
+    if (stopping)
+      break;
+
+    lock.unlock();
+    Build();
+    lock.lock();
+  }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "../Syntax/Highlighter.hxx"
+#include "../TextBuffer/TextBuffer.hxx"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Builds a low resolution RGBA image of a whole TextBuffer, for an overview of
+ * the document next to the editor.
+ *
+ * Every line is reduced to runs of colored pixels, one pixel per column, which
+ * are kept across edits: the edit log of the buffer is replayed so that only
+ * the edited lines are reduced again, and lines whose highlighting state
+ * changed are colored again. When there are more lines than rows in the image,
+ * consecutive lines share a row. The image is built on a worker thread, and
+ * only the rows which changed are handed out for uploading */
+struct Minimap {
+  struct Stats {
+    uint64_t lines_reduced;
+    /* time spent building, in nanoseconds */
+    double build_time;
+  };
+
+  /* columns past this are not shown */
+  static constexpr uint kMaxWidth = 255;
+  static constexpr size_t kBytesPerPixel = 4;
+
+  /* ink of a run of columns of a line, whitespace has none */
+  struct PixelRun {
+    uint8_t column;
+    uint8_t len;
+    TokenKind kind;
+  };
+  struct Line {
+    std::vector<PixelRun> runs;
+    /* state the line was lexed with, only valid if colored */
+    LexState state;
+    bool reduced;
+    /* the state at the start of the line was known when it was reduced */
+    bool colored;
+  };
+
+  Minimap(Highlighter &highlighter);
+  Minimap(Minimap const &) = delete;
+  Minimap &operator=(Minimap const &) = delete;
+  ~Minimap();
+
+  /* starts the worker thread, without it the image is only built by Build */
+  void Start(void);
+
+  /* sets the size of the image in pixels, every row is built again when it
+   * changes */
+  void Resize(uint w, uint h);
+  /* takes the edits made to buffer since the previous call, and changes to
+   * the highlighting, into account. Called on the thread which edits the
+   * buffer */
+  void Update(TextBuffer &buffer);
+
+  /* builds the rows which are out of date */
+  void Build(void);
+
+  /* rows of the image, handed out for uploading */
+  struct Rows {
+    /* size of the whole image */
+    uint w, h;
+    uint first_row;
+    uint num_rows;
+    /* number of lines which share a row */
+    size_t lines_per_row;
+    /* num_rows rows of w pixels */
+    std::vector<uint8_t> pixels;
+  };
+  /* sets rows to the rows which changed since the previous call, returns false
+   * if no row changed */
+  bool TakeChangedRows(Rows &rows);
+
+  /* false while there are edits or rows which were not handed out yet */
+  bool UpToDate(void);
+  Stats GetStats(void);
+
+private:
+  static constexpr uint kClean = UINT32_MAX;
+
+  void Work(void);
+  /* applies the edits to lines, returns the first line which moved or
+   * changed */
+  size_t ReplayEdits(const std::vector<TextBuffer::Edit> &edits,
+                     bool *lines_moved);
+  void ComposeRows(uint begin, uint end);
+
+  Highlighter &highlighter;
+
+  std::mutex mutex;
+  std::condition_variable work_available;
+  bool stopping;
+  std::thread worker;
+
+  /* inputs of the next build, taken by Build */
+  bool pending;
+  size_t epoch;
+  std::shared_ptr<const std::vector<TextBuffer::Span>> spans;
+  size_t num_lines;
+  /* edits since the previous build, and whether some were dropped from the
+   * log of the buffer so that every line has to be reduced again */
+  std::vector<TextBuffer::Edit> edits;
+  bool reset;
+  uint64_t highlighter_version;
+  uint w, h;
+  bool building;
+
+  /* copy of the image, and the rows of it which were not handed out yet */
+  std::vector<uint8_t> published;
+  uint published_w, published_h;
+  uint changed_begin;
+  uint changed_end;
+  size_t published_lines_per_row;
+  Stats stats;
+
+  /* only used by Build */
+  std::vector<Line> lines;
+  std::vector<uint8_t> image;
+  uint image_w, image_h;
+  size_t lines_per_row;
+  std::vector<LexState> states;
+};
@@ -0,0 +1,229 @@
+#include "Minimap.hxx"
+#include "Palette.hxx"
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+
+/* whole image, kept up to date from the changed rows */
+struct Image {
+  uint w = 0, h = 0;
+  size_t lines_per_row = 1;
+  std::vector<uint8_t> pixels;
+
+  /* returns false if no row changed */
+  bool Take(Minimap &minimap) {
+    Minimap::Rows rows;
+    if (!minimap.TakeChangedRows(rows))
+      return false;
+    const size_t row_bytes = rows.w * Minimap::kBytesPerPixel;
+    w = rows.w;
+    h = rows.h;
+    lines_per_row = rows.lines_per_row;
+    pixels.resize(h * row_bytes);
+    std::copy(rows.pixels.begin(), rows.pixels.end(),
+              pixels.begin() + rows.first_row * row_bytes);
+    last_rows = rows;
+    return true;
+  }
+
+  bool Ink(uint x, uint y) const {
+    return memcmp(At(x, y), &kMinimapBackground, Minimap::kBytesPerPixel) != 0;
+  }
+
+  const uint8_t *At(uint x, uint y) const {
+    return &pixels[((size_t)y * w + x) * Minimap::kBytesPerPixel];
+  }
+
+  Minimap::Rows last_rows;
+};
+
+static void Insert(TextBuffer &tb, size_t line, size_t col,
+                   std::string_view text) {
+  tb.InsertAt(tb.AtLineCol(line, col), text.begin(), text.end());
+}
+
+static void Sync(TextBuffer &tb, Highlighter &highlighter, Minimap &minimap) {
+  highlighter.Update(tb);
+  highlighter.Lex(SIZE_MAX);
+  minimap.Update(tb);
+  minimap.Build();
+}
+
+TEST_CASE("minimap", "[Minimap]") {
+  TextBuffer tb;
+  std::string_view source = "int x;\n  // comment\n\nreturn x;\n";
+  tb.InsertAt(tb.AtByteOffset(0), source.begin(), source.end());
+
+  Highlighter highlighter;
+  Minimap minimap(highlighter);
+  minimap.Resize(40, 100);
+  Sync(tb, highlighter, minimap);
+
+  Image image;
+  REQUIRE(image.Take(minimap));
+  REQUIRE(image.w == 40);
+  REQUIRE(image.h == 100);
+  REQUIRE(image.lines_per_row == 1);
+
+  /* one pixel per column, whitespace has no ink */
+  REQUIRE(image.Ink(0, 0));
+  REQUIRE(image.Ink(2, 0));
+  REQUIRE(!image.Ink(3, 0));
+  REQUIRE(image.Ink(4, 0));
+  REQUIRE(!image.Ink(6, 0));
+  REQUIRE(!image.Ink(0, 1));
+  REQUIRE(image.Ink(2, 1));
+  REQUIRE(!image.Ink(0, 2));
+  REQUIRE(!image.Ink(0, 4));
+
+  /* colored by token */
+  REQUIRE(memcmp(image.At(0, 0), image.At(4, 0), 4) != 0);
+  REQUIRE(memcmp(image.At(0, 0), image.At(0, 3), 4) != 0);
+
+  SECTION("only the rows of edited lines are handed out") {
+    Insert(tb, 3, 0, "  ");
+    Sync(tb, highlighter, minimap);
+    REQUIRE(image.Take(minimap));
+    REQUIRE(image.last_rows.first_row == 3);
+    REQUIRE(image.last_rows.num_rows == 1);
+    REQUIRE(!image.Ink(0, 3));
+    REQUIRE(image.Ink(2, 3));
+    REQUIRE(!image.Take(minimap));
+  }
+
+  SECTION("lines are colored again when their state changes") {
+    const uint8_t *before = image.At(0, 3);
+    std::vector<uint8_t> color(before, before + 4);
+    Insert(tb, 2, 0, "/*");
+    Sync(tb, highlighter, minimap);
+    REQUIRE(image.Take(minimap));
+    REQUIRE(image.Ink(0, 3));
+    REQUIRE(memcmp(image.At(0, 3), color.data(), 4) != 0);
+  }
+
+  SECTION("lines share rows once there are more than rows") {
+    minimap.Resize(40, 2);
+    Sync(tb, highlighter, minimap);
+    REQUIRE(image.Take(minimap));
+    REQUIRE(image.h == 2);
+    REQUIRE(image.lines_per_row == 3);
+    REQUIRE(image.Ink(2, 0));
+    REQUIRE(image.Ink(0, 1));
+  }
+}
+
+TEST_CASE("minimap edits", "[Minimap]") {
+  TextBuffer tb;
+  std::string source;
+  for (int i = 0; i < 300; i++) {
+    source += i % 7 == 0 ? "/* note\n" : i % 7 == 3 ? "  done */\n"
+                                                     : "  int v = 1;\n";
+  }
+  tb.InsertAt(tb.AtByteOffset(0), source.begin(), source.end());
+
+  /* large enough for a row per line, and small enough for shared rows */
+  const uint height = GENERATE(400, 64);
+
+  Highlighter highlighter;
+  Minimap minimap(highlighter);
+  minimap.Resize(32, height);
+  Sync(tb, highlighter, minimap);
+  Image image;
+  image.Take(minimap);
+
+  std::mt19937 rng(5);
+  const std::string_view snippets[] = {"/*", "*/", "\n", "x", "  ", "\n\n"};
+  for (int i = 0; i < 100; i++) {
+    for (int j = 0; j < 1 + i % 3; j++) {
+      const size_t line = rng() % (tb.num_lines + 1);
+      Insert(tb, line, 0, snippets[rng() % 6]);
+    }
+    Sync(tb, highlighter, minimap);
+    image.Take(minimap);
+
+    /* the same as an image built from scratch */
+    Minimap reference(highlighter);
+    reference.Resize(32, height);
+    reference.Update(tb);
+    reference.Build();
+    Image expected;
+    REQUIRE(expected.Take(reference));
+    REQUIRE(image.lines_per_row == expected.lines_per_row);
+    REQUIRE(image.pixels == expected.pixels);
+  }
+}
+
+TEST_CASE("minimap worker", "[Minimap]") {
+  TextBuffer tb;
+  std::string source;
+  for (int i = 0; i < 20000; i++) {
+    source += "static int value = 0; // line\n";
+  }
+  tb.InsertAt(tb.AtByteOffset(0), source.begin(), source.end());
+
+  Highlighter highlighter;
+  highlighter.Start();
+  Minimap minimap(highlighter);
+  minimap.Start();
+  minimap.Resize(64, 512);
+
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  Image image;
+  while (std::chrono::steady_clock::now() < deadline) {
+    highlighter.Update(tb);
+    minimap.Update(tb);
+    image.Take(minimap);
+    if (highlighter.UpToDate() && minimap.UpToDate())
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  REQUIRE(minimap.UpToDate());
+  REQUIRE(image.h == 512);
+  REQUIRE(image.lines_per_row == 40);
+  REQUIRE(image.Ink(0, 499));
+}
+
+TEST_CASE("minimap performance", "[Minimap]") {
+  TextBuffer tb;
+  std::string source;
+  for (int i = 0; i < 500000; i++) {
+    source += i % 4 == 0 ? "/* a comment about the value */\n"
+                         : "  static int value" + std::to_string(i) + " = 0;\n";
+  }
+  tb.InsertAt(tb.AtByteOffset(0), source.begin(), source.end());
+
+  Highlighter highlighter;
+  highlighter.Update(tb);
+  highlighter.Lex(SIZE_MAX);
+
+  BENCHMARK("build 500k lines") {
+    Minimap minimap(highlighter);
+    minimap.Resize(120, 1000);
+    minimap.Update(tb);
+    minimap.Build();
+    return minimap.GetStats().lines_reduced;
+  };
+
+  Minimap minimap(highlighter);
+  minimap.Resize(120, 1000);
+  Sync(tb, highlighter, minimap);
+  Minimap::Rows rows;
+  minimap.TakeChangedRows(rows);
+
+  BENCHMARK("single character edit in 500k lines") {
+    Insert(tb, tb.num_lines / 2, 2, "x");
+    Sync(tb, highlighter, minimap);
+    return minimap.TakeChangedRows(rows);
+  };
+
+  BENCHMARK("new line in 500k lines") {
+    Insert(tb, tb.num_lines / 2, 2, "\n");
+    Sync(tb, highlighter, minimap);
+    return minimap.TakeChangedRows(rows);
+  };
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../Render/Types.hxx"
+#include "../Syntax/Lexer.hxx"
+
+/* colors shared by the views */
+constexpr Color kEditorBackground = RGB(0xf7f4ef);
+constexpr Color kMinimapBackground = RGB(0xefebe4);
+
+constexpr Color kTokenColors[kNumTokenKinds] = {
+    /* kTokenDefault */ RGB(0x111111),
+    /* kTokenKeyword */ RGB(0x7a3e9d),
+    /* kTokenType */ RGB(0x2a6f97),
+    /* kTokenComment */ RGB(0x8a8580),
+    /* kTokenString */ RGB(0x4b7a2a),
+    /* kTokenNumber */ RGB(0xb05a1e),
+    /* kTokenPreprocessor */ RGB(0x9c4a6f)};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Render/RenderContext.hxx"
+#include <algorithm>
 /* TODO: move types in Render/Types.hxx */
 
 // only the parent of a view can increase the size of it's region,
@@ -16,15 +17,63 @@ struct View {
   /* TODO: should this be passed as a reference? why not just global editor/draw
    * state */
   virtual void draw(RenderContext &) = 0;
+  /* Only the damaged regions of the window are redrawn, and those may overlap
+   * views which did not change, as may the repair region of the render
+   * context. Views which skip pushing their quads when nothing changed push
+   * them on the next draw after Invalidate */
+  virtual void Invalidate(void) {}
   /* TODO: handle_event */
   virtual ~View() {}
 };
 
 /*
 ViewScrollable
-ViewSplit
 */
 
+/* places a side view of fixed width to the right of the main view. The side
+ * view is drawn first, so that the main view can be invalidated before it
+ * draws if the side view damaged the window, or if it overlaps the repair
+ * region of a frame with damage. The side view has to push its quads on every
+ * draw */
+class ViewSplit : public View {
+  View &main;
+  View &side;
+  int side_w;
+
+public:
+  ViewSplit(View &main_view, View &side_view, int side_width)
+      : main(main_view), side(side_view), side_w(side_width) {
+    is_animating = true;
+  };
+
+  virtual void draw(RenderContext &render) {
+    const int w = std::max(viewport.w - side_w, 0);
+    main.viewport = {viewport.x, viewport.y, w, viewport.h};
+    side.viewport = {viewport.x + w, viewport.y, viewport.w - w, viewport.h};
+
+    const size_t damage = render.damage.size();
+    const bool damage_all = render.damage_all;
+    side.draw(render);
+    /* the main view only adds damage if it changed, in which case it pushes
+     * its quads anyway. Frames without damage are not presented, so nothing
+     * is repaired in them */
+    const bool repaired =
+        (!render.damage.empty() || render.damage_all) &&
+        !render.RepairRegion().intersected(main.viewport).empty();
+    if (render.damage.size() != damage || render.damage_all != damage_all ||
+        repaired) {
+      main.Invalidate();
+    }
+    main.draw(render);
+    is_animating = main.is_animating || side.is_animating;
+  }
+
+  virtual void Invalidate(void) {
+    main.Invalidate();
+    side.Invalidate();
+  }
+};
+
 class ViewRoot : public View {
   View &child;
 
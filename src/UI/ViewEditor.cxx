@@ -1,4 +1,7 @@
 #include "ViewEditor.hxx"
+#include "../TextBuffer/CodepointReader.hxx"
+#include "../Util/Profile.hxx"
+#include "Palette.hxx"
 #include "SDL_opengl_glext.h"
 #include "src/Render/Types.hxx"
 #include <cassert>
@@ -59,102 +62,126 @@ void ViewEditor::PageUp(void) { ScrollLines(-viewport.h / font.line_height); }
 
 void ViewEditor::PageDown(void) { ScrollLines(viewport.h / font.line_height); }
 
-int NumDigits(size_t num) {
-  int len = 1;
-  while (num /= 10)
-    len++;
-  return len;
+int ViewEditor::CalculateGutterWidth(void) {
+  return gutter.Width(buffer.num_lines);
 }
 
-int ViewEditor::CalculateGutterWidth(void) {
-  const int digit_width = font.glyphs['0'].advance;
-  assert(digit_width > 0);
-  const int line_no_digits = 2 + NumDigits(buffer.num_lines);
-  /* 2 digit padding */
-  return digit_width * (line_no_digits + 2);
+ViewEditor::RowCheckpoints *ViewEditor::FindCheckpoints(size_t line) {
+  for (size_t i = 0; i < num_checkpoint_lines; i++) {
+    if (checkpoints[i].line == line)
+      return &checkpoints[i];
+  }
+  return nullptr;
 }
 
-void ViewEditor::NormalizeCursor(void) {
+ViewEditor::RowPosition ViewEditor::SeekRow(size_t line, size_t row) {
   const int textarea_w = viewport.w - CalculateGutterWidth();
 
-  float x = 0;
-  uint16_t current_line_height = font.line_height;
-
-  TextBuffer::iterator iter = buffer.AtLineCol(first_line, 0);
-
-  if (first_line == 0 && offset_px < 0) {
-    offset_px = 0;
-    return;
+  const Hash inputs = Hasher().add(buffer.epoch).add(textarea_w);
+  const bool full = num_checkpoint_lines == kMaxCheckpointLines &&
+                    FindCheckpoints(line) == nullptr;
+  if (inputs != checkpoints_inputs || full) {
+    checkpoints_inputs = inputs;
+    num_checkpoint_lines = 0;
   }
+  RowCheckpoints *found = FindCheckpoints(line);
+  if (found == nullptr) {
+    if (num_checkpoint_lines == checkpoints.size()) {
+      checkpoints.emplace_back();
+    }
+    found = &checkpoints[num_checkpoint_lines++];
+    found->line = line;
+    found->offsets.assign(1, 0);
+    found->num_rows = 0;
+    found->last_line = false;
+  }
+  RowCheckpoints &line_checkpoints = *found;
+  if (line_checkpoints.num_rows > 0)
+    row = std::min(row, line_checkpoints.num_rows - 1);
+
+  /* resume from the closest row known to start before the requested one */
+  std::vector<size_t> &offsets = line_checkpoints.offsets;
+  const size_t checkpoint = std::min(row / kCheckpointRows, offsets.size() - 1);
+  size_t current_row = checkpoint * kCheckpointRows;
+  size_t offset = offsets[checkpoint];
+  size_t row_offset = offset;
+  bool line_ended = false;
+
+  CodepointReader reader(buffer.AtLineCol(line, offset));
+  float x = 0;
 
-  if (offset_px > 0) {
-    while (!iter.IsEOF()) {
-      uint8_t c = *iter;
-      iter++;
-
-      if (iter.IsEOF()) {
-        offset_px = std::min(offset_px, (int64_t)current_line_height);
-        break;
-      }
-
-      if (c == '\n') {
-        if (offset_px > current_line_height) {
-          first_line++;
-          offset_px -= current_line_height;
-        } else {
-          break;
-        }
-        x = 0;
-        current_line_height = font.line_height;
-        continue;
-      }
-
-      if (!isprint(c)) {
-        c = '?';
-      }
+  auto place = [&](uint32_t c, size_t len) {
+    if (c == '\n') {
+      line_ended = true;
+      return;
+    }
 
-      float advance = font.glyphs[c].advance;
-      if (x + advance >= textarea_w) {
-        x = advance;
-        current_line_height += font.line_height;
-        continue;
+    float advance = font.CharAdvance(c);
+    if (x + advance >= textarea_w) {
+      x = advance;
+      current_row++;
+      row_offset = offset;
+      if (current_row == offsets.size() * kCheckpointRows) {
+        offsets.push_back(row_offset);
       }
-
+    } else {
       x += advance;
     }
-  } else if (offset_px < 0) {
-    /* skip newline and first char (?) */
-    iter--;
-    iter--;
-    while (iter != buffer.begin()) {
-      uint8_t c = *iter;
-      iter--;
-
-      if (c == '\n' || iter == buffer.begin()) {
-        if (offset_px < 0) {
-          first_line--;
-          offset_px += current_line_height;
-        } else {
-          break;
-        }
-        x = 0;
-        current_line_height = font.line_height;
-        continue;
-      }
+    offset += len;
+  };
+
+  while (current_row < row && !line_ended && !reader.Done()) {
+    const ConstView<uint8_t> ascii = reader.PeekASCII(256);
+    size_t i = 0;
+    for (; i < ascii.len && current_row < row && !line_ended; i++) {
+      place(ascii.begin[i], 1);
+    }
+    if (i > 0) {
+      reader.Skip(i);
+      continue;
+    }
 
-      if (!isprint(c)) {
-        c = '?';
-      }
+    size_t len;
+    const uint32_t c = reader.Next(&len);
+    place(c, len);
+  }
 
-      float advance = font.glyphs[c].advance;
-      if (x + advance >= textarea_w) {
-        x = advance;
-        current_line_height += font.line_height;
-        continue;
-      }
+  if (current_row < row) {
+    line_checkpoints.num_rows = current_row + 1;
+    line_checkpoints.last_line = !line_ended;
+  }
+  return {buffer.AtLineCol(line, row_offset), current_row, row_offset,
+          line_checkpoints.last_line};
+}
 
-      x += advance;
+ViewEditor::RowPosition ViewEditor::NormalizeCursor(void) {
+  PROFILE_ZONE("NormalizeCursor");
+  const int64_t line_height = font.line_height;
+
+  /* scrolling up moves into the last rows of the previous lines */
+  while (offset_px < 0 && first_line > 0) {
+    first_line--;
+    const size_t rows = SeekRow(first_line, SIZE_MAX).row + 1;
+    offset_px += rows * line_height;
+  }
+  if (offset_px < 0)
+    offset_px = 0;
+
+  /* scrolling down moves past the rows of first_line, only the rows up to the
+   * one at the top of the viewport are laid out */
+  while (true) {
+    const size_t row = offset_px / line_height;
+    const RowPosition start = SeekRow(first_line, row);
+    if (start.row == row)
+      return start;
+
+    if (start.last_line) {
+      /* keep the last row in view */
+      offset_px = start.row * line_height;
+      return start;
     }
+    first_line++;
+    offset_px -= (start.row + 1) * line_height;
   }
 }
 
@@ -169,56 +196,105 @@ void ViewEditor::UpdateLayout(void) {
   if (inputs == layout_inputs)
     return;
   layout_inputs = inputs;
+  PROFILE_ZONE("UpdateLayout");
 
-  NormalizeCursor();
+  const RowPosition start = NormalizeCursor();
+  first_row = start.row;
+  first_row_offset = start.offset;
+  layout_start = start.pos;
   layout.clear();
   layout_version++;
 
   const int textarea_w = viewport.w - CalculateGutterWidth();
 
-  /* cache line length based on hash of line? probably not worth it*/
-  /* TODO: normalize offset px */
-  int y = -offset_px;
-  TextBuffer::iterator iter = buffer.AtLineCol(first_line, 0);
+  int y = -RowOffsetPx();
+  CodepointReader reader(layout_start);
   float x = 0;
-  uint16_t run_bytes = 0;
-  uint16_t current_line_height = 0;
-  bool logical_line_next = true;
-
-  while (y < viewport.h && !iter.IsEOF()) {
-    uint8_t c = *iter;
-    iter++;
+  size_t run_bytes = 0;
+  bool logical_line_next = first_row == 0;
 
+  auto place = [&](uint32_t c, size_t len) {
     if (c == '\n') {
       y += font.line_height;
-      current_line_height += font.line_height;
       layout.push_back({logical_line_next, true, run_bytes});
       x = 0, run_bytes = 0;
-      current_line_height = 0;
       logical_line_next = true;
-      continue;
+      return;
     }
 
-    if (!isprint(c)) {
-      c = '?';
-    }
-
-    float advance = font.glyphs[c].advance;
+    float advance = font.CharAdvance(c);
     if (x + advance >= textarea_w) {
       layout.push_back({logical_line_next, false, run_bytes});
-      x = advance, run_bytes = 1;
+      x = advance, run_bytes = len;
       y += font.line_height;
-      current_line_height += font.line_height;
       logical_line_next = false;
-      continue;
+      return;
     }
 
     x += advance;
-    run_bytes++;
+    run_bytes += len;
+  };
+
+  while (y < viewport.h && !reader.Done()) {
+    /* ASCII is placed straight from the buffer, only other codepoints are
+     * decoded */
+    const ConstView<uint8_t> ascii = reader.PeekASCII(256);
+    size_t i = 0;
+    for (; i < ascii.len && y < viewport.h; i++) {
+      place(ascii.begin[i], 1);
+    }
+    if (i > 0) {
+      reader.Skip(i);
+      continue;
+    }
+
+    size_t len;
+    const uint32_t c = reader.Next(&len);
+    place(c, len);
   }
 }
 
+void ViewEditor::DrawLineNumbers(RenderContext &render) {
+  if (!gutter.ShapeDigits())
+    return;
+
+  /* the number of a line is drawn on its first row. The numbers are placed
+   * relative to the top of the first row, so they only change when other
+   * lines start in the layout */
+  const size_t first_number = first_line + (first_row > 0) + 1;
+  Hasher key;
+  key.add((uintptr_t)&gutter)
+      .add((int)LayerText)
+      .add(font.Epoch())
+      .add(first_number);
+  for (size_t i = 0; i < layout.size(); i++) {
+    if (layout[i].starts_line) {
+      key.add(i);
+    }
+  }
+
+  /* the digit width is up to date, as the gutter width is taken first */
+  const Point origin = {viewport.x + gutter.digit_width,
+                        viewport.y - RowOffsetPx()};
+  if (render.DrawRetained(key, origin)) {
+    gutter.TouchDigits();
+    return;
+  }
+
+  render.BeginRetained(key, origin);
+  Gutter::Counter number(first_number);
+  for (size_t i = 0; i < layout.size(); i++) {
+    if (!layout[i].starts_line)
+      continue;
+    gutter.DrawNumber(LayerText, {0, (int)(i * font.line_height)}, number,
+                      kTokenColors[kTokenDefault]);
+    number.Increment();
+  }
+  render.EndRetained();
+}
+
 void ViewEditor::draw(RenderContext &render) {
+  PROFILE_ZONE("ViewEditor::draw");
   /* apply scroll velocity TODO: frame update vs draw */
   constexpr double anim_factor = 3;
   int64_t move_amount = (target_px - progress_target) / anim_factor;
@@ -231,8 +307,14 @@ void ViewEditor::draw(RenderContext &render) {
   }
   ScrollPx(move_amount);
 
+  /* place glyphs which finished rasterizing, and keep drawing until the
+   * placeholders are replaced */
+  font.Update();
+  /* lines are drawn again as the highlighter catches up */
+  highlighter.Update(buffer);
   /* TODO: caching */
-  is_animating = target_px != 0;
+  is_animating =
+      target_px != 0 || font.GlyphsPending() || !highlighter.UpToDate();
 
   UpdateLayout();
 
@@ -242,72 +324,219 @@ void ViewEditor::draw(RenderContext &render) {
                     .add(offset_px)
                     .add(first_line)
                     .add(buffer.epoch)
-                    .add(viewport.w)
-                    .add(viewport.h)
-                    .add(viewport.x)
-                    .add(viewport.y);
+                    .add(viewport)
+                    .add(cursor->span_idx)
+                    .add(cursor->byte_offset)
+                    .add(font.Epoch())
+                    .add(highlighter.Version());
 
   if (inputs == render_inputs)
     return;
 
-  inputs = render_inputs;
+  render_inputs = inputs;
 
-  const int digit_width = font.glyphs['0'].advance;
   const int gutter_width = CalculateGutterWidth();
-  render.DrawRect(LayerBg, viewport, RGB(0xf7f4ef));
+
+  /* scrolling or resizing moves every line, and glyphs changing in the atlas
+   * may affect any line, otherwise only the lines which changed since the
+   * previous draw are damaged */
+  const Hash frame_inputs = Hasher()
+                                .add(offset_px)
+                                .add(first_line)
+                                .add(viewport)
+                                .add(gutter_width)
+                                .add(font.Epoch());
+  const bool damage_all = frame_inputs != drawn_frame;
+  drawn_frame = frame_inputs;
+  if (damage_all) {
+    render.AddDamage(viewport);
+  }
+  /* glyphs extend below their line, and the cursor is drawn slightly lower */
+  auto damageLine = [&](size_t i) {
+    const int line_y =
+        viewport.y - RowOffsetPx() + (int)i * (int)font.line_height;
+    render.AddDamage(
+        {viewport.x, line_y, viewport.w, (int)font.line_height * 3 / 2});
+  };
+  render.DrawRect(LayerBg, viewport, kEditorBackground);
   render.DrawRect(LayerGutter,
                   {viewport.x, viewport.y, gutter_width, viewport.h}, Dim(0.1));
-
-  int y = viewport.y - offset_px;
-  size_t line_num = first_line;
-  TextBuffer::iterator iter = buffer.AtLineCol(first_line, 0);
-  std::string run;
-
-  for (VisualLine line : layout) {
+  DrawLineNumbers(render);
+
+  int y = viewport.y - RowOffsetPx();
+  /* the number of a line is drawn on its first row */
+  size_t line_num = first_line + (first_row > 0);
+  CodepointReader reader(layout_start);
+  /* the text of a visual line and its colors only live until the frame is
+   * committed */
+  ArenaString run(render.frame_arena);
+  ArenaVector<ColorRun> colors(render.frame_arena);
+  /* index into tokens, and the byte offset of the visual line within its
+   * logical line */
+  size_t token_idx = 0;
+  size_t row_offset = first_row_offset;
+
+  drawn_lines.resize(std::max(drawn_lines.size(), layout.size()), 0);
+  for (size_t line_idx = 0; line_idx < layout.size(); line_idx++) {
+    const VisualLine line = layout[line_idx];
+    const bool visible = y + (int)font.line_height >= viewport.y;
+    Hasher line_state;
     if (line.starts_line) {
-      drawRun(viewport.x + digit_width, y, std::to_string(line_num + 1));
+      line_state.add(line_num);
       line_num++;
+      row_offset = 0;
     }
 
+    /* lex the line up to the end of its last visible row */
+    if (line.starts_line || line_idx == 0) {
+      size_t visible_end = row_offset;
+      for (size_t k = line_idx; k < layout.size(); k++) {
+        visible_end += layout[k].len_bytes;
+        if (layout[k].ends_line)
+          break;
+      }
+      tokens.clear();
+      token_idx = 0;
+      if (row_offset < kMaxHighlightBytes) {
+        highlighter.LineTokens(line_num - 1,
+                               std::min(visible_end, kMaxHighlightBytes),
+                               tokens, render.frame_arena);
+      }
+    }
+    /* starts a color run if the token kind changes at pos */
+    auto color = [&](size_t pos) {
+      while (token_idx < tokens.size() &&
+             tokens[token_idx].offset + tokens[token_idx].len <= pos) {
+        token_idx++;
+      }
+      TokenKind kind = kTokenDefault;
+      if (token_idx < tokens.size() && tokens[token_idx].offset <= pos) {
+        kind = tokens[token_idx].kind;
+      }
+      if (colors.empty() || colors.back().kind != kind) {
+        colors.push_back({run.size(), kind});
+      }
+    };
+
     float x = 0;
     run.clear();
-    for (uint16_t i = 0; i < line.len_bytes + line.ends_line; i++) {
-      uint8_t c = *iter;
-      if (iter == *cursor) {
-        render.DrawRect(LayerCursor,
-                        {viewport.x + gutter_width + (int)x, y + 4, 2,
-                         (int)font.line_height},
-                        RGB(0x555555));
+    colors.clear();
+    auto drawCursor = [&](size_t i) {
+      line_state.add(i);
+      render.DrawRect(LayerCursor,
+                      {viewport.x + gutter_width + (int)x, y + 4, 2,
+                       (int)font.line_height},
+                      RGB(0x555555));
+    };
+
+    const size_t line_end = line.len_bytes + line.ends_line;
+    for (size_t i = 0; i < line_end && !reader.Done();) {
+      /* runs of ASCII are copied as they are, and lie within a single span */
+      const ConstView<uint8_t> ascii = reader.PeekASCII(line_end - i);
+      if (ascii.len > 0) {
+        const TextBuffer::iterator &pos = reader.pos;
+        const size_t cursor_k = cursor->span_idx == pos.span_idx
+                                    ? cursor->byte_offset - pos.byte_offset
+                                    : SIZE_MAX;
+        for (size_t k = 0; k < ascii.len; k++) {
+          if (k == cursor_k) {
+            drawCursor(i + k);
+          }
+          uint8_t c = ascii.begin[k];
+          if (c == '\n')
+            continue;
+          if (!isprint(c))
+            c = '?';
+          color(row_offset + i + k);
+          run.push_back(c);
+          x += font.CharAdvance(c);
+        }
+        i += ascii.len;
+        reader.Skip(ascii.len);
+        continue;
       }
-      iter++;
 
-      if (c == '\n')
-        continue;
-      if (!isprint(c))
-        c = '?';
+      /* the cursor may be placed inside of a sequence */
+      const TextBuffer::iterator start = reader.pos;
+      size_t len;
+      const uint32_t c = reader.Next(&len);
+      if (start <= *cursor && *cursor < reader.pos) {
+        drawCursor(i);
+      }
+      color(row_offset + i);
+      i += len;
 
-      run.push_back(c);
-      x += font.glyphs[c].advance;
+      /* invalid sequences are drawn as U+FFFD */
+      EncodeUTF8(c, run);
+      x += font.CharAdvance(c);
     }
     /* skip newline TODO: handle cursor at end of line */
+    row_offset += line.len_bytes;
+
+    /* the glyphs of a line only depend on it's contents, so they are retained
+     * across frames and only moved when scrolling. Evicting glyphs from the
+     * atlas moves other glyphs into their place, and glyphs which did not fit
+     * are missing, so both invalidate every retained line */
+    if (visible) {
+      const Point origin = {viewport.x + gutter_width, y};
+      Hasher line_key;
+      line_key.add((uintptr_t)&font)
+          .add((int)LayerText)
+          .add(font.Epoch());
+      line_key.add(run);
+      for (const ColorRun &color_run : colors) {
+        line_key.add(color_run.offset).add((int)color_run.kind);
+      }
+      if (render.DrawRetained(line_key, origin)) {
+        for (const ShapedGlyph &glyph : shapes.Shape(font, run).glyphs) {
+          font.TouchGlyph(glyph.glyph_id);
+        }
+      } else {
+        render.BeginRetained(line_key, origin);
+        drawRun(0, 0, run, colors);
+        render.EndRetained();
+      }
+    }
 
-    drawRun(viewport.x + gutter_width, y, run);
+    line_state.add(run);
+    for (const ColorRun &color_run : colors) {
+      line_state.add(color_run.offset).add((int)color_run.kind);
+    }
+    const Hash state = line_state;
+    if (state != drawn_lines[line_idx] && !damage_all) {
+      damageLine(line_idx);
+    }
+    drawn_lines[line_idx] = state;
     y += font.line_height;
   }
 
+  /* lines which were drawn previously, but no longer exist */
+  for (size_t line_idx = layout.size(); line_idx < drawn_lines.size();
+       line_idx++) {
+    if (!damage_all) {
+      damageLine(line_idx);
+    }
+  }
+  drawn_lines.resize(layout.size());
+
   /* TODO: use transaction grouping to minimize per edit
    * calculations where we dont care about the intermediate steps */
 }
 
-void ViewEditor::drawRun(int x, int y, const std::string &run) {
-  if (y + (int)font.line_height < viewport.y)
-    return;
-  float pos = x;
-  for (size_t i = 0; i < run.size(); i++) {
-    if (isprint(run[i])) {
-      font.DrawGlyph(LayerText, {(int)pos, y + (int)font.line_height}, run[i],
-                     RGB(0x111111));
-      pos += font.glyphs[run[i]].advance;
+void ViewEditor::drawRun(int x, int y, std::string_view run,
+                         std::span<const ColorRun> colors) {
+  /* clusters increase along the run, as only left to right text is shaped */
+  size_t color_idx = 0;
+  for (const ShapedGlyph &glyph : shapes.Shape(font, run).glyphs) {
+    while (color_idx + 1 < colors.size() &&
+           colors[color_idx + 1].offset <= glyph.cluster) {
+      color_idx++;
     }
+    const TokenKind kind =
+        colors.empty() ? kTokenDefault : colors[color_idx].kind;
+    font.DrawGlyph(LayerText,
+                   {(int)(x + glyph.x),
+                    (int)(y + glyph.y) + (int)font.line_height},
+                   glyph.glyph_id, kTokenColors[kind]);
   }
 }
\ No newline at end of file
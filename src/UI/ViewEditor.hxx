@@ -1,14 +1,22 @@
 #pragma once
 
 #include "../Render/RenderFont.hxx"
+#include "../Render/ShapeCache.hxx"
+#include "../Syntax/Highlighter.hxx"
 #include "../TextBuffer/TextBuffer.hxx"
 #include "../Util/Hash.hxx"
+#include "Gutter.hxx"
 #include "View.hxx"
 #include <memory>
+#include <span>
+#include <string_view>
 
 struct ViewEditor : View {
   RenderFont &font;
+  ShapeCache &shapes;
+  Highlighter &highlighter;
   TextBuffer &buffer;
+  Gutter gutter;
   /* current scroll info */
   size_t first_line; /* TODO: handle being out of range, maybe use an iterator
                         for it */
@@ -17,25 +25,81 @@ struct ViewEditor : View {
   struct VisualLine {
     bool starts_line;
     bool ends_line;
-    uint16_t len_bytes;
+    /* lines may be longer than 64KiB, e.g. minified files */
+    size_t len_bytes;
   };
 
-  /* array of visual lines */
+  /* start of a visual line (row) within a logical line */
+  struct RowPosition {
+    TextBuffer::iterator pos;
+    size_t row;
+    /* byte offset of the row within the line */
+    size_t offset;
+    /* set when the logical line was laid out to the end of the buffer */
+    bool last_line;
+  };
+
+  /* Long lines, e.g. in minified files, may wrap into many thousands of rows.
+   * Layout starts at the row at the top of the viewport rather than at the
+   * start of first_line, and resumes from checkpoints of the byte offset of
+   * every kCheckpointRows'th row of a line. A row always starts at x = 0, so
+   * the offset is all of the wrap state needed. Scrolling across the start of
+   * a line lays out the previous one to its end, so the checkpoints of more
+   * than one line are kept */
+  static constexpr size_t kCheckpointRows = 64;
+  static constexpr size_t kMaxCheckpointLines = 64;
+  struct RowCheckpoints {
+    size_t line;
+    std::vector<size_t> offsets;
+    /* once the line was laid out to its end */
+    size_t num_rows;
+    bool last_line;
+  };
+  /* the first num_checkpoint_lines are in use. The offsets of the others are
+   * kept, so that laying out lines while scrolling does not allocate */
+  std::vector<RowCheckpoints> checkpoints;
+  size_t num_checkpoint_lines;
+  /* buffer version and text area width the checkpoints are valid for */
+  Hash checkpoints_inputs;
+
+  /* array of visual lines, starting at first_row of first_line */
   std::vector<VisualLine> layout;
   uint64_t layout_version;
   Hash layout_inputs;
+  size_t first_row;
+  size_t first_row_offset;
+  TextBuffer::iterator layout_start;
+
+  /* Token kinds of the bytes of a visual line, starting at offset within the
+   * string drawn for it. Lines are only lexed up to kMaxHighlightBytes, the
+   * rest of longer lines is drawn without highlighting */
+  struct ColorRun {
+    size_t offset;
+    TokenKind kind;
+  };
+  static constexpr size_t kMaxHighlightBytes = 1 << 20;
+  /* tokens of the logical line being drawn, kept to reuse their memory */
+  std::vector<Token> tokens;
 
   /* scroll animation */
   double target_px;
   double progress_target;
 
   Hash render_inputs;
+  /* inputs which move every visual line when changed, as well as the contents
+   * of each visual line as of the previous draw, used to report damage */
+  Hash drawn_frame;
+  std::vector<Hash> drawn_lines;
 
   std::shared_ptr<TextBuffer::iterator> cursor;
 
-  ViewEditor(RenderFont &font, TextBuffer &buffer)
-      : font(font), buffer(buffer), first_line(0), offset_px(0),
-        layout_version(0), target_px(0), progress_target(0) {
+  ViewEditor(RenderFont &font, ShapeCache &shapes, Highlighter &highlighter,
+             TextBuffer &buffer)
+      : font(font), shapes(shapes), highlighter(highlighter), buffer(buffer),
+        gutter(font, shapes), first_line(0), offset_px(0),
+        num_checkpoint_lines(0), checkpoints_inputs(0), layout_version(0),
+        first_row(0), first_row_offset(0), layout_start(buffer.begin()),
+        target_px(0), progress_target(0), drawn_frame(0) {
     is_animating = true;
   };
 
@@ -45,8 +109,20 @@ struct ViewEditor : View {
   void PageDown(void);
 
   int CalculateGutterWidth(void);
-  void NormalizeCursor(void);
+  RowPosition SeekRow(size_t line, size_t row);
+  /* returns nullptr if the line has no checkpoints */
+  RowCheckpoints *FindCheckpoints(size_t line);
+  RowPosition NormalizeCursor(void);
+  /* offset of the first visual line above the viewport */
+  int RowOffsetPx(void) const {
+    return offset_px - (int64_t)(first_row * font.line_height);
+  }
   void UpdateLayout(void);
+  /* draws the numbers of the lines which start in the layout. They only move
+   * with the text, so they are retained until other lines are in view */
+  void DrawLineNumbers(RenderContext &render);
   virtual void draw(RenderContext &render);
-  void drawRun(int x, int y, const std::string &);
+  virtual void Invalidate(void) { render_inputs = 0; }
+  void drawRun(int x, int y, std::string_view,
+               std::span<const ColorRun> colors = {});
 };
\ No newline at end of file
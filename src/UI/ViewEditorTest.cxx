@@ -0,0 +1,204 @@
+#include "ViewEditor.hxx"
+#include "../Util/Profile.hxx"
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <string_view>
+
+/* every character is 10px wide and rows are 20px high. With a gutter of 5
+ * digits for buffers of less than 10 lines, a 155px wide view fits 10
+ * characters per row */
+struct LayoutFixture {
+  static constexpr int kCharsPerRow = 10;
+  static constexpr int64_t kRowHeight = 20;
+
+  RenderFont font;
+  ShapeCache shapes;
+  Highlighter highlighter;
+  TextBuffer buffer;
+  ViewEditor view;
+
+  LayoutFixture(std::string_view text)
+      : shapes(1 << 20), view(font, shapes, highlighter, buffer) {
+    for (float &advance : font.ascii_advances) {
+      advance = 10;
+    }
+    font.line_height = kRowHeight;
+    view.viewport = {0, 0, 155, 200};
+    buffer.InsertAt(buffer.begin(), text.cbegin(), text.cend());
+  }
+
+  void Insert(size_t line, std::string_view text) {
+    buffer.InsertAt(buffer.AtLineCol(line, 0), text.cbegin(), text.cend());
+  }
+};
+
+TEST_CASE("seeking into long lines", "[ViewEditor]") {
+  /* 4MiB of text in the second line, wrapped into 419431 rows */
+  const size_t long_len = 4 << 20;
+  LayoutFixture f("a\n" + std::string(long_len, 'x') + "\nb\n");
+  ViewEditor &view = f.view;
+
+  const ViewEditor::RowPosition deep = view.SeekRow(1, 300'000);
+  REQUIRE(deep.row == 300'000);
+  REQUIRE(deep.offset == 300'000 * LayoutFixture::kCharsPerRow);
+  REQUIRE(!deep.last_line);
+  REQUIRE(*deep.pos == 'x');
+
+  /* a checkpoint was stored every kCheckpointRows rows on the way */
+  const std::vector<size_t> &offsets = view.FindCheckpoints(1)->offsets;
+  REQUIRE(offsets.size() == 300'000 / ViewEditor::kCheckpointRows + 1);
+  for (size_t i = 0; i < offsets.size(); i++) {
+    REQUIRE(offsets[i] ==
+            i * ViewEditor::kCheckpointRows * LayoutFixture::kCharsPerRow);
+  }
+
+  SECTION("seeks resume from the closest checkpoint") {
+    /* moving a checkpoint moves the rows seeked to from it, but no others */
+    const size_t checkpoint = 200'000 / ViewEditor::kCheckpointRows;
+    view.FindCheckpoints(1)->offsets[checkpoint] += 1;
+    REQUIRE(view.SeekRow(1, 200'000).offset ==
+            200'000 * LayoutFixture::kCharsPerRow + 1);
+    REQUIRE(view.SeekRow(1, 100'000).offset ==
+            100'000 * LayoutFixture::kCharsPerRow);
+  }
+
+  SECTION("seeking past the end of a line stops at its last row") {
+    const size_t last_row = long_len / LayoutFixture::kCharsPerRow;
+    const ViewEditor::RowPosition end = view.SeekRow(1, SIZE_MAX);
+    REQUIRE(end.row == last_row);
+    REQUIRE(end.offset == last_row * LayoutFixture::kCharsPerRow);
+    REQUIRE(!end.last_line);
+    REQUIRE(view.FindCheckpoints(1)->num_rows == last_row + 1);
+
+    /* and is known from then on */
+    REQUIRE(view.SeekRow(1, last_row + 10).row == last_row);
+  }
+
+  SECTION("the top of the viewport is laid out from its row") {
+    view.first_line = 1;
+    view.offset_px = 300'000 * LayoutFixture::kRowHeight + 5;
+    view.UpdateLayout();
+    REQUIRE(view.first_line == 1);
+    REQUIRE(view.first_row == 300'000);
+    REQUIRE(view.first_row_offset == 300'000 * LayoutFixture::kCharsPerRow);
+    REQUIRE(view.RowOffsetPx() == 5);
+    REQUIRE(!view.layout.empty());
+    REQUIRE(!view.layout[0].starts_line);
+    REQUIRE(view.layout[0].len_bytes == LayoutFixture::kCharsPerRow);
+  }
+}
+
+TEST_CASE("scrolling across the start of lines", "[ViewEditor]") {
+  /* the second line wraps into 100 rows */
+  LayoutFixture f("short\n" + std::string(1000, 'y') + "\nz\n");
+  ViewEditor &view = f.view;
+  view.first_line = 2;
+
+  SECTION("scrolling up moves into the last rows of the previous line") {
+    view.offset_px = -3 * LayoutFixture::kRowHeight - 5;
+    const ViewEditor::RowPosition start = view.NormalizeCursor();
+    REQUIRE(view.first_line == 1);
+    REQUIRE(start.row == 96);
+    REQUIRE(start.offset == 96 * LayoutFixture::kCharsPerRow);
+    REQUIRE(view.offset_px == 97 * LayoutFixture::kRowHeight - 5);
+  }
+
+  SECTION("scrolling up across several lines") {
+    view.offset_px = -101 * LayoutFixture::kRowHeight;
+    const ViewEditor::RowPosition start = view.NormalizeCursor();
+    REQUIRE(view.first_line == 0);
+    REQUIRE(start.row == 0);
+    REQUIRE(view.offset_px == 0);
+  }
+
+  SECTION("scrolling up stops at the start of the buffer") {
+    view.offset_px = -1000 * LayoutFixture::kRowHeight;
+    const ViewEditor::RowPosition start = view.NormalizeCursor();
+    REQUIRE(view.first_line == 0);
+    REQUIRE(start.row == 0);
+    REQUIRE(view.offset_px == 0);
+  }
+
+  SECTION("scrolling down moves past the rows of the line") {
+    view.first_line = 0;
+    view.offset_px = 50 * LayoutFixture::kRowHeight;
+    const ViewEditor::RowPosition start = view.NormalizeCursor();
+    REQUIRE(view.first_line == 1);
+    REQUIRE(start.row == 49);
+    REQUIRE(view.offset_px == 49 * LayoutFixture::kRowHeight);
+  }
+}
+
+TEST_CASE("row checkpoints are invalidated", "[ViewEditor]") {
+  LayoutFixture f("short\n" + std::string(1000, 'y') + "\nz\n");
+  ViewEditor &view = f.view;
+  REQUIRE(view.SeekRow(1, SIZE_MAX).row == 99);
+
+  SECTION("by edits") {
+    f.Insert(1, std::string(10, 'y'));
+    REQUIRE(view.SeekRow(1, SIZE_MAX).row == 100);
+  }
+
+  SECTION("by resizing") {
+    view.viewport.w += 10 * LayoutFixture::kCharsPerRow;
+    REQUIRE(view.SeekRow(1, SIZE_MAX).row == 49);
+    /* rows fit twice as many characters */
+    REQUIRE(view.SeekRow(1, 10).offset ==
+            10 * 2 * LayoutFixture::kCharsPerRow);
+  }
+}
+
+TEST_CASE("row checkpoints reuse their memory", "[ViewEditor]") {
+  /* more lines than checkpoints are kept for, as when scrolling through a
+   * file */
+  std::string text;
+  for (size_t i = 0; i < 2 * ViewEditor::kMaxCheckpointLines; i++) {
+    text += std::string(100, 'y') + "\n";
+  }
+  LayoutFixture f(text);
+  ViewEditor &view = f.view;
+  auto seekLines = [&] {
+    size_t rows = 0;
+    for (size_t line = 0; line < f.buffer.num_lines; line++) {
+      rows += view.SeekRow(line, SIZE_MAX).row + 1;
+    }
+    return rows;
+  };
+
+  const size_t rows = seekLines();
+  REQUIRE(view.num_checkpoint_lines <= ViewEditor::kMaxCheckpointLines);
+  const uint64_t before = ProfileAllocations();
+  const size_t rows_again = seekLines();
+  const uint64_t allocated = ProfileAllocations() - before;
+  REQUIRE(rows_again == rows);
+  /* allocations are only counted with EDITOR_COUNT_ALLOCATIONS */
+  REQUIRE(allocated == 0);
+}
+
+TEST_CASE("scrolling down stops at the end of the buffer", "[ViewEditor]") {
+  SECTION("keeping the last row of a wrapped line in view") {
+    LayoutFixture f("a\n" + std::string(1000, 'y'));
+    ViewEditor &view = f.view;
+    view.offset_px = 1000 * LayoutFixture::kRowHeight;
+    const ViewEditor::RowPosition start = view.NormalizeCursor();
+    REQUIRE(view.first_line == 1);
+    REQUIRE(start.row == 99);
+    REQUIRE(start.last_line);
+    REQUIRE(view.offset_px == 99 * LayoutFixture::kRowHeight);
+
+    view.UpdateLayout();
+    REQUIRE(view.first_row == 99);
+  }
+
+  SECTION("on the empty line after a final newline") {
+    LayoutFixture f("a\nb\n");
+    ViewEditor &view = f.view;
+    view.offset_px = 1000 * LayoutFixture::kRowHeight;
+    const ViewEditor::RowPosition start = view.NormalizeCursor();
+    REQUIRE(view.first_line == 2);
+    REQUIRE(start.row == 0);
+    REQUIRE(start.last_line);
+    REQUIRE(view.offset_px == 0);
+  }
+}
@@ -0,0 +1,66 @@
+#include "ViewMinimap.hxx"
+#include "../Util/Profile.hxx"
+#include "Palette.hxx"
+#include <algorithm>
+
+enum Layer { LayerBg, LayerImage, LayerMarker };
+
+void ViewMinimap::draw(RenderContext &render) {
+  PROFILE_ZONE("ViewMinimap::draw");
+  minimap.Resize(viewport.w, viewport.h);
+  minimap.Update(editor.buffer);
+
+  if (minimap.TakeChangedRows(rows)) {
+    if (batch == RenderContext::kNoBatch) {
+      texture = render.CreateTexture(GPUTexture::Format::kRGBA, rows.w, rows.h,
+                                     1, nullptr);
+      batch = render.NewBatch(texture, false);
+    } else if (texture.size.x != rows.w || texture.size.y != rows.h) {
+      /* every row is handed out after the image was resized */
+      render.ReallocTexture(texture, rows.w, rows.h, 1, nullptr);
+      render.batches[batch].texture = texture;
+    }
+    const Rect changed = {0, (int)rows.first_row, (int)rows.w,
+                          (int)rows.num_rows};
+    render.CopyIntoTexture(texture, 0, changed, rows.pixels.data());
+    render.AddDamage({viewport.x + changed.x, viewport.y + changed.y,
+                      changed.w, changed.h});
+  }
+
+  /* rows of the lines visible in the editor */
+  size_t visible_lines = 0;
+  for (const ViewEditor::VisualLine &line : editor.layout) {
+    visible_lines += line.ends_line;
+  }
+  const size_t per_row = std::max<size_t>(rows.lines_per_row, 1);
+  const int top = editor.first_line / per_row;
+  const int bottom =
+      std::max<size_t>((editor.first_line + visible_lines + per_row - 1) /
+                           per_row,
+                       top + 1);
+
+  const Hash inputs = HashOf(viewport, top, bottom);
+  /* the editor scrolls after this view is drawn, so the marker is a frame
+   * behind, and one more frame is drawn after it moved */
+  is_animating = !minimap.UpToDate() || inputs != drawn_inputs;
+  if (inputs != drawn_inputs) {
+    render.AddDamage(viewport);
+    drawn_inputs = inputs;
+  }
+
+  /* the quads are pushed on every draw, as the editor next to this view may
+   * damage regions which overlap it */
+  render.DrawRect(LayerBg, viewport, kMinimapBackground);
+  if (batch != RenderContext::kNoBatch) {
+    render.PushQuad(batch, LayerImage, viewport.top_left(), {0, 0},
+                    std::min<int>(texture.size.x, viewport.w),
+                    std::min<int>(texture.size.y, viewport.h), RGB(0xffffff));
+  }
+  const Color marker = RGB(0x8a8580);
+  render.DrawRect(LayerMarker, {viewport.x, viewport.y + top, 2, bottom - top},
+                  marker);
+  render.DrawRect(LayerMarker, {viewport.x, viewport.y + top, viewport.w, 1},
+                  marker);
+  render.DrawRect(LayerMarker,
+                  {viewport.x, viewport.y + bottom - 1, viewport.w, 1}, marker);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../Util/Hash.hxx"
+#include "Minimap.hxx"
+#include "View.hxx"
+#include "ViewEditor.hxx"
+
+/* Overview of the whole document of an editor, with the lines visible in the
+ * editor marked. The image built by the Minimap is kept in a texture, into
+ * which only the rows that changed are uploaded, and drawn as a single quad,
+ * so that drawing does not depend on the size of the document */
+struct ViewMinimap : View {
+  static constexpr int kWidth = 120;
+
+  Minimap &minimap;
+  ViewEditor &editor;
+
+  GPUTexture texture;
+  RenderContext::BatchID batch;
+  /* the rows most recently uploaded */
+  Minimap::Rows rows;
+  /* position of the marker and the viewport as of the previous draw */
+  Hash drawn_inputs;
+
+  ViewMinimap(Minimap &minimap, ViewEditor &editor)
+      : minimap(minimap), editor(editor), texture(),
+        batch(RenderContext::kNoBatch), rows(), drawn_inputs(0) {
+    rows.lines_per_row = 1;
+    is_animating = true;
+  };
+
+  virtual void draw(RenderContext &render);
+};
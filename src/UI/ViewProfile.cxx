@@ -0,0 +1,93 @@
+#include "ViewProfile.hxx"
+#include "../Util/Profile.hxx"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+/* above every layer of the views below */
+enum Layer { LayerBox = 16, LayerText };
+
+void ViewProfile::Toggle(void) {
+  visible = !visible;
+  /* shows the frames of the last refresh interval right away */
+  summarized_ns = ProfileNow() - kRefreshNs;
+}
+
+void ViewProfile::Summarize(uint64_t now_ns) {
+  lines.clear();
+#ifndef EDITOR_PROFILE
+  lines.push_back("profiling is compiled out, set the profile option");
+#else
+  const ProfileSummary summary = ProfileSummarize(summarized_ns);
+  const double frames = std::max<uint64_t>(summary.frames, 1);
+  char line[128];
+
+  snprintf(line, sizeof(line), "%" PRIu64 " frames, per frame:",
+           summary.frames);
+  lines.push_back(line);
+  for (size_t i = 0; i < summary.zones.size() && i < kMaxZones; i++) {
+    const ProfileTotal &zone = summary.zones[i];
+    snprintf(line, sizeof(line), "%-20.20s %8.3fms  max %8.3fms  %6.1fx",
+             zone.name, zone.total / frames / 1e6, zone.max / 1e6,
+             zone.count / frames);
+    lines.push_back(line);
+  }
+  for (const ProfileTotal &counter : summary.counters) {
+    snprintf(line, sizeof(line), "%-20.20s %8.0f   max %8" PRIu64,
+             counter.name, counter.total / frames, counter.max);
+    lines.push_back(line);
+  }
+#endif
+  summarized_ns = now_ns;
+}
+
+void ViewProfile::draw(RenderContext &render) {
+  child.viewport = viewport;
+
+  const uint64_t now = ProfileNow();
+  if (visible && now - summarized_ns >= kRefreshNs) {
+    Summarize(now);
+  }
+
+  /* in the top right corner, columns are lined up for monospace fonts */
+  const int padding = 6;
+  const int line_height = font.line_height;
+  size_t columns = 0;
+  for (const std::string &line : lines) {
+    columns = std::max(columns, line.size());
+  }
+  const int box_w = columns * font.CharAdvance('0') + 2 * padding;
+  const int box_h = lines.size() * line_height + 2 * padding;
+  Rect box = {viewport.x + viewport.w - box_w, viewport.y, box_w, box_h};
+  if (!visible) {
+    box = {0, 0, 0, 0};
+  }
+
+  const Hash drawn = HashOf(box, lines);
+  /* the view below has to push its quads for the damaged regions */
+  if (drawn != drawn_inputs) {
+    render.AddDamage(drawn_box);
+    render.AddDamage(box);
+    child.Invalidate();
+    drawn_inputs = drawn;
+    drawn_box = box;
+  }
+
+  child.draw(render);
+  is_animating = child.is_animating;
+  if (!visible)
+    return;
+
+  /* pushed on every draw, as the view below may damage regions under it */
+  render.DrawRect(LayerBox, box, RGB(0x22211f));
+  int y = box.y + padding;
+  for (const std::string &line : lines) {
+    for (const ShapedGlyph &glyph : shapes.Shape(font, line).glyphs) {
+      font.DrawGlyph(LayerText,
+                     {box.x + padding + (int)glyph.x,
+                      y + (int)glyph.y + line_height},
+                     glyph.glyph_id, RGB(0xe8e4dc));
+    }
+    y += line_height;
+  }
+}
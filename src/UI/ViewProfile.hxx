@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../Render/RenderFont.hxx"
+#include "../Render/ShapeCache.hxx"
+#include "../Util/Hash.hxx"
+#include "View.hxx"
+#include <string>
+#include <vector>
+
+/* Draws a view, and on top of it the time spent in the zones of the profiler
+ * since the overlay was last refreshed */
+struct ViewProfile : View {
+  static constexpr uint64_t kRefreshNs = 500'000'000;
+  static constexpr size_t kMaxZones = 16;
+
+  View &child;
+  RenderFont &font;
+  ShapeCache &shapes;
+
+  bool visible;
+  std::vector<std::string> lines;
+  uint64_t summarized_ns;
+  /* text and box of the overlay as of the previous draw */
+  Hash drawn_inputs;
+  Rect drawn_box;
+
+  ViewProfile(View &child, RenderFont &font, ShapeCache &shapes)
+      : child(child), font(font), shapes(shapes), visible(false),
+        summarized_ns(0), drawn_inputs(0), drawn_box({0, 0, 0, 0}) {
+    is_animating = true;
+  };
+
+  void Toggle(void);
+  void Summarize(uint64_t now_ns);
+  virtual void draw(RenderContext &render);
+  virtual void Invalidate(void) { child.Invalidate(); }
+};
@@ -0,0 +1,106 @@
+#include "View.hxx"
+#include "catch2/catch.hpp"
+
+/* skips drawing until it changes or is invalidated, and only damages the
+ * window when it changed, like ViewEditor */
+struct SkippingView : View {
+  bool changed = true;
+  bool invalid = true;
+  bool drawn = false;
+
+  virtual void draw(RenderContext &render) {
+    drawn = changed || invalid;
+    if (changed) {
+      render.AddDamage({viewport.x, viewport.y + 20, viewport.w, 20});
+    }
+    changed = false;
+    invalid = false;
+  }
+  virtual void Invalidate(void) { invalid = true; }
+};
+
+/* pushes its quads on every draw, damaging itself when changed */
+struct SideView : View {
+  bool changed = false;
+
+  virtual void draw(RenderContext &render) {
+    if (changed) {
+      render.AddDamage(viewport);
+    }
+    changed = false;
+  }
+};
+
+TEST_CASE("views in the repair region push their quads", "[View]") {
+  RenderContext rctx(nullptr);
+  rctx.win_w = 800;
+  rctx.win_h = 600;
+
+  SkippingView editor;
+  SideView side;
+  ViewSplit split(editor, side, 100);
+  split.viewport = {0, 0, 800, 600};
+
+  /* draws a frame, and does what Commit and the render thread do with its
+   * damage, given the age of the back buffer it is drawn into */
+  const uint buffer_age = GENERATE(1, 2, 3);
+  auto frame = [&] {
+    split.draw(rctx);
+    RenderContext::FramePacket packet;
+    packet.win_w = rctx.win_w;
+    packet.win_h = rctx.win_h;
+    rctx.CommitDamage(packet);
+    rctx.last_buffer_age = buffer_age;
+
+    const Rect repaint = rctx.RepaintRegion(packet, buffer_age);
+    /* otherwise the render thread would drop the frame */
+    REQUIRE(packet.repairable.contains(repaint));
+    if (!repaint.empty()) {
+      Rect bounds = {0, 0, 0, 0};
+      if (packet.damage_all) {
+        bounds = {0, 0, 800, 600};
+      }
+      for (const Rect &rect : packet.damage) {
+        bounds = bounds.united(rect);
+      }
+      std::copy_backward(rctx.damage_history,
+                         rctx.damage_history + rctx.kDamageHistory - 1,
+                         rctx.damage_history + rctx.kDamageHistory);
+      rctx.damage_history[0] = bounds;
+      rctx.damage_history_len =
+          std::min(rctx.damage_history_len + 1, rctx.kDamageHistory);
+    }
+    return repaint;
+  };
+
+  /* the first frames damage everything */
+  frame();
+  REQUIRE(editor.drawn);
+  for (uint i = 0; i < RenderContext::kDamageHistory; i++) {
+    side.changed = true;
+    frame();
+  }
+
+  editor.changed = true;
+  frame();
+  REQUIRE(editor.drawn);
+
+  SECTION("a change of the side view after an edit") {
+    side.changed = true;
+    frame();
+    REQUIRE(editor.drawn);
+  }
+
+  SECTION("damage outside of the views after an edit") {
+    /* e.g. by an overlay above the side view */
+    rctx.AddDamage({750, 0, 50, 50});
+    frame();
+    /* the previous frame only has to be repaired in older back buffers */
+    REQUIRE(editor.drawn == (buffer_age > 1));
+  }
+
+  SECTION("frames without damage are not presented") {
+    REQUIRE(frame().empty());
+    REQUIRE(!editor.drawn);
+  }
+}
@@ -0,0 +1,9 @@
+#include "Arena.hxx"
+
+Arena::Arena(size_t capacity)
+    : memory(VirtualMemory::NewPrivateMemory(capacity)), base(nullptr),
+      capacity(capacity), used(0), peak(0) {
+  base = (uint8_t *)VirtualMemory::Map(memory, true);
+}
+
+Arena::~Arena() { VirtualMemory::Unmap(memory); }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../Platform/VirtualMemory.hxx"
+#include "Assert.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Bump allocator for data which only lives until a known point, like the end
+ * of a frame.
+ *
+ * The whole capacity is mapped up front as private memory, which the OS only
+ * backs with pages once they are touched, so the arena never moves and
+ * allocations stay valid until Reset. Freeing single allocations does nothing,
+ * Reset frees everything at once and keeps the pages for the next use */
+struct Arena {
+  VirtualMemory::Handle memory;
+  uint8_t *base;
+  size_t capacity;
+  /* bytes allocated since the last Reset */
+  size_t used;
+  /* most bytes in use at once, as of the last Reset */
+  size_t peak;
+
+  Arena(size_t capacity);
+  Arena(Arena const &) = delete;
+  Arena &operator=(Arena const &) = delete;
+  ~Arena();
+
+  /* align must be a power of two */
+  void *Allocate(size_t size, size_t align) {
+    const size_t begin = (used + align - 1) & ~(align - 1);
+    assume(begin <= capacity && size <= capacity - begin,
+           "arena is out of memory");
+    used = begin + size;
+    return base + begin;
+  }
+
+  void Reset(void) {
+    peak = used > peak ? used : peak;
+    used = 0;
+  }
+};
+
+/* Allocator for standard containers whose memory comes from an arena, the
+ * containers must not be used after the arena is reset */
+template <typename T> struct ArenaAllocator {
+  using value_type = T;
+
+  Arena *arena;
+
+  ArenaAllocator(Arena &arena) : arena(&arena){};
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t n) {
+    return (T *)arena->Allocate(n * sizeof(T), alignof(T));
+  }
+  void deallocate(T *, size_t) {}
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+    return arena == other.arena;
+  }
+};
+
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>
+    ArenaString;
@@ -0,0 +1,82 @@
+#include "Arena.hxx"
+#include "catch2/catch.hpp"
+
+#include "Profile.hxx"
+#include <cstdint>
+#include <cstring>
+
+TEST_CASE("allocations are aligned and do not overlap", "[Arena]") {
+  Arena arena(1 << 20);
+  uint8_t *a = (uint8_t *)arena.Allocate(3, 1);
+  uint8_t *b = (uint8_t *)arena.Allocate(8, 8);
+  uint8_t *c = (uint8_t *)arena.Allocate(64, 64);
+  REQUIRE((uintptr_t)b % 8 == 0);
+  REQUIRE((uintptr_t)c % 64 == 0);
+  REQUIRE(b >= a + 3);
+  REQUIRE(c >= b + 8);
+  /* the memory is writable */
+  memset(a, 1, 3);
+  memset(b, 2, 8);
+  memset(c, 3, 64);
+  REQUIRE(a[2] == 1);
+  REQUIRE(b[7] == 2);
+}
+
+TEST_CASE("reset reuses the memory", "[Arena]") {
+  Arena arena(1 << 20);
+  void *first = arena.Allocate(1000, 16);
+  arena.Allocate(1000, 16);
+  const size_t used = arena.used;
+  REQUIRE(used >= 2000);
+
+  arena.Reset();
+  REQUIRE(arena.used == 0);
+  REQUIRE(arena.peak == used);
+  REQUIRE(arena.Allocate(10, 16) == first);
+
+  /* the peak is kept across smaller frames */
+  arena.Reset();
+  REQUIRE(arena.peak == used);
+}
+
+TEST_CASE("containers allocate from the arena", "[Arena]") {
+  Arena arena(1 << 20);
+  const uint8_t *begin = arena.base;
+  const uint8_t *end = arena.base + arena.capacity;
+
+  ArenaVector<int> values(arena);
+  for (int i = 0; i < 1000; i++) {
+    values.push_back(i);
+  }
+  REQUIRE(values[999] == 999);
+  REQUIRE((const uint8_t *)values.data() >= begin);
+  REQUIRE((const uint8_t *)values.data() < end);
+
+  /* longer than the small string buffer */
+  ArenaString text(arena);
+  text.append(100, 'x');
+  REQUIRE(text.size() == 100);
+  REQUIRE((const uint8_t *)text.data() >= begin);
+  REQUIRE((const uint8_t *)text.data() < end);
+  REQUIRE(std::string_view(text) == std::string(100, 'x'));
+}
+
+TEST_CASE("heap allocations are counted", "[Arena]") {
+  Arena arena(1 << 20);
+  const uint64_t before = ProfileAllocations();
+  {
+    ArenaVector<int> values(arena);
+    values.resize(100);
+  }
+  /* nothing is allocated from the heap for the arena containers */
+  REQUIRE(ProfileAllocations() == before);
+
+  /* new expressions may be optimized out, calls of operator new may not */
+  void *value = ::operator new(sizeof(int));
+  ::operator delete(value);
+#ifdef EDITOR_COUNT_ALLOCATIONS
+  REQUIRE(ProfileAllocations() == before + 1);
+#else
+  REQUIRE(ProfileAllocations() == 0);
+#endif
+}
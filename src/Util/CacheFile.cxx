@@ -0,0 +1,38 @@
+#include "CacheFile.hxx"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+std::optional<std::vector<uint8_t>> ReadCacheFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return std::nullopt;
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  if (file.bad())
+    return std::nullopt;
+  return data;
+}
+
+bool WriteCacheFile(const std::string &path, const std::vector<uint8_t> &data) {
+  /* written to a temporary file first, renaming it over the old cache is
+   * atomic */
+  const std::string tmp_path =
+      path + ".tmp" + std::to_string(std::random_device()());
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write((const char *)data.data(), data.size());
+    file.close();
+    if (!file) {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
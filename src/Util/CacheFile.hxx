@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/* Binary cache files are written in native byte order, as caches are never
+ * shared between machines */
+
+struct CacheWriter {
+  std::vector<uint8_t> data;
+
+  void PutBytes(const void *bytes, size_t len) {
+    const uint8_t *begin = (const uint8_t *)bytes;
+    data.insert(data.end(), begin, begin + len);
+  }
+
+  template <typename T> void Put(const T &v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    PutBytes(&v, sizeof(T));
+  }
+
+  /* prefixed by its length */
+  void PutString(std::string_view s) {
+    Put((uint32_t)s.size());
+    PutBytes(s.data(), s.size());
+  }
+};
+
+/* every read is bounds checked, as the file might be truncated or corrupt */
+struct CacheReader {
+  const uint8_t *cur;
+  const uint8_t *end;
+
+  const uint8_t *GetBytes(size_t len) {
+    if ((size_t)(end - cur) < len)
+      return nullptr;
+    const uint8_t *bytes = cur;
+    cur += len;
+    return bytes;
+  }
+
+  template <typename T> bool Get(T *v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const uint8_t *bytes = GetBytes(sizeof(T));
+    if (bytes == nullptr)
+      return false;
+    memcpy(v, bytes, sizeof(T));
+    return true;
+  }
+
+  bool GetString(std::string *s) {
+    uint32_t len;
+    if (!Get(&len))
+      return false;
+    const uint8_t *bytes = GetBytes(len);
+    if (bytes == nullptr)
+      return false;
+    s->assign((const char *)bytes, len);
+    return true;
+  }
+};
+
+/* returns nullopt if the file can not be read */
+std::optional<std::vector<uint8_t>> ReadCacheFile(const std::string &path);
+/* replaces the file at path atomically, so that concurrently starting editors
+ * never read a partially written cache. Returns false on failure */
+bool WriteCacheFile(const std::string &path, const std::vector<uint8_t> &data);
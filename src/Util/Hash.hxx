@@ -1,34 +1,93 @@
 #pragma once
 
 #include "Assert.hxx"
+/* XXH3_state_t is only declared for static linking */
+#ifndef XXH_STATIC_LINKING_ONLY
+#define XXH_STATIC_LINKING_ONLY
+#endif
 #include "xxhash.h"
 #include <cassert>
+#include <cstring>
+#include <ranges>
+#include <string_view>
+#include <type_traits>
 
 typedef XXH64_hash_t Hash;
 
 template <class...> constexpr std::false_type always_false{};
 
+/* Hashes a sequence of values with XXH3, without allocating.
+ *
+ * Most hashes are of a few integers, so the input is gathered in a buffer on
+ * the stack and hashed in one shot when the Hasher is converted to a Hash.
+ * Only inputs longer than the buffer are streamed into the XXH3 state, which
+ * also lives on the stack. Either way the hash is the same as XXH3_64bits of
+ * the whole input.
+ *
+ * add accepts:
+ * - types with unique object representations, which are hashed by their
+ *   bytes. This covers integers, enums, pointers, and structs without padding
+ *   like Point and Rect. Structs with padding have to add their members one by
+ *   one
+ * - ranges of those, such as std::string_view, std::span or std::vector, which
+ *   are hashed by their length and elements, so that consecutive ranges hash
+ *   differently than their concatenation */
 struct Hasher {
-  XXH64_state_t *state;
+  /* large enough for the inputs of the views, and a line of text */
+  static constexpr size_t kBufferSize = 256;
 
-  Hasher(void) {
-    state = XXH64_createState();
-    assume(state != nullptr, "xxh64 failed to create state");
-    XXH_errorcode err = XXH64_reset(state, 0);
-    assume(err != XXH_ERROR, "xxh64 failed to reset state");
-  }
+  size_t buffered;
+  bool streaming;
+  uint8_t buffer[kBufferSize];
+  /* only initialized once streaming */
+  XXH3_state_t state;
+
+  Hasher(void) : buffered(0), streaming(false){};
 
-  ~Hasher() { XXH64_freeState(state); }
+  void UpdateHash(const void *data, size_t len) {
+    if (!streaming && buffered + len <= kBufferSize) {
+      /* memcpy with a null pointer is undefined even for a length of 0 */
+      if (len > 0) {
+        memcpy(buffer + buffered, data, len);
+      }
+      buffered += len;
+      return;
+    }
 
-  void UpdateHash(void *data, size_t len) {
-    XXH_errorcode err = XXH64_update(state, data, len);
+    if (!streaming) {
+      XXH_errorcode err = XXH3_64bits_reset(&state);
+      assume(err != XXH_ERROR, "xxh3 failed to reset state");
+      err = XXH3_64bits_update(&state, buffer, buffered);
+      assert(err != XXH_ERROR);
+      streaming = true;
+    }
+    XXH_errorcode err = XXH3_64bits_update(&state, data, len);
     assert(err != XXH_ERROR);
+    (void)err;
   }
 
-  operator Hash() { return XXH64_digest(state); }
+  operator Hash() const {
+    if (streaming)
+      return XXH3_64bits_digest(&state);
+    return XXH3_64bits(buffer, buffered);
+  }
 
-  template <typename T> inline Hasher &add(T v) {
-    if constexpr (std::is_integral<T>::value) {
+  template <typename T> inline Hasher &add(const T &v) {
+    /* views like std::string_view have unique object representations too,
+     * so ranges are checked for first */
+    if constexpr (std::ranges::sized_range<const T>) {
+      using Element = std::ranges::range_value_t<const T>;
+      add((size_t)std::ranges::size(v));
+      if constexpr (std::ranges::contiguous_range<const T> &&
+                    std::has_unique_object_representations_v<Element>) {
+        UpdateHash(std::ranges::data(v),
+                   std::ranges::size(v) * sizeof(Element));
+      } else {
+        for (const Element &element : v) {
+          add(element);
+        }
+      }
+    } else if constexpr (std::has_unique_object_representations_v<T>) {
       UpdateHash(&v, sizeof(T));
     } else {
       static_assert(always_false<T>, "hash unimplemented for type");
@@ -36,4 +95,14 @@ struct Hasher {
 
     return *this;
   }
+
+  /* a C string is hashed by its contents rather than its address */
+  Hasher &add(const char *s) { return add(std::string_view(s)); }
 };
+
+/* shorthand for hashing a few values */
+template <typename... Ts> inline Hash HashOf(const Ts &...values) {
+  Hasher hasher;
+  (hasher.add(values), ...);
+  return hasher;
+}
@@ -0,0 +1,93 @@
+#include "Hash.hxx"
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch2/catch.hpp"
+
+#include "../Render/Types.hxx"
+#include <chrono>
+#include <span>
+#include <string>
+#include <vector>
+
+TEST_CASE("hashes match XXH3 of the whole input", "[Hash]") {
+  std::string input;
+  for (int i = 0; i < 1000; i++) {
+    input.push_back('a' + i % 26);
+  }
+
+  /* below, at and past the size of the buffer */
+  for (size_t len : {(size_t)0, (size_t)7, Hasher::kBufferSize,
+                     Hasher::kBufferSize + 1, input.size()}) {
+    const Hash expected = XXH3_64bits(input.data(), len);
+
+    Hasher whole;
+    whole.UpdateHash(input.data(), len);
+    REQUIRE((Hash)whole == expected);
+
+    /* in pieces which cross the end of the buffer */
+    Hasher pieces;
+    for (size_t i = 0; i < len; i += 100) {
+      pieces.UpdateHash(input.data() + i, std::min<size_t>(100, len - i));
+    }
+    REQUIRE((Hash)pieces == expected);
+  }
+}
+
+TEST_CASE("structured values", "[Hash]") {
+  const Rect rect = {1, 2, 3, 4};
+  REQUIRE(HashOf(rect) == HashOf(1, 2, 3, 4));
+  REQUIRE(HashOf(rect) != HashOf(Rect{1, 2, 4, 3}));
+  REQUIRE(HashOf(Point{5, 6}) == HashOf(5, 6));
+
+  /* ranges hash their length, so that the boundaries between them matter */
+  REQUIRE(HashOf(std::string_view("ab"), std::string_view("c")) !=
+          HashOf(std::string_view("a"), std::string_view("bc")));
+  REQUIRE(HashOf(std::string("abc")) == HashOf(std::string_view("abc")));
+  REQUIRE(HashOf("abc") == HashOf(std::string_view("abc")));
+
+  const std::vector<int> values = {1, 2, 3};
+  REQUIRE(HashOf(values) == HashOf(std::span<const int>(values)));
+  REQUIRE(HashOf(values) != HashOf(std::vector<int>{1, 2}));
+
+  /* ranges of ranges hash every element */
+  const std::vector<std::string> lines = {"a", "bc"};
+  REQUIRE(HashOf(lines) == HashOf((size_t)2, std::string_view("a"),
+                                  std::string_view("bc")));
+
+  /* a copy continues from the same input */
+  Hasher prefix;
+  prefix.add(1);
+  Hasher copy = prefix;
+  REQUIRE((Hash)copy.add(2) == HashOf(1, 2));
+}
+
+TEST_CASE("hash throughput", "[Hash]") {
+  /* like the inputs of a view */
+  constexpr size_t num_hashes = 10'000'000;
+  Rect viewport = {0, 0, 1920, 1080};
+  Hash sum = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_hashes; i++) {
+    viewport.y = i;
+    sum += HashOf(i, viewport, (uint64_t)42);
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(t1 - t0).count();
+  WARN("view inputs: " << num_hashes / seconds / 1e6
+                       << "M hashes per second");
+  REQUIRE(sum != 0);
+
+  const std::string line(80, 'x');
+  BENCHMARK("view inputs") { return HashOf((size_t)1, viewport, 42); };
+  BENCHMARK("80 byte line") { return HashOf(line); };
+  /* how Hasher hashed before, for comparison */
+  BENCHMARK("view inputs, XXH64 with a heap state") {
+    XXH64_state_t *state = XXH64_createState();
+    XXH64_reset(state, 0);
+    const size_t i = 1;
+    XXH64_update(state, &i, sizeof(i));
+    XXH64_update(state, &viewport, sizeof(viewport));
+    const Hash hash = XXH64_digest(state);
+    XXH64_freeState(state);
+    return hash;
+  };
+}
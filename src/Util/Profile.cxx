@@ -0,0 +1,238 @@
+#include "Profile.hxx"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+/* The ring of a thread is only written by that thread. Readers copy it without
+ * locking, and drop the events which may have been overwritten while they
+ * copied, which is why the slots are atomics */
+struct ProfileRing {
+  struct Slot {
+    std::atomic<const char *> name;
+    std::atomic<uint64_t> begin_ns;
+    std::atomic<uint64_t> value;
+    std::atomic<uint8_t> kind;
+  };
+
+  uint32_t thread_id;
+  /* protected by the mutex of the registry */
+  std::string thread_name;
+  /* number of events written so far */
+  std::atomic<uint64_t> written;
+  Slot slots[kProfileRingEvents];
+};
+
+struct ProfileRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ProfileRing>> rings;
+};
+
+/* never destroyed, threads may still record while static destructors run */
+static ProfileRegistry &Registry(void) {
+  static ProfileRegistry *registry = new ProfileRegistry();
+  return *registry;
+}
+
+static ProfileRing &ThreadRing(void) {
+  thread_local ProfileRing *ring = nullptr;
+  if (ring == nullptr) {
+    ProfileRegistry &registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.rings.push_back(std::make_unique<ProfileRing>());
+    ring = registry.rings.back().get();
+    ring->thread_id = registry.rings.size();
+    ring->written = 0;
+  }
+  return *ring;
+}
+
+uint64_t ProfileNow(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void ProfileRecord(ProfileEvent::Kind kind, const char *name,
+                   uint64_t begin_ns, uint64_t value) {
+  ProfileRing &ring = ThreadRing();
+  const uint64_t i = ring.written.load(std::memory_order_relaxed);
+  ProfileRing::Slot &slot = ring.slots[i % kProfileRingEvents];
+  /* readers which see any of the new contents of the slot also see that
+   * event i was started */
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+  slot.value.store(value, std::memory_order_relaxed);
+  slot.kind.store(kind, std::memory_order_relaxed);
+  ring.written.store(i + 1, std::memory_order_release);
+}
+
+void ProfileThreadName(const char *name) {
+  ProfileRing &ring = ThreadRing();
+  std::lock_guard<std::mutex> lock(Registry().mutex);
+  ring.thread_name = name;
+}
+
+/* copies the events of ring which are still intact */
+static std::vector<ProfileEvent> CopyRing(const ProfileRing &ring,
+                                          uint64_t since_ns) {
+  constexpr uint64_t n = kProfileRingEvents;
+  const uint64_t end = ring.written.load(std::memory_order_acquire);
+  const uint64_t begin = end > n ? end - n : 0;
+
+  std::vector<ProfileEvent> events;
+  events.reserve(end - begin);
+  for (uint64_t i = begin; i < end; i++) {
+    const ProfileRing::Slot &slot = ring.slots[i % n];
+    events.push_back({slot.name.load(std::memory_order_relaxed),
+                      slot.begin_ns.load(std::memory_order_relaxed),
+                      slot.value.load(std::memory_order_relaxed),
+                      (ProfileEvent::Kind)slot.kind.load(
+                          std::memory_order_relaxed)});
+  }
+
+  /* event i is overwritten by event i + n, which may have been in progress
+   * while copying */
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t after = ring.written.load(std::memory_order_relaxed);
+  const uint64_t first_intact = after >= n ? after - n + 1 : 0;
+  const size_t dropped =
+      std::min(first_intact, end) - std::min(first_intact, begin);
+  events.erase(events.begin(), events.begin() + dropped);
+
+  std::erase_if(events, [&](const ProfileEvent &event) {
+    return event.begin_ns < since_ns;
+  });
+  return events;
+}
+
+std::vector<ProfileThreadEvents> ProfileCollect(uint64_t since_ns) {
+  ProfileRegistry &registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::vector<ProfileThreadEvents> threads;
+  for (const std::unique_ptr<ProfileRing> &ring : registry.rings) {
+    threads.push_back(
+        {ring->thread_id, ring->thread_name, CopyRing(*ring, since_ns)});
+  }
+  return threads;
+}
+
+ProfileSummary ProfileSummarize(uint64_t since_ns) {
+  ProfileSummary summary = {0, {}, {}};
+  /* the same name may be a different string literal in every file */
+  std::unordered_map<std::string_view, ProfileTotal> zones;
+  std::unordered_map<std::string_view, ProfileTotal> counters;
+
+  for (const ProfileThreadEvents &thread : ProfileCollect(since_ns)) {
+    for (const ProfileEvent &event : thread.events) {
+      if (event.kind == ProfileEvent::kFrame) {
+        summary.frames++;
+        continue;
+      }
+      auto &totals = event.kind == ProfileEvent::kZone ? zones : counters;
+      ProfileTotal &total =
+          totals.try_emplace(event.name, ProfileTotal{event.name, 0, 0, 0})
+              .first->second;
+      total.count++;
+      total.total += event.value;
+      total.max = std::max(total.max, event.value);
+    }
+  }
+
+  auto sorted = [](const auto &totals) {
+    std::vector<ProfileTotal> out;
+    for (const auto &[name, total] : totals) {
+      out.push_back(total);
+    }
+    std::sort(out.begin(), out.end(),
+              [](const ProfileTotal &a, const ProfileTotal &b) {
+                return a.total > b.total;
+              });
+    return out;
+  };
+  summary.zones = sorted(zones);
+  summary.counters = sorted(counters);
+  return summary;
+}
+
+/* names are string literals, which are only escaped for safety */
+static void WriteJSONString(FILE *file, std::string_view s) {
+  fputc('"', file);
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      fputc('\\', file);
+    }
+    fputc((unsigned char)c < 0x20 ? ' ' : c, file);
+  }
+  fputc('"', file);
+}
+
+bool ProfileWriteTrace(const std::string &path) {
+  const std::vector<ProfileThreadEvents> threads = ProfileCollect(0);
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr)
+    return false;
+
+  /* timestamps are in microseconds from the first event. Zones are recorded
+   * when they end, so enclosing zones come after the zones within them */
+  uint64_t origin = UINT64_MAX;
+  for (const ProfileThreadEvents &thread : threads) {
+    for (const ProfileEvent &event : thread.events) {
+      origin = std::min(origin, event.begin_ns);
+    }
+  }
+
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+  bool first = true;
+  auto separate = [&] {
+    if (!first) {
+      fputs(",\n", file);
+    }
+    first = false;
+  };
+
+  for (const ProfileThreadEvents &thread : threads) {
+    if (!thread.thread_name.empty()) {
+      separate();
+      fprintf(file,
+              "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+              "\"tid\":%" PRIu32 ",\"args\":{\"name\":",
+              thread.thread_id);
+      WriteJSONString(file, thread.thread_name);
+      fputs("}}", file);
+    }
+
+    for (const ProfileEvent &event : thread.events) {
+      const double ts = (event.begin_ns - origin) / 1e3;
+      separate();
+      switch (event.kind) {
+      case ProfileEvent::kZone:
+        fprintf(file, "{\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32
+                      ",\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                thread.thread_id, ts, event.value / 1e3);
+        WriteJSONString(file, event.name);
+        fputs("}", file);
+        break;
+      case ProfileEvent::kCounter:
+        fprintf(file, "{\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"name\":", ts);
+        WriteJSONString(file, event.name);
+        fprintf(file, ",\"args\":{\"value\":%" PRIu64 "}}", event.value);
+        break;
+      case ProfileEvent::kFrame:
+        fprintf(file,
+                "{\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%" PRIu32
+                ",\"ts\":%.3f,\"name\":\"frame\"}",
+                thread.thread_id, ts);
+        break;
+      }
+    }
+  }
+  fputs("\n]}\n", file);
+  return fclose(file) == 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Scoped timers and counters for finding out where the time of a frame goes.
+ *
+ * Events are recorded into a ring buffer owned by the thread they happen on,
+ * so that recording takes no locks and only the most recent kProfileRingEvents
+ * events of every thread are kept. The rings are read for the stats overlay,
+ * and for writing a trace which can be opened in chrome://tracing or Perfetto.
+ *
+ * The PROFILE_ macros compile to nothing unless EDITOR_PROFILE is defined,
+ * which the profile build option does */
+
+constexpr size_t kProfileRingEvents = 1 << 15;
+
+struct ProfileEvent {
+  enum Kind : uint8_t { kZone, kCounter, kFrame };
+
+  /* must outlive the profiler, e.g. a string literal */
+  const char *name;
+  uint64_t begin_ns;
+  /* duration of zones in nanoseconds, value of counters */
+  uint64_t value;
+  Kind kind;
+};
+
+/* nanoseconds from the monotonic clock */
+uint64_t ProfileNow(void);
+void ProfileRecord(ProfileEvent::Kind, const char *name, uint64_t begin_ns,
+                   uint64_t value);
+/* names the calling thread in traces */
+void ProfileThreadName(const char *name);
+
+/* number of heap allocations the calling thread made through operator new so
+ * far, which is replaced to count them. Always 0 unless
+ * EDITOR_COUNT_ALLOCATIONS is defined, which the count_allocations build option
+ * does. Allocations made with malloc by C libraries are not counted */
+uint64_t ProfileAllocations(void);
+
+/* events of every thread which began at or after since_ns, oldest first */
+struct ProfileThreadEvents {
+  uint32_t thread_id;
+  std::string thread_name;
+  std::vector<ProfileEvent> events;
+};
+std::vector<ProfileThreadEvents> ProfileCollect(uint64_t since_ns);
+
+struct ProfileTotal {
+  const char *name;
+  uint64_t count;
+  /* summed and largest durations of zones, or values of counters */
+  uint64_t total;
+  uint64_t max;
+};
+struct ProfileSummary {
+  uint64_t frames;
+  /* by total, largest first */
+  std::vector<ProfileTotal> zones;
+  std::vector<ProfileTotal> counters;
+};
+ProfileSummary ProfileSummarize(uint64_t since_ns);
+
+/* writes every recorded event in the Chrome trace event format, returns
+ * false if the file could not be written */
+bool ProfileWriteTrace(const std::string &path);
+
+class ProfileZone {
+  const char *name;
+  uint64_t begin_ns;
+
+public:
+  ProfileZone(const char *name) : name(name), begin_ns(ProfileNow()) {}
+  ProfileZone(ProfileZone const &) = delete;
+  ProfileZone &operator=(ProfileZone const &) = delete;
+  ~ProfileZone() {
+    ProfileRecord(ProfileEvent::kZone, name, begin_ns,
+                  ProfileNow() - begin_ns);
+  }
+};
+
+#ifdef EDITOR_PROFILE
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+/* times the rest of the enclosing scope */
+#define PROFILE_ZONE(name)                                                     \
+  ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_COUNTER(name, value)                                           \
+  ProfileRecord(ProfileEvent::kCounter, (name), ProfileNow(), (value))
+#define PROFILE_FRAME()                                                        \
+  ProfileRecord(ProfileEvent::kFrame, "frame", ProfileNow(), 0)
+#define PROFILE_THREAD_NAME(name) ProfileThreadName(name)
+#else
+#define PROFILE_ZONE(name) (void)0
+/* value is not evaluated, but variables only used for counters are used */
+#define PROFILE_COUNTER(name, value) (void)sizeof(value)
+#define PROFILE_FRAME() (void)0
+#define PROFILE_THREAD_NAME(name) (void)0
+#endif
@@ -0,0 +1,64 @@
+#include "Profile.hxx"
+#include <cstdlib>
+#include <new>
+
+/* Kept apart from the rest of the profiler, so that no allocation in this file
+ * can be inlined into the replaced operator delete, which GCC warns about as a
+ * mismatched free */
+
+#ifdef EDITOR_COUNT_ALLOCATIONS
+/* constant initialized, so that it can be used before the thread is set up */
+static thread_local uint64_t thread_allocations = 0;
+
+/* The replaceable allocation functions, which count the allocations of the
+ * thread. Array forms call these, the nothrow forms are replaced too since
+ * some runtimes, like the sanitizers, bring their own */
+static void *CountedAlloc(size_t size, size_t align) {
+  thread_allocations++;
+  if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    return malloc(size > 0 ? size : 1);
+  /* the size has to be a multiple of the alignment */
+  return aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void *operator new(size_t size) {
+  void *p = CountedAlloc(size, 1);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+  void *p = CountedAlloc(size, (size_t)align);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return CountedAlloc(size, 1);
+}
+
+void *operator new(size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  return CountedAlloc(size, (size_t)align);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  free(p);
+}
+#endif
+
+uint64_t ProfileAllocations(void) {
+#ifdef EDITOR_COUNT_ALLOCATIONS
+  return thread_allocations;
+#else
+  return 0;
+#endif
+}
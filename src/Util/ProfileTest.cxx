@@ -0,0 +1,148 @@
+#include "Profile.hxx"
+#include "catch2/catch.hpp"
+
+#include <cstdio>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+/* the profiler is global, so every test records on threads of its own and
+ * only looks at those */
+static const ProfileThreadEvents *FindThread(
+    const std::vector<ProfileThreadEvents> &threads, std::string_view name) {
+  for (const ProfileThreadEvents &thread : threads) {
+    if (thread.thread_name == name)
+      return &thread;
+  }
+  return nullptr;
+}
+
+static const ProfileTotal *FindTotal(const std::vector<ProfileTotal> &totals,
+                                     std::string_view name) {
+  for (const ProfileTotal &total : totals) {
+    if (total.name == name)
+      return &total;
+  }
+  return nullptr;
+}
+
+TEST_CASE("profile zones and counters", "[Profile]") {
+  const uint64_t since = ProfileNow();
+  std::thread([] {
+    ProfileThreadName("profile test zones");
+    for (int frame = 0; frame < 3; frame++) {
+      {
+        ProfileZone outer("test outer");
+        for (int i = 0; i < 2; i++) {
+          ProfileZone inner("test inner");
+        }
+      }
+      ProfileRecord(ProfileEvent::kCounter, "test counter", ProfileNow(),
+                    10 + frame);
+      ProfileRecord(ProfileEvent::kFrame, "frame", ProfileNow(), 0);
+    }
+  }).join();
+
+  const std::vector<ProfileThreadEvents> threads = ProfileCollect(since);
+  const ProfileThreadEvents *thread =
+      FindThread(threads, "profile test zones");
+  REQUIRE(thread != nullptr);
+  /* 2 inner zones, the outer zone, the counter and the frame per frame */
+  REQUIRE(thread->events.size() == 15);
+  /* zones are recorded when they end */
+  REQUIRE(std::string_view(thread->events[0].name) == "test inner");
+  REQUIRE(std::string_view(thread->events[2].name) == "test outer");
+  REQUIRE(thread->events[2].begin_ns <= thread->events[0].begin_ns);
+  REQUIRE(thread->events[2].value >= thread->events[0].value);
+
+  const ProfileSummary summary = ProfileSummarize(since);
+  REQUIRE(summary.frames >= 3);
+  const ProfileTotal *inner = FindTotal(summary.zones, "test inner");
+  const ProfileTotal *outer = FindTotal(summary.zones, "test outer");
+  REQUIRE(inner != nullptr);
+  REQUIRE(outer != nullptr);
+  REQUIRE(inner->count == 6);
+  REQUIRE(outer->count == 3);
+  REQUIRE(outer->total >= inner->total);
+  const ProfileTotal *counter = FindTotal(summary.counters, "test counter");
+  REQUIRE(counter != nullptr);
+  REQUIRE(counter->count == 3);
+  REQUIRE(counter->total == 10 + 11 + 12);
+  REQUIRE(counter->max == 12);
+
+  /* nothing began after now */
+  REQUIRE(FindTotal(ProfileSummarize(ProfileNow() + 1).zones, "test inner") ==
+          nullptr);
+}
+
+TEST_CASE("profile ring keeps the latest events", "[Profile]") {
+  const uint64_t since = ProfileNow();
+  const size_t recorded = kProfileRingEvents + 100;
+  std::thread([&] {
+    ProfileThreadName("profile test ring");
+    for (size_t i = 0; i < recorded; i++) {
+      ProfileRecord(ProfileEvent::kCounter, "test ring", ProfileNow(), i);
+    }
+  }).join();
+
+  const std::vector<ProfileThreadEvents> threads = ProfileCollect(since);
+  const ProfileThreadEvents *thread = FindThread(threads, "profile test ring");
+  REQUIRE(thread != nullptr);
+  /* the oldest slot of a full ring may be overwritten by the next event */
+  REQUIRE(thread->events.size() == kProfileRingEvents - 1);
+  for (size_t i = 0; i < thread->events.size(); i++) {
+    REQUIRE(thread->events[i].value == recorded - kProfileRingEvents + 1 + i);
+  }
+}
+
+TEST_CASE("profile collect while threads record", "[Profile]") {
+  const uint64_t since = ProfileNow();
+  std::atomic<bool> done = false;
+  std::thread writer([&] {
+    ProfileThreadName("profile test concurrent");
+    for (uint64_t i = 0; !done; i++) {
+      ProfileRecord(ProfileEvent::kCounter, "test concurrent", ProfileNow(),
+                    i);
+    }
+  });
+
+  /* copied events are consecutive, torn slots are dropped */
+  for (int round = 0; round < 50; round++) {
+    const std::vector<ProfileThreadEvents> threads = ProfileCollect(since);
+    const ProfileThreadEvents *thread =
+        FindThread(threads, "profile test concurrent");
+    if (thread == nullptr)
+      continue;
+    REQUIRE(thread->events.size() <= kProfileRingEvents);
+    for (size_t i = 1; i < thread->events.size(); i++) {
+      REQUIRE(thread->events[i].value == thread->events[i - 1].value + 1);
+    }
+  }
+  done = true;
+  writer.join();
+}
+
+TEST_CASE("profile trace", "[Profile]") {
+  std::thread([] {
+    ProfileThreadName("profile test \"trace\"");
+    ProfileZone zone("test trace zone");
+  }).join();
+
+  const std::string path = "profile-test-trace.json";
+  REQUIRE(ProfileWriteTrace(path));
+  std::stringstream contents;
+  contents << std::ifstream(path).rdbuf();
+  std::remove(path.c_str());
+
+  const std::string trace = contents.str();
+  REQUIRE(trace.starts_with("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+  REQUIRE(trace.ends_with("]}\n"));
+  REQUIRE(trace.find("\"name\":\"profile test \\\"trace\\\"\"") !=
+          std::string::npos);
+  REQUIRE(trace.find("\"ph\":\"X\"") != std::string::npos);
+  REQUIRE(trace.find("\"name\":\"test trace zone\"") != std::string::npos);
+
+  REQUIRE_FALSE(ProfileWriteTrace("/nonexistent-directory/trace.json"));
+}
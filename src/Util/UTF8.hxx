@@ -0,0 +1,140 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* U+FFFD, drawn in place of invalid sequences */
+constexpr uint32_t kReplacementCharacter = 0xfffd;
+
+/* Returns the number of leading bytes of data which are ASCII.
+ *
+ * Source code is mostly ASCII, so whole blocks are checked at once using the
+ * high bit of every byte, and only the block containing the first non-ASCII
+ * byte is looked at byte by byte */
+inline size_t ASCIIPrefixLength(const uint8_t *data, size_t len) {
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  for (; i + 32 <= len; i += 32) {
+    const __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+    const uint32_t mask = _mm256_movemask_epi8(block);
+    if (mask != 0)
+      return i + std::countr_zero(mask);
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 16 <= len; i += 16) {
+    const __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+    const uint32_t mask = _mm_movemask_epi8(block);
+    if (mask != 0)
+      return i + std::countr_zero(mask);
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 16 <= len; i += 16) {
+    if (vmaxvq_u8(vld1q_u8(data + i)) >= 0x80)
+      break;
+  }
+#endif
+
+  /* remaining bytes a word at a time */
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    const uint64_t high_bits = word & 0x8080808080808080;
+    if (high_bits != 0) {
+      if constexpr (std::endian::native == std::endian::little) {
+        return i + std::countr_zero(high_bits) / 8;
+      }
+      break;
+    }
+  }
+
+  for (; i < len; i++) {
+    if (data[i] >= 0x80)
+      return i;
+  }
+  return len;
+}
+
+/* Number of bytes of the sequence started by lead, or 0 if lead can not start
+ * a sequence */
+inline size_t UTF8SequenceLength(uint8_t lead) {
+  if (lead < 0x80)
+    return 1;
+  if (lead < 0xc2)
+    return 0; /* continuation bytes, and overlong 2 byte sequences */
+  if (lead < 0xe0)
+    return 2;
+  if (lead < 0xf0)
+    return 3;
+  if (lead < 0xf5)
+    return 4;
+  return 0;
+}
+
+/* Decodes the codepoint at the start of data, which must not be empty.
+ *
+ * Invalid sequences, overlong encodings, surrogates and truncated sequences
+ * decode to kReplacementCharacter. len is set to the number of bytes used,
+ * which is 1 for invalid sequences, so that decoding resumes at the next
+ * byte */
+inline uint32_t DecodeUTF8(const uint8_t *data, size_t available,
+                           size_t *len) {
+  const uint8_t lead = data[0];
+  const size_t sequence_len = UTF8SequenceLength(lead);
+  *len = 1;
+
+  if (sequence_len == 1)
+    return lead;
+  if (sequence_len == 0 || sequence_len > available)
+    return kReplacementCharacter;
+
+  uint32_t codepoint = lead & (0x7f >> sequence_len);
+  for (size_t i = 1; i < sequence_len; i++) {
+    if ((data[i] & 0xc0) != 0x80)
+      return kReplacementCharacter;
+    codepoint = codepoint << 6 | (data[i] & 0x3f);
+  }
+
+  /* overlong 3 and 4 byte sequences, surrogates, and beyond U+10FFFF */
+  constexpr uint32_t min_codepoint[5] = {0, 0, 0x80, 0x800, 0x10000};
+  if (codepoint < min_codepoint[sequence_len] || codepoint > 0x10ffff ||
+      (codepoint >= 0xd800 && codepoint <= 0xdfff))
+    return kReplacementCharacter;
+
+  *len = sequence_len;
+  return codepoint;
+}
+
+/* appends the encoding of codepoint to out, returns the number of bytes */
+template <typename String>
+inline size_t EncodeUTF8(uint32_t codepoint, String &out) {
+  if (codepoint < 0x80) {
+    out.push_back(codepoint);
+    return 1;
+  }
+  if (codepoint < 0x800) {
+    out.push_back(0xc0 | codepoint >> 6);
+    out.push_back(0x80 | (codepoint & 0x3f));
+    return 2;
+  }
+  if (codepoint < 0x10000) {
+    out.push_back(0xe0 | codepoint >> 12);
+    out.push_back(0x80 | (codepoint >> 6 & 0x3f));
+    out.push_back(0x80 | (codepoint & 0x3f));
+    return 3;
+  }
+  out.push_back(0xf0 | codepoint >> 18);
+  out.push_back(0x80 | (codepoint >> 12 & 0x3f));
+  out.push_back(0x80 | (codepoint >> 6 & 0x3f));
+  out.push_back(0x80 | (codepoint & 0x3f));
+  return 4;
+}
@@ -0,0 +1,73 @@
+#include "UTF8.hxx"
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <vector>
+
+static uint32_t Decode(std::string_view s, size_t *len) {
+  return DecodeUTF8((const uint8_t *)s.data(), s.size(), len);
+}
+
+TEST_CASE("decode utf8", "[UTF8]") {
+  size_t len;
+
+  SECTION("valid sequences") {
+    REQUIRE(Decode("a", &len) == 'a');
+    REQUIRE(len == 1);
+    REQUIRE(Decode("\xc3\xa9", &len) == 0xe9);
+    REQUIRE(len == 2);
+    REQUIRE(Decode("\xe2\x82\xac", &len) == 0x20ac);
+    REQUIRE(len == 3);
+    REQUIRE(Decode("\xf0\x9f\x98\x80", &len) == 0x1f600);
+    REQUIRE(len == 4);
+    REQUIRE(Decode("\xf4\x8f\xbf\xbf", &len) == 0x10ffff);
+    REQUIRE(len == 4);
+  }
+
+  SECTION("invalid sequences are replaced one byte at a time") {
+    for (std::string_view invalid : {
+             "\x80",             /* lone continuation byte */
+             "\xc0\xaf",         /* overlong '/' */
+             "\xe0\x80\xaf",     /* overlong '/' */
+             "\xf0\x80\x80\xaf", /* overlong '/' */
+             "\xed\xa0\x80",     /* surrogate */
+             "\xf4\x90\x80\x80", /* beyond U+10FFFF */
+             "\xff",
+             "\xc3",             /* truncated */
+             "\xe2\x82",         /* truncated */
+             "\xc3x",            /* missing continuation byte */
+         }) {
+      REQUIRE(Decode(invalid, &len) == kReplacementCharacter);
+      REQUIRE(len == 1);
+    }
+  }
+
+  SECTION("encoding round trips") {
+    for (uint32_t codepoint : {0x24u, 0xa3u, 0x939u, 0x20acu, 0xd55cu,
+                               0xfffdu, 0x10348u, 0x10ffffu}) {
+      std::string encoded;
+      const size_t encoded_len = EncodeUTF8(codepoint, encoded);
+      REQUIRE(encoded.size() == encoded_len);
+      REQUIRE(Decode(encoded, &len) == codepoint);
+      REQUIRE(len == encoded_len);
+    }
+  }
+}
+
+TEST_CASE("ascii prefix length", "[UTF8]") {
+  /* every length and position of the first non-ASCII byte, at every
+   * alignment, to cover the block, word and byte loops */
+  std::vector<uint8_t> data(128 + 16, 'a');
+  for (size_t offset = 0; offset < 16; offset++) {
+    for (size_t len = 0; len <= 128; len++) {
+      const uint8_t *begin = data.data() + offset;
+      REQUIRE(ASCIIPrefixLength(begin, len) == len);
+
+      for (size_t non_ascii = 0; non_ascii < len; non_ascii++) {
+        data[offset + non_ascii] = 0xc3;
+        REQUIRE(ASCIIPrefixLength(begin, len) == non_ascii);
+        data[offset + non_ascii] = 'a';
+      }
+    }
+  }
+}